@@ -0,0 +1,209 @@
+#include <common/aescfb8.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <stdexcept>
+
+#include <immintrin.h>
+#include <openssl/evp.h>
+
+#define AES_NI_TARGET __attribute__((target("aes,sse4.1")))
+
+namespace vitamine::detail
+{
+	// cfb8 encryption is inherently serial, every byte needs the ciphertext of the previous one
+	// decryption only depends on ciphertext that is already known, so blocks for several bytes are in flight at once
+	constexpr UInt AES_CFB8_DECRYPT_LANES = 8;
+
+	template <int roundConstant>
+	AES_NI_TARGET
+	static
+	__m128i expandAesKey(__m128i key)
+	{
+		auto assist = _mm_shuffle_epi32(_mm_aeskeygenassist_si128(key, roundConstant), 0xff);
+		key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+		key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+		key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+		return _mm_xor_si128(key, assist);
+	}
+
+	AES_NI_TARGET
+	static
+	void expandAesKeyAesNi(UInt8 const* key, UInt8 (*roundKeys)[16])
+	{
+		__m128i keys[11];
+		keys[0]  = _mm_loadu_si128((__m128i const*)key);
+		keys[1]  = expandAesKey<0x01>(keys[0]);
+		keys[2]  = expandAesKey<0x02>(keys[1]);
+		keys[3]  = expandAesKey<0x04>(keys[2]);
+		keys[4]  = expandAesKey<0x08>(keys[3]);
+		keys[5]  = expandAesKey<0x10>(keys[4]);
+		keys[6]  = expandAesKey<0x20>(keys[5]);
+		keys[7]  = expandAesKey<0x40>(keys[6]);
+		keys[8]  = expandAesKey<0x80>(keys[7]);
+		keys[9]  = expandAesKey<0x1b>(keys[8]);
+		keys[10] = expandAesKey<0x36>(keys[9]);
+
+		for(auto i = 0; i != 11; ++i)
+			_mm_store_si128((__m128i*)roundKeys[i], keys[i]);
+	}
+
+	AES_NI_TARGET
+	static
+	void encryptCfb8AesNi(UInt8 const (*roundKeys)[16], UInt8* shiftRegister, UInt8 const* in, UInt8* out, UInt size)
+	{
+		__m128i keys[11];
+
+		for(auto i = 0; i != 11; ++i)
+			keys[i] = _mm_load_si128((__m128i const*)roundKeys[i]);
+
+		auto shift = _mm_load_si128((__m128i const*)shiftRegister);
+
+		for(UInt i = 0; i != size; ++i)
+		{
+			auto block = _mm_xor_si128(shift, keys[0]);
+
+			for(auto round = 1; round != 10; ++round)
+				block = _mm_aesenc_si128(block, keys[round]);
+
+			block = _mm_aesenclast_si128(block, keys[10]);
+
+			auto c = (UInt8)(in[i] ^ (UInt8)_mm_cvtsi128_si32(block));
+			out[i] = c;
+			shift = _mm_insert_epi8(_mm_srli_si128(shift, 1), c, 15);
+		}
+
+		_mm_store_si128((__m128i*)shiftRegister, shift);
+	}
+
+	AES_NI_TARGET
+	static
+	void decryptCfb8AesNi(UInt8 const (*roundKeys)[16], UInt8* shiftRegister, UInt8 const* in, UInt8* out, UInt size)
+	{
+		constexpr auto LANES = AES_CFB8_DECRYPT_LANES;
+
+		__m128i keys[11];
+
+		for(auto i = 0; i != 11; ++i)
+			keys[i] = _mm_load_si128((__m128i const*)roundKeys[i]);
+
+		// the shift register followed by the ciphertext of the current group
+		// the ciphertext is copied first because the output may overwrite it
+		alignas(16) UInt8 history[16 + LANES] = {};
+		std::memcpy(history, shiftRegister, 16);
+
+		for(UInt done = 0; done != size;)
+		{
+			auto count = std::min(size - done, LANES);
+			std::memcpy(history + 16, in + done, count);
+
+			// the input for byte i is the 16 bytes of ciphertext preceding it
+			__m128i blocks[LANES];
+
+			for(UInt lane = 0; lane != LANES; ++lane)
+				blocks[lane] = _mm_xor_si128(_mm_loadu_si128((__m128i const*)(history + lane)), keys[0]);
+
+			for(auto round = 1; round != 10; ++round)
+				for(UInt lane = 0; lane != LANES; ++lane)
+					blocks[lane] = _mm_aesenc_si128(blocks[lane], keys[round]);
+
+			for(UInt lane = 0; lane != LANES; ++lane)
+				blocks[lane] = _mm_aesenclast_si128(blocks[lane], keys[10]);
+
+			for(UInt lane = 0; lane != count; ++lane)
+				out[done + lane] = history[16 + lane] ^ (UInt8)_mm_cvtsi128_si32(blocks[lane]);
+
+			std::memmove(history, history + count, 16);
+			done += count;
+		}
+
+		std::memcpy(shiftRegister, history, 16);
+	}
+
+	static
+	evp_cipher_ctx_st* createOpenSslContext(UInt8 const* key, bool encrypt)
+	{
+		auto context = EVP_CIPHER_CTX_new();
+
+		if(!context || EVP_CipherInit_ex(context, EVP_aes_128_cfb8(), nullptr, key, key, encrypt) != 1)
+		{
+			EVP_CIPHER_CTX_free(context);
+			throw std::runtime_error("failed to initialize aes-128-cfb8");
+		}
+
+		return context;
+	}
+
+	static
+	void updateOpenSsl(evp_cipher_ctx_st* context, UInt8 const* in, UInt8* out, UInt size)
+	{
+		// cfb8 is a stream mode, the output is always as long as the input
+		while(size != 0)
+		{
+			auto chunk = (int)std::min<UInt>(size, 1 << 30);
+			int written;
+			EVP_CipherUpdate(context, out, &written, in, chunk);
+			in += chunk;
+			out += chunk;
+			size -= chunk;
+		}
+	}
+}
+
+namespace vitamine
+{
+	AesCfb8::AesCfb8(Span<UInt8 const> key)
+	{
+		assert(key.size() == AES_CFB8_KEY_SIZE);
+
+		std::memcpy(_encryptRegister, key.data(), AES_CFB8_KEY_SIZE);
+		std::memcpy(_decryptRegister, key.data(), AES_CFB8_KEY_SIZE);
+
+		if(hardwareAccelerated())
+		{
+			detail::expandAesKeyAesNi(key.data(), _roundKeys);
+			return;
+		}
+
+		_encryptContext = detail::createOpenSslContext(key.data(), true);
+
+		try
+		{
+			_decryptContext = detail::createOpenSslContext(key.data(), false);
+		}
+		catch(...)
+		{
+			EVP_CIPHER_CTX_free(_encryptContext);
+			throw;
+		}
+	}
+
+	AesCfb8::~AesCfb8()
+	{
+		EVP_CIPHER_CTX_free(_encryptContext);
+		EVP_CIPHER_CTX_free(_decryptContext);
+	}
+
+	void AesCfb8::encrypt(UInt8 const* in, UInt8* out, UInt size)
+	{
+		if(_encryptContext)
+			detail::updateOpenSsl(_encryptContext, in, out, size);
+		else
+			detail::encryptCfb8AesNi(_roundKeys, _encryptRegister, in, out, size);
+	}
+
+	void AesCfb8::decrypt(UInt8 const* in, UInt8* out, UInt size)
+	{
+		if(_decryptContext)
+			detail::updateOpenSsl(_decryptContext, in, out, size);
+		else
+			detail::decryptCfb8AesNi(_roundKeys, _decryptRegister, in, out, size);
+	}
+
+	bool AesCfb8::hardwareAccelerated()
+	{
+		static bool const supported = __builtin_cpu_supports("aes") && __builtin_cpu_supports("sse4.1");
+		return supported;
+	}
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <common/span.hpp>
+#include <common/types.hpp>
+
+struct evp_cipher_ctx_st;
+
+namespace vitamine
+{
+	constexpr UInt AES_CFB8_KEY_SIZE = 16;
+
+	// aes-128 in cfb8 mode, the key doubles as the initialization vector
+	// both directions of a stream keep their own shift register, so one instance serves a whole connection
+	// uses aes-ni if the cpu supports it and openssl otherwise
+	class AesCfb8
+	{
+		alignas(16) UInt8 _roundKeys[11][16];
+		alignas(16) UInt8 _encryptRegister[16];
+		alignas(16) UInt8 _decryptRegister[16];
+
+		evp_cipher_ctx_st* _encryptContext = nullptr;
+		evp_cipher_ctx_st* _decryptContext = nullptr;
+
+	public:
+		explicit AesCfb8(Span<UInt8 const> key);
+		~AesCfb8();
+
+		AesCfb8(AesCfb8 const&) = delete;
+		AesCfb8& operator=(AesCfb8 const&) = delete;
+
+		// in and out may be the same buffer, but must not overlap otherwise
+		void encrypt(UInt8 const* in, UInt8* out, UInt size);
+		void decrypt(UInt8 const* in, UInt8* out, UInt size);
+
+		[[nodiscard]]
+		static bool hardwareAccelerated();
+	};
+}
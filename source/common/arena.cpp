@@ -0,0 +1,39 @@
+#include <common/arena.hpp>
+
+#include <algorithm>
+
+namespace vitamine
+{
+	Arena::~Arena()
+	{
+		for(auto& block : _blocks)
+			::operator delete(block.data);
+	}
+
+	void* Arena::allocateSlow(UInt size, UInt align)
+	{
+		// every block starts at an address aligned for any type, so this much space always fits the allocation
+		auto required = size + align;
+
+		// blocks that are too small are skipped until the next rewind
+		while(_nextBlock != _blocks.size() && _blocks[_nextBlock].size < required)
+			++_nextBlock;
+
+		if(_nextBlock == _blocks.size())
+		{
+			auto blockSize = std::max(required, ARENA_BLOCK_SIZE);
+			_blocks.push_back({(UInt8*)::operator new(blockSize), blockSize});
+		}
+
+		auto& block = _blocks[_nextBlock++];
+		_pos = block.data;
+		_end = block.data + block.size;
+		return allocate(size, align);
+	}
+
+	Arena& threadArena()
+	{
+		static thread_local Arena arena;
+		return arena;
+	}
+}
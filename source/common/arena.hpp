@@ -0,0 +1,113 @@
+#pragma once
+
+#include <new>
+#include <type_traits>
+#include <vector>
+
+#include <common/span.hpp>
+#include <common/types.hpp>
+
+namespace vitamine
+{
+	constexpr UInt ARENA_BLOCK_SIZE = 16384;
+
+	// monotonic allocator for data that only lives while a packet is decoded, handled or built
+	// memory is released all at once by rewinding to an earlier mark, destructors are never run
+	// blocks are kept across rewinds, so an arena that has warmed up does not allocate anymore
+	class Arena
+	{
+		struct Block
+		{
+			UInt8* data;
+			UInt size;
+		};
+
+		std::vector<Block> _blocks;
+
+		// index of the block after the one that is currently allocated from
+		UInt _nextBlock = 0;
+		UInt8* _pos = nullptr;
+		UInt8* _end = nullptr;
+
+		void* allocateSlow(UInt size, UInt align);
+
+	public:
+		struct Mark
+		{
+			UInt nextBlock;
+			UInt8* pos;
+			UInt8* end;
+		};
+
+		Arena() = default;
+		~Arena();
+
+		Arena(Arena const&) = delete;
+		Arena& operator=(Arena const&) = delete;
+
+		[[nodiscard]]
+		Mark mark() const
+		{
+			return {_nextBlock, _pos, _end};
+		}
+
+		// frees everything allocated since the mark was taken
+		void rewind(Mark mark)
+		{
+			_nextBlock = mark.nextBlock;
+			_pos = mark.pos;
+			_end = mark.end;
+		}
+
+		[[nodiscard]]
+		void* allocate(UInt size, UInt align)
+		{
+			auto ptr = (UInt8*)(((UInt)_pos + align - 1) & ~(align - 1));
+
+			if(ptr > _end || size > (UInt)(_end - ptr))
+				return allocateSlow(size, align);
+
+			_pos = ptr + size;
+			return ptr;
+		}
+
+		// the elements are value initialized
+		template <typename T>
+		[[nodiscard]]
+		Span<T> allocateArray(UInt count)
+		{
+			static_assert(std::is_trivially_destructible_v<T>, "arena memory is released without running destructors");
+
+			auto ptr = (T*)allocate(count * sizeof(T), alignof(T));
+
+			for(UInt i = 0; i != count; ++i)
+				new(ptr + i) T();
+
+			return Span(ptr, count);
+		}
+	};
+
+	// rewinds the arena to where it was when the scope was entered
+	class ArenaScope
+	{
+		Arena& _arena;
+		Arena::Mark _mark;
+
+	public:
+		explicit ArenaScope(Arena& arena)
+		: _arena(arena), _mark(arena.mark())
+		{}
+
+		~ArenaScope()
+		{
+			_arena.rewind(_mark);
+		}
+
+		ArenaScope(ArenaScope const&) = delete;
+		ArenaScope& operator=(ArenaScope const&) = delete;
+	};
+
+	// arena of the calling thread, for packets decoded and built on a reactor thread
+	[[nodiscard]]
+	Arena& threadArena();
+}
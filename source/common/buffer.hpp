@@ -1,32 +1,61 @@
 #pragma once
 
 #include <cassert>
+#include <cstring>
 
+#include <common/bufferpool.hpp>
 #include <common/types.hpp>
 
 #include <boost/container/small_vector.hpp>
 
 namespace vitamine
 {
+	// space reserved in front of the data, so that framing headers can be prepended without moving the data
+	// fits the packet length, data length and packet id varints of a compressed frame
+	constexpr UInt BUFFER_HEADROOM = 16;
+
 	class Buffer
 	{
-		boost::container::small_vector<UInt8, 40> _data;
+		// data that does not fit inline is allocated from the thread local pool
+		// packets are usually freed by the reactor thread once written and reused by its next serialization
+		boost::container::small_vector<UInt8, 48, PoolAllocator<UInt8>> _data;
+
+		// offset of the first byte of data in _data
+		UInt _begin;
 
 	public:
+		Buffer()
+		: _data(BUFFER_HEADROOM, boost::container::default_init), _begin(BUFFER_HEADROOM)
+		{}
+
 		void* data()
 		{
-			return _data.data();
+			return _data.data() + _begin;
+		}
+
+		void const* data() const
+		{
+			return _data.data() + _begin;
+		}
+
+		UInt size() const
+		{
+			return _data.size() - _begin;
 		}
 
-		UInt size()
+		void clear()
 		{
-			return _data.size();
+			_data.resize(BUFFER_HEADROOM);
+			_begin = BUFFER_HEADROOM;
 		}
 
 		void discard(UInt size)
 		{
-			assert(size <= _data.size());
-			_data.erase(_data.begin(), _data.begin() + size);
+			assert(size <= this->size());
+			_begin += size;
+
+			if(_begin == _data.size())
+				clear();
 		}
 
 		void write(void const* data, UInt size)
@@ -35,12 +64,50 @@ namespace vitamine
 			_data.insert(_data.end(), it, it + size);
 		}
 
+		// appends 'size' uninitialized bytes and returns a pointer to them, grows the storage at most once
+		UInt8* extend(UInt size)
+		{
+			auto oldSize = _data.size();
+			_data.resize(oldSize + size, boost::container::default_init);
+			return _data.data() + oldSize;
+		}
+
 		void prepend(void const* data, UInt size)
 		{
-			auto it = (UInt8 const*)data;
-			_data.insert(_data.begin(), it, it + size);
+			if(size > _begin)
+			{
+				auto it = (UInt8 const*)data;
+				_data.insert(_data.begin() + _begin, it, it + size);
+				return;
+			}
+
+			_begin -= size;
+			std::memcpy(_data.data() + _begin, data, size);
 		}
 	};
 
-	static_assert(sizeof(Buffer) == 64);
+	static_assert(sizeof(Buffer) == 80);
+
+	// output buffer over space that has already been allocated, e.g. by Buffer::extend
+	// writes do not check for room, the caller must know the exact size in advance
+	class UncheckedWriter
+	{
+		UInt8* _pos;
+
+	public:
+		explicit UncheckedWriter(UInt8* pos)
+		: _pos(pos)
+		{}
+
+		UInt8* position() const
+		{
+			return _pos;
+		}
+
+		void write(void const* data, UInt size)
+		{
+			std::memcpy(_pos, data, size);
+			_pos += size;
+		}
+	};
 }
@@ -0,0 +1,177 @@
+#include <common/bufferpool.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace vitamine::detail
+{
+	// size classes are powers of two from 64 bytes to 64 KiB, larger allocations bypass the pool
+	constexpr UInt POOL_MIN_CLASS_SHIFT = 6;
+	constexpr UInt POOL_MAX_CLASS_SHIFT = 16;
+	constexpr UInt POOL_CLASS_COUNT = POOL_MAX_CLASS_SHIFT - POOL_MIN_CLASS_SHIFT + 1;
+
+	// upper bound for the memory a thread keeps cached per size class
+	constexpr UInt POOL_MAX_CACHED_BYTES_PER_CLASS = 1 << 20;
+
+	static
+	UInt poolClassIndex(UInt size)
+	{
+		if(size <= (1u << POOL_MIN_CLASS_SHIFT))
+			return 0;
+
+		auto shift = 64 - __builtin_clzll(size - 1);
+		return shift - POOL_MIN_CLASS_SHIFT;
+	}
+
+	static
+	UInt poolClassSize(UInt index)
+	{
+		return (UInt)1 << (index + POOL_MIN_CLASS_SHIFT);
+	}
+
+	struct FreeBlock
+	{
+		FreeBlock* next;
+	};
+
+	class ThreadPool;
+
+	struct PoolRegistry
+	{
+		std::mutex mutex;
+		std::vector<ThreadPool*> pools;
+
+		// stats of threads that have exited
+		BufferPoolStats retired = {};
+	};
+
+	static
+	PoolRegistry& poolRegistry()
+	{
+		// never destroyed, thread pools may unregister after static destruction has started
+		static auto registry = new PoolRegistry();
+		return *registry;
+	}
+
+	class ThreadPool
+	{
+		FreeBlock* _freeLists[POOL_CLASS_COUNT] = {};
+		UInt _freeCounts[POOL_CLASS_COUNT] = {};
+
+	public:
+		// only modified by the owning thread, read by bufferPoolStats()
+		std::atomic<UInt64> hits = 0;
+		std::atomic<UInt64> misses = 0;
+
+		ThreadPool()
+		{
+			auto& registry = poolRegistry();
+			std::lock_guard lock(registry.mutex);
+			registry.pools.push_back(this);
+		}
+
+		~ThreadPool();
+
+		ThreadPool(ThreadPool const&) = delete;
+		ThreadPool& operator=(ThreadPool const&) = delete;
+
+		void* allocate(UInt index)
+		{
+			if(auto block = _freeLists[index])
+			{
+				_freeLists[index] = block->next;
+				--_freeCounts[index];
+				hits.store(hits.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+				return block;
+			}
+
+			misses.store(misses.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+			return ::operator new(poolClassSize(index));
+		}
+
+		void deallocate(void* ptr, UInt index)
+		{
+			if(_freeCounts[index] * poolClassSize(index) >= POOL_MAX_CACHED_BYTES_PER_CLASS)
+			{
+				::operator delete(ptr);
+				return;
+			}
+
+			auto block = (FreeBlock*)ptr;
+			block->next = _freeLists[index];
+			_freeLists[index] = block;
+			++_freeCounts[index];
+		}
+	};
+
+	// set once the pool of the current thread has been destroyed, buffers freed afterwards go to the heap
+	static thread_local bool threadPoolDestroyed = false;
+	static thread_local ThreadPool threadPool;
+
+	ThreadPool::~ThreadPool()
+	{
+		threadPoolDestroyed = true;
+
+		for(auto& list : _freeLists)
+		{
+			while(list)
+			{
+				auto next = list->next;
+				::operator delete(list);
+				list = next;
+			}
+		}
+
+		auto& registry = poolRegistry();
+		std::lock_guard lock(registry.mutex);
+		registry.pools.erase(std::find(registry.pools.begin(), registry.pools.end(), this));
+		registry.retired.hits += hits;
+		registry.retired.misses += misses;
+	}
+
+	void* poolAllocate(UInt size)
+	{
+		if(size > poolClassSize(POOL_CLASS_COUNT - 1) || threadPoolDestroyed)
+		{
+			if(!threadPoolDestroyed)
+				threadPool.misses.store(threadPool.misses.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+			return ::operator new(size);
+		}
+
+		return threadPool.allocate(poolClassIndex(size));
+	}
+
+	void poolDeallocate(void* ptr, UInt size) noexcept
+	{
+		if(size > poolClassSize(POOL_CLASS_COUNT - 1) || threadPoolDestroyed)
+		{
+			::operator delete(ptr);
+			return;
+		}
+
+		threadPool.deallocate(ptr, poolClassIndex(size));
+	}
+}
+
+namespace vitamine
+{
+	BufferPoolStats bufferPoolStats()
+	{
+		auto& registry = detail::poolRegistry();
+		std::lock_guard lock(registry.mutex);
+
+		auto stats = registry.retired;
+
+		for(auto pool : registry.pools)
+		{
+			stats.hits += pool->hits.load(std::memory_order_relaxed);
+			stats.misses += pool->misses.load(std::memory_order_relaxed);
+		}
+
+		return stats;
+	}
+}
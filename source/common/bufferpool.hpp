@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+
+#include <common/types.hpp>
+
+namespace vitamine
+{
+	struct BufferPoolStats
+	{
+		// allocations served from a thread's free list
+		UInt64 hits;
+
+		// allocations that had to go to the global heap, including oversized ones
+		UInt64 misses;
+	};
+
+	// totals over all threads, including threads that have already exited
+	[[nodiscard]]
+	BufferPoolStats bufferPoolStats();
+}
+
+namespace vitamine::detail
+{
+	void* poolAllocate(UInt size);
+	void poolDeallocate(void* ptr, UInt size) noexcept;
+}
+
+namespace vitamine
+{
+	// allocates from size classed, thread local free lists
+	// memory may be freed by a different thread than the one that allocated it, it is then cached by the freeing thread
+	template <typename T>
+	struct PoolAllocator
+	{
+		using value_type = T;
+
+		PoolAllocator() = default;
+
+		template <typename U>
+		PoolAllocator(PoolAllocator<U> const&) noexcept
+		{}
+
+		[[nodiscard]]
+		T* allocate(std::size_t count)
+		{
+			return (T*)detail::poolAllocate(count * sizeof(T));
+		}
+
+		void deallocate(T* ptr, std::size_t count) noexcept
+		{
+			detail::poolDeallocate(ptr, count * sizeof(T));
+		}
+
+		friend bool operator==(PoolAllocator, PoolAllocator) noexcept
+		{
+			return true;
+		}
+
+		friend bool operator!=(PoolAllocator, PoolAllocator) noexcept
+		{
+			return false;
+		}
+	};
+}
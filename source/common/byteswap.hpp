@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstring>
+#include <type_traits>
+
+#if defined(__SSSE3__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include <boost/endian/conversion.hpp>
+
+#include <common/types.hpp>
+
+namespace vitamine
+{
+	namespace detail
+	{
+#if defined(__SSSE3__) || defined(__AVX2__)
+		// reverses the bytes of every element of 'size' bytes within a 128 bit lane
+		template <UInt size>
+		__m128i byteSwapShuffle()
+		{
+#define AT(i) (char)((i) / size * size + size - 1 - (i) % size)
+			return _mm_setr_epi8(AT( 0), AT( 1), AT( 2), AT( 3), AT( 4), AT( 5), AT( 6), AT( 7),
+			                     AT( 8), AT( 9), AT(10), AT(11), AT(12), AT(13), AT(14), AT(15));
+#undef AT
+		}
+#endif
+	}
+
+	// copies 'count' integers of type T and converts them between native and big endian order
+	// the conversion is its own inverse, so this serves both directions, 'out' and 'in' need not be aligned
+	template <typename T>
+	void copyBigEndianArray(void* out, void const* in, UInt count)
+	{
+		static_assert(std::is_integral_v<T>);
+
+		auto dst = (UInt8*)out;
+		auto src = (UInt8 const*)in;
+		auto bytes = count * sizeof(T);
+
+		if constexpr(sizeof(T) == 1 || boost::endian::order::native == boost::endian::order::big)
+		{
+			std::memcpy(dst, src, bytes);
+		}
+		else
+		{
+			UInt i = 0;
+
+#if defined(__SSSE3__) || defined(__AVX2__)
+			auto shuffle = detail::byteSwapShuffle<sizeof(T)>();
+
+#ifdef __AVX2__
+			auto shuffle256 = _mm256_broadcastsi128_si256(shuffle);
+
+			for(; i + 32 <= bytes; i += 32)
+			{
+				auto block = _mm256_loadu_si256((__m256i const*)(src + i));
+				_mm256_storeu_si256((__m256i*)(dst + i), _mm256_shuffle_epi8(block, shuffle256));
+			}
+#endif
+
+			for(; i + 16 <= bytes; i += 16)
+			{
+				auto block = _mm_loadu_si128((__m128i const*)(src + i));
+				_mm_storeu_si128((__m128i*)(dst + i), _mm_shuffle_epi8(block, shuffle));
+			}
+#endif
+
+			for(; i != bytes; i += sizeof(T))
+			{
+				T value;
+				std::memcpy(&value, src + i, sizeof value);
+				boost::endian::endian_reverse_inplace(value);
+				std::memcpy(dst + i, &value, sizeof value);
+			}
+		}
+	}
+}
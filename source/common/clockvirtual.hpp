@@ -0,0 +1,23 @@
+#pragma once
+
+#include <common/clock.hpp>
+
+namespace vitamine
+{
+	// only moves when told to, replays drive it from the timestamps of the captured traffic
+	class VirtualClock : public Clock
+	{
+		Int64 _now = 0;
+
+	public:
+		virtual Int64 now() final
+		{
+			return _now;
+		}
+
+		void set(Int64 now)
+		{
+			_now = now;
+		}
+	};
+}
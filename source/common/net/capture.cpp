@@ -0,0 +1,294 @@
+#include <common/net/capture.hpp>
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+
+#include <boost/endian/conversion.hpp>
+
+namespace
+{
+	// unsigned leb128, a capture field never exceeds 64 bits
+	constexpr vitamine::UInt VARINT64_MAX_LENGTH = 10;
+
+	// bits of the header's flags byte
+	constexpr vitamine::UInt8 CAPTURE_FLAG_ONLINE_MODE = 1;
+
+	constexpr vitamine::UInt CAPTURE_HEADER_SIZE = sizeof vitamine::CAPTURE_MAGIC + 1 + 1 + 4;
+
+	vitamine::UInt encodeVarUInt64(vitamine::UInt8* buf, vitamine::UInt64 value)
+	{
+		vitamine::UInt length = 0;
+
+		while(value >= 0x80)
+		{
+			buf[length++] = (vitamine::UInt8)(value | 0x80);
+			value >>= 7;
+		}
+
+		buf[length++] = (vitamine::UInt8)value;
+		return length;
+	}
+
+	bool readVarUInt64(std::FILE* file, vitamine::UInt64* out, bool* eof = nullptr)
+	{
+		vitamine::UInt64 value = 0;
+
+		for(vitamine::UInt i = 0; i != VARINT64_MAX_LENGTH; ++i)
+		{
+			auto c = std::fgetc(file);
+
+			if(c == EOF)
+			{
+				if(eof)
+					*eof = i == 0;
+
+				return false;
+			}
+
+			value |= (vitamine::UInt64)(c & 0x7f) << (7 * i);
+
+			if((c & 0x80) == 0)
+			{
+				*out = value;
+				return true;
+			}
+		}
+
+		return false;
+	}
+}
+
+namespace vitamine::detail
+{
+	// forwards everything to the transport's connection and records what is sent
+	class RecordingConnection : public IConnection, public std::enable_shared_from_this<RecordingConnection>
+	{
+		std::shared_ptr<IConnection> _connection;
+		CaptureWriter* _writer;
+		UInt32 _captureId;
+		bool _captureOutbound;
+		void* _userPointer = nullptr;
+
+	public:
+		RecordingConnection(std::shared_ptr<IConnection> connection, CaptureWriter* writer, UInt32 captureId, bool captureOutbound)
+		: _connection(std::move(connection)), _writer(writer), _captureId(captureId), _captureOutbound(captureOutbound)
+		{}
+
+		[[nodiscard]]
+		UInt32 captureId() const
+		{
+			return _captureId;
+		}
+
+		ConnectionId id() const final
+		{
+			return _connection->id();
+		}
+
+		std::string endpoint() const final
+		{
+			return _connection->endpoint();
+		}
+
+		void userPointer(void* ptr) final
+		{
+			_userPointer = ptr;
+		}
+
+		void* userPointer() final
+		{
+			return _userPointer;
+		}
+
+		WriteQueueDepth writeQueueDepth() const final
+		{
+			return _connection->writeQueueDepth();
+		}
+
+		void send(SharedBuffer buffer, SendPolicy policy) final
+		{
+			// packets the write queue drops or supersedes are recorded anyway
+			if(_captureOutbound)
+				_writer->write(CaptureRecordType::OUTBOUND, _captureId, buffer);
+
+			_connection->send(std::move(buffer), policy);
+		}
+
+		void disconnect() final
+		{
+			_connection->disconnect();
+		}
+
+		void enableEncryption(Span<UInt8 const> sharedSecret) final
+		{
+			_connection->enableEncryption(sharedSecret);
+		}
+
+		void post(std::function<void()> f) final
+		{
+			_connection->post(std::move(f));
+		}
+	};
+}
+
+namespace vitamine
+{
+	CaptureWriter::CaptureWriter(char const* path, CaptureSettings const& settings)
+	: _file(std::fopen(path, "wb"))
+	{
+		if(!_file)
+			throw std::system_error(errno, std::system_category(), path);
+
+		UInt8 header[CAPTURE_HEADER_SIZE];
+		std::memcpy(header, CAPTURE_MAGIC, sizeof CAPTURE_MAGIC);
+		header[4] = CAPTURE_VERSION;
+		header[5] = settings.onlineMode ? CAPTURE_FLAG_ONLINE_MODE : 0;
+		boost::endian::store_big_s32(header + 6, settings.compressionThreshold);
+		std::fwrite(header, 1, sizeof header, _file);
+	}
+
+	CaptureWriter::~CaptureWriter()
+	{
+		std::fclose(_file);
+	}
+
+	void CaptureWriter::writeHeader(CaptureRecordType type, UInt32 connection, UInt size)
+	{
+		UInt8 header[1 + 3 * VARINT64_MAX_LENGTH];
+		UInt length = 0;
+
+		auto now = _clock.now();
+
+		header[length++] = (UInt8)type;
+		length += encodeVarUInt64(header + length, connection);
+		length += encodeVarUInt64(header + length, now - _lastTime);
+
+		if(type == CaptureRecordType::INBOUND || type == CaptureRecordType::OUTBOUND)
+			length += encodeVarUInt64(header + length, size);
+
+		_lastTime = now;
+		std::fwrite(header, 1, length, _file);
+	}
+
+	void CaptureWriter::write(CaptureRecordType type, UInt32 connection, Span<UInt8 const> data)
+	{
+		std::lock_guard lock(_mutex);
+		writeHeader(type, connection, data.size());
+		std::fwrite(data.data(), 1, data.size(), _file);
+	}
+
+	void CaptureWriter::write(CaptureRecordType type, UInt32 connection, SharedBuffer const& data)
+	{
+		std::lock_guard lock(_mutex);
+		writeHeader(type, connection, data.size());
+
+		data.forEachSegment([&](void const* segment, UInt size)
+		{
+			std::fwrite(segment, 1, size, _file);
+		});
+	}
+
+	CaptureReader::CaptureReader(char const* path)
+	: _file(std::fopen(path, "rb"))
+	{
+		if(!_file)
+			throw std::system_error(errno, std::system_category(), path);
+
+		UInt8 header[CAPTURE_HEADER_SIZE];
+
+		// the version is checked before the rest of the header, whose layout depends on it
+		if(std::fread(header, 1, sizeof CAPTURE_MAGIC + 1, _file) != sizeof CAPTURE_MAGIC + 1
+		|| std::memcmp(header, CAPTURE_MAGIC, sizeof CAPTURE_MAGIC) != 0 || header[4] != CAPTURE_VERSION)
+		{
+			std::fclose(_file);
+			throw std::runtime_error("not a capture file or unsupported capture version");
+		}
+
+		if(std::fread(header + 5, 1, sizeof header - 5, _file) != sizeof header - 5 || (header[5] & ~CAPTURE_FLAG_ONLINE_MODE) != 0)
+		{
+			std::fclose(_file);
+			throw std::runtime_error("truncated or invalid capture header");
+		}
+
+		_settings.onlineMode = (header[5] & CAPTURE_FLAG_ONLINE_MODE) != 0;
+		_settings.compressionThreshold = boost::endian::load_big_s32(header + 6);
+	}
+
+	CaptureReader::~CaptureReader()
+	{
+		std::fclose(_file);
+	}
+
+	bool CaptureReader::next(CaptureRecord* out)
+	{
+		auto type = std::fgetc(_file);
+
+		if(type == EOF)
+			return false;
+
+		if(type < (int)CaptureRecordType::CONNECT || type > (int)CaptureRecordType::OUTBOUND)
+			throw std::runtime_error("invalid capture record type");
+
+		UInt64 connection, delta, size = 0;
+
+		if(!readVarUInt64(_file, &connection) || connection > UINT32_MAX || !readVarUInt64(_file, &delta))
+			throw std::runtime_error("truncated capture record");
+
+		out->type = (CaptureRecordType)type;
+		out->connection = (UInt32)connection;
+		out->time = _time += (Int64)delta;
+
+		if(out->type == CaptureRecordType::INBOUND || out->type == CaptureRecordType::OUTBOUND)
+		{
+			if(!readVarUInt64(_file, &size))
+				throw std::runtime_error("truncated capture record");
+
+			_data.resize(size);
+
+			if(std::fread(_data.data(), 1, size, _file) != size)
+				throw std::runtime_error("truncated capture record");
+		}
+
+		out->data = {_data.data(), (UInt)size};
+		return true;
+	}
+
+	RecordingConnectionHandler::RecordingConnectionHandler(IConnectionHandler* handler, CaptureWriter* writer, bool captureOutbound)
+	: _handler(handler), _writer(writer), _captureOutbound(captureOutbound)
+	{}
+
+	void RecordingConnectionHandler::onClientConnected(std::shared_ptr<IConnection> connection)
+	{
+		std::unique_lock lock(_mutex);
+		auto recording = std::make_shared<detail::RecordingConnection>(connection, _writer, _nextConnection++, _captureOutbound);
+		_connections.emplace(&*connection, recording);
+		lock.unlock();
+
+		// the wrapped handler owns the wrapper's user pointer, the transport's connection points to the wrapper
+		connection->userPointer(&*recording);
+
+		_writer->write(CaptureRecordType::CONNECT, recording->captureId());
+		_handler->onClientConnected(recording);
+	}
+
+	void RecordingConnectionHandler::onDataReceived(std::shared_ptr<IConnection> connection, Span<UInt8 const> data)
+	{
+		auto recording = static_cast<detail::RecordingConnection*>(connection->userPointer());
+		_writer->write(CaptureRecordType::INBOUND, recording->captureId(), data);
+		_handler->onDataReceived(recording->shared_from_this(), data);
+	}
+
+	void RecordingConnectionHandler::onClientDisconnected(std::shared_ptr<IConnection> connection)
+	{
+		std::unique_lock lock(_mutex);
+		auto it = _connections.find(&*connection);
+		auto recording = std::move(it->second);
+		_connections.erase(it);
+		lock.unlock();
+
+		_writer->write(CaptureRecordType::DISCONNECT, recording->captureId());
+		_handler->onClientDisconnected(recording);
+	}
+}
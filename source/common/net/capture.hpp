@@ -0,0 +1,130 @@
+#pragma once
+
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include <common/clockmonotonic.hpp>
+#include <common/sharedbuffer.hpp>
+#include <common/span.hpp>
+#include <common/types.hpp>
+#include <common/net/connectionhandler.hpp>
+
+namespace vitamine
+{
+	// capture files start with a header, followed by records until the end of the file
+	// header: [magic:4, version:u8, flags:u8, compression threshold:i32 big endian]
+	// record: [type:u8, connection:varint, time:varint, size:varint, data]
+	// the time is in nanoseconds since the previous record, size and data are only present for data records
+	constexpr UInt8 CAPTURE_MAGIC[4] = {'V', 'C', 'A', 'P'};
+	constexpr UInt8 CAPTURE_VERSION = 2;
+
+	// the settings of the captured server that the recorded clients depend on, a replay has to use the same ones
+	struct CaptureSettings
+	{
+		// clients compress their packets according to it, negative if compression was disabled
+		Int32 compressionThreshold = -1;
+
+		// the inbound traffic of logins depends on the server's key pair, which is not captured
+		bool onlineMode = false;
+	};
+
+	enum struct CaptureRecordType : UInt8
+	{
+		CONNECT    = 1,
+		DISCONNECT = 2,
+
+		// bytes as passed to onDataReceived, after decryption
+		INBOUND    = 3,
+
+		// bytes as passed to send, before encryption
+		OUTBOUND   = 4,
+	};
+
+	struct CaptureRecord
+	{
+		CaptureRecordType type;
+
+		// numbered in the order connections were captured, starting at 0
+		UInt32 connection;
+
+		// nanoseconds since the capture started
+		Int64 time;
+
+		Span<UInt8 const> data;
+	};
+
+	// may be used from any thread, records are written in the order their timestamps were taken
+	class CaptureWriter
+	{
+		std::mutex _mutex;
+		std::FILE* _file;
+		MonotonicClock _clock;
+		Int64 _lastTime = 0;
+
+		void writeHeader(CaptureRecordType type, UInt32 connection, UInt size);
+
+	public:
+		// throws std::system_error if the file cannot be created
+		CaptureWriter(char const* path, CaptureSettings const& settings);
+		~CaptureWriter();
+
+		CaptureWriter(CaptureWriter const&) = delete;
+		CaptureWriter& operator=(CaptureWriter const&) = delete;
+
+		void write(CaptureRecordType type, UInt32 connection, Span<UInt8 const> data = {});
+		void write(CaptureRecordType type, UInt32 connection, SharedBuffer const& data);
+	};
+
+	class CaptureReader
+	{
+		std::FILE* _file;
+		std::vector<UInt8> _data;
+		Int64 _time = 0;
+		CaptureSettings _settings;
+
+	public:
+		// throws std::system_error if the file cannot be opened and std::runtime_error if it is not a capture
+		explicit CaptureReader(char const* path);
+		~CaptureReader();
+
+		CaptureReader(CaptureReader const&) = delete;
+		CaptureReader& operator=(CaptureReader const&) = delete;
+
+		CaptureSettings const& settings() const
+		{
+			return _settings;
+		}
+
+		// returns false at the end of the capture, throws std::runtime_error if a record is truncated or invalid
+		// the record's data stays valid until the next call
+		bool next(CaptureRecord* out);
+	};
+
+	namespace detail
+	{
+		class RecordingConnection;
+	}
+
+	// captures the traffic of all connections and forwards the callbacks to the wrapped handler
+	// the wrapped handler sees connections that record what it sends if outbound traffic is captured
+	class RecordingConnectionHandler : public IConnectionHandler
+	{
+		IConnectionHandler* _handler;
+		CaptureWriter* _writer;
+		bool _captureOutbound;
+
+		std::mutex _mutex;
+		std::unordered_map<IConnection*, std::shared_ptr<detail::RecordingConnection>> _connections;
+		UInt32 _nextConnection = 0;
+
+	public:
+		RecordingConnectionHandler(IConnectionHandler* handler, CaptureWriter* writer, bool captureOutbound);
+
+		void onClientConnected(std::shared_ptr<IConnection> connection) final;
+		void onDataReceived(std::shared_ptr<IConnection> connection, Span<UInt8 const> data) final;
+		void onClientDisconnected(std::shared_ptr<IConnection> connection) final;
+	};
+}
@@ -1,14 +1,37 @@
 #pragma once
 
+#include <functional>
 #include <string>
 
-#include <common/buffer.hpp>
+#include <common/sharedbuffer.hpp>
+#include <common/span.hpp>
 #include <common/types.hpp>
 
 namespace vitamine
 {
 	using ConnectionId = UInt32;
 
+	// controls what may happen to a packet if the receiver does not keep up
+	struct SendPolicy
+	{
+		// the packet is discarded if the write queue is above its soft limit
+		bool droppable = false;
+
+		// if non-zero, the packet replaces a packet with the same key that is queued but not yet being written
+		// only use for packets that carry absolute state, e.g. entity teleports
+		UInt64 supersedeKey = 0;
+	};
+
+	struct WriteQueueDepth
+	{
+		// includes data that is currently being written
+		UInt bytes;
+		UInt packets;
+
+		// true if the soft limit is exceeded, senders should reduce traffic to this connection
+		bool congested;
+	};
+
 	struct IConnection
 	{
 		[[nodiscard]]
@@ -20,9 +43,27 @@ namespace vitamine
 		virtual void userPointer(void* ptr) = 0;
 		virtual void* userPointer() = 0;
 
-		virtual void send(Buffer buffer) = 0;
+		// may be called from any thread
+		[[nodiscard]]
+		virtual WriteQueueDepth writeQueueDepth() const = 0;
+
+		virtual void send(SharedBuffer buffer, SendPolicy policy) = 0;
 		virtual void disconnect() = 0;
 
+		// encrypts everything sent and decrypts everything received from now on with aes-128-cfb8
+		// must be called from the handler's data callback, after all earlier packets have been handed to the socket
+		// data that arrived in the same read as the packet that triggered the call stays unencrypted
+		virtual void enableEncryption(Span<UInt8 const> sharedSecret) = 0;
+
+		// runs f where the handler's data callbacks run, never concurrently with them
+		// may be called from any thread, f also runs if the connection has been closed in the meantime
+		virtual void post(std::function<void()> f) = 0;
+
+		void send(SharedBuffer buffer)
+		{
+			send(std::move(buffer), SendPolicy());
+		}
+
 		virtual ~IConnection() = default;
 
 	protected:
@@ -0,0 +1,78 @@
+#include <common/net/reactorpool.hpp>
+
+#include <algorithm>
+#include <cstdio>
+
+#include <pthread.h>
+#include <sched.h>
+
+namespace vitamine
+{
+	static
+	void pinCurrentThread(UInt index)
+	{
+		auto cpuCount = std::max(std::thread::hardware_concurrency(), 1u);
+
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(index % cpuCount, &set);
+
+		if(pthread_setaffinity_np(pthread_self(), sizeof set, &set) != 0)
+			std::printf("failed to pin reactor thread %zu\n", (std::size_t)index);
+	}
+
+	ReactorPool::ReactorPool(ReactorPoolSettings const& settings)
+	: _pinThreads(settings.pinThreads)
+	{
+		auto count = settings.threadCount != 0 ? settings.threadCount : std::max(std::thread::hardware_concurrency(), 1u);
+
+		for(UInt i = 0; i != count; ++i)
+		{
+			// concurrency hint 1: each service is only ever run by a single thread
+			_services.push_back(std::make_unique<boost::asio::io_service>(1));
+			_work.emplace_back(std::in_place, *_services.back());
+		}
+	}
+
+	ReactorPool::~ReactorPool()
+	{
+		stop();
+
+		for(auto& thread : _threads)
+			if(thread.joinable())
+				thread.join();
+	}
+
+	void ReactorPool::run()
+	{
+		for(UInt i = 1; i < _services.size(); ++i)
+		{
+			_threads.emplace_back([this, i]
+			{
+				if(_pinThreads)
+					pinCurrentThread(i);
+
+				_services[i]->run();
+			});
+		}
+
+		if(_pinThreads)
+			pinCurrentThread(0);
+
+		_services[0]->run();
+
+		for(auto& thread : _threads)
+			thread.join();
+
+		_threads.clear();
+	}
+
+	void ReactorPool::stop()
+	{
+		for(auto& work : _work)
+			work.reset();
+
+		for(auto& service : _services)
+			service->stop();
+	}
+}
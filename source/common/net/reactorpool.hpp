@@ -0,0 +1,54 @@
+#pragma once
+
+#include <memory>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include <boost/asio/io_service.hpp>
+
+#include <common/types.hpp>
+
+namespace vitamine
+{
+	struct ReactorPoolSettings
+	{
+		// 0 means one reactor per hardware thread
+		UInt threadCount = 0;
+		bool pinThreads = false;
+	};
+
+	// owns one io_service per reactor thread
+	// every io_service is run by exactly one thread, so handlers posted to the same service never run concurrently
+	class ReactorPool
+	{
+		std::vector<std::unique_ptr<boost::asio::io_service>> _services;
+		std::vector<std::optional<boost::asio::io_service::work>> _work;
+		std::vector<std::thread> _threads;
+		bool _pinThreads;
+
+	public:
+		explicit ReactorPool(ReactorPoolSettings const& settings);
+		~ReactorPool();
+
+		ReactorPool(ReactorPool const&) = delete;
+		ReactorPool& operator=(ReactorPool const&) = delete;
+
+		[[nodiscard]]
+		UInt size() const
+		{
+			return _services.size();
+		}
+
+		[[nodiscard]]
+		boost::asio::io_service* service(UInt index)
+		{
+			return &*_services[index];
+		}
+
+		// runs reactor 0 on the calling thread and all other reactors on their own threads
+		// returns after stop() has been called and all reactors have finished
+		void run();
+		void stop();
+	};
+}
@@ -1,6 +1,8 @@
 #include <common/net/tcpserver.hpp>
 
 #include <atomic>
+#include <cstdio>
+#include <memory>
 #include <utility>
 #include <vector>
 
@@ -9,16 +11,21 @@
 #include <boost/system/error_code.hpp>
 #include <boost/system/system_error.hpp>
 
-#include <common/buffer.hpp>
+#include <common/aescfb8.hpp>
+#include <common/sharedbuffer.hpp>
 #include <common/net/connection.hpp>
 #include <common/net/connectionhandler.hpp>
+#include <common/net/tcpserverimpl.hpp>
+#include <common/net/uring.hpp>
+#include <common/net/writequeue.hpp>
 
 namespace vitamine::detail
 {
 	class TcpServerConnection : public IConnection, public std::enable_shared_from_this<TcpServerConnection>
 	{
-		friend class TcpServerImpl;
+		friend class AsioTcpServerImpl;
 
+		boost::asio::io_service* _service;
 		boost::asio::ip::tcp::socket _socket;
 		boost::asio::io_service::strand _strand;
 		ConnectionId _id;
@@ -26,16 +33,21 @@ namespace vitamine::detail
 		std::atomic<bool> _disconnectMarker;
 
 		UInt8 _readBuf[4096];
-		std::vector<Buffer> _appendWriteQueue;
-		std::vector<Buffer> _activeWriteQueue;
+		SendInbox _sendInbox;
+		std::vector<OutgoingPacket> _flushedPackets;
+		WriteQueue _writeQueue;
 		std::vector<boost::asio::const_buffer> _activeWriteQueueBuffers;
 
+		// only accessed on the strand
+		std::unique_ptr<AesCfb8> _cipher;
+		std::vector<UInt8> _encryptedWriteBuffer;
+
 		void* _userPtr;
 
 		static
 		void startWrite(std::shared_ptr<TcpServerConnection>&& connection)
 		{
-			if(connection->_appendWriteQueue.empty())
+			if(!connection->_writeQueue.activate())
 			{
 				if(connection->_disconnectMarker)
 					connection->_socket.close();
@@ -43,16 +55,45 @@ namespace vitamine::detail
 				return;
 			}
 
-			// preserve allocated capacity by using swap instead of move assignment
-			connection->_activeWriteQueue.swap(connection->_appendWriteQueue);
+			if(connection->_cipher)
+			{
+				// shared packets cannot be encrypted in place, so the whole write is encrypted into a private buffer
+				auto& encrypted = connection->_encryptedWriteBuffer;
+				encrypted.resize(connection->_writeQueue.activeBytes());
+				auto out = encrypted.data();
+
+				for(auto& buffer : connection->_writeQueue.active())
+				{
+					buffer.forEachSegment([&](void const* data, UInt size)
+					{
+						connection->_cipher->encrypt((UInt8 const*)data, out, size);
+						out += size;
+					});
+				}
+
+				connection->_activeWriteQueueBuffers.emplace_back(encrypted.data(), encrypted.size());
+			}
+			else
+			{
+				// segmented packets contribute one gather entry per segment
+				for(auto& buffer : connection->_writeQueue.active())
+				{
+					buffer.forEachSegment([&](void const* data, UInt size)
+					{
+						connection->_activeWriteQueueBuffers.emplace_back(data, size);
+					});
+				}
+			}
 
-			for(auto& buffer : connection->_activeWriteQueue)
-				connection->_activeWriteQueueBuffers.emplace_back(buffer.data(), buffer.size());
+			// the connection pointer is moved into the handler, so everything else needs to be looked up beforehand
+			auto& socket = connection->_socket;
+			auto& buffers = connection->_activeWriteQueueBuffers;
+			auto& strand = connection->_strand;
 
-			boost::asio::async_write(connection->_socket, connection->_activeWriteQueueBuffers, connection->_strand.wrap(
+			boost::asio::async_write(socket, buffers, strand.wrap(
 				[connection = std::move(connection)](boost::system::error_code ec, auto) mutable
 				{
-					connection->_activeWriteQueue.clear();
+					connection->_writeQueue.complete();
 					connection->_activeWriteQueueBuffers.clear();
 
 					if(!ec)
@@ -61,21 +102,44 @@ namespace vitamine::detail
 		}
 
 		static
-		void sendImpl(std::shared_ptr<TcpServerConnection>&& connection, Buffer buffer)
+		void flushImpl(std::shared_ptr<TcpServerConnection>&& connection)
 		{
-			connection->_appendWriteQueue.emplace_back(std::move(buffer));
+			auto& packets = connection->_flushedPackets;
+			if(!connection->_sendInbox.take(packets) && !connection->_disconnectMarker)
+				connection->evictImpl();
 
-			if(!connection->_activeWriteQueue.empty())
-				return;
+			for(auto& packet : packets)
+			{
+				if(connection->_disconnectMarker)
+					break;
+
+				if(connection->_writeQueue.push(std::move(packet.buffer), packet.policy) == WriteQueuePushResult::LIMIT_EXCEEDED)
+					connection->evictImpl();
+			}
 
-			startWrite(std::move(connection));
+			packets.clear();
+
+			if(!connection->_disconnectMarker && !connection->_writeQueue.writing())
+				startWrite(std::move(connection));
+		}
+
+		// the client does not keep up with the data sent to it, drop everything and close without waiting for pending writes
+		void evictImpl()
+		{
+			std::printf("write queue limit exceeded, disconnecting %s\n", endpoint().c_str());
+
+			_disconnectMarker = true;
+			_writeQueue.discardPending();
+
+			boost::system::error_code ec;
+			_socket.close(ec);
 		}
 
 		void disconnectImpl()
 		{
 			_disconnectMarker = true;
 
-			if(_activeWriteQueue.empty())
+			if(!_writeQueue.writing())
 			{
 				boost::system::error_code ec;
 				_socket.close(ec);
@@ -85,8 +149,8 @@ namespace vitamine::detail
 		}
 
 	public:
-		TcpServerConnection(boost::asio::io_service* service, ConnectionId id)
-			: _socket(*service), _strand(*service), _id(id), _disconnectMarker(false)
+		TcpServerConnection(boost::asio::io_service* service, ConnectionId id, WriteQueueLimits const& limits)
+			: _service(service), _socket(*service), _strand(*service), _id(id), _disconnectMarker(false), _sendInbox(limits), _writeQueue(limits)
 		{}
 
 		virtual ConnectionId id() const final
@@ -109,40 +173,83 @@ namespace vitamine::detail
 			return _userPtr;
 		}
 
-		virtual void send(Buffer buffer) final
+		virtual WriteQueueDepth writeQueueDepth() const final
+		{
+			return _writeQueue.depth();
+		}
+
+		virtual void send(SharedBuffer buffer, SendPolicy policy) final
 		{
 			// discard packets after the connection has been marked for disconnect
 			if(_disconnectMarker)
 				return;
 
-			_socket.get_io_service().post(_strand.wrap(
-				[self = shared_from_this(), buffer = std::move(buffer)]() mutable
+			if(!_sendInbox.push(std::move(buffer), policy))
+				return;
+
+			_service->post(_strand.wrap(
+				[self = shared_from_this()]() mutable
 				{
-					self->sendImpl(std::move(self), std::move(buffer));
+					flushImpl(std::move(self));
 				}));
 		}
 
 		virtual void disconnect() final
 		{
-			_socket.get_io_service().post(_strand.wrap(
+			_service->post(_strand.wrap(
 				[self = shared_from_this()]
 				{
 					self->disconnectImpl();
 				}));
 		}
+
+		virtual void enableEncryption(Span<UInt8 const> sharedSecret) final
+		{
+			// the data callback runs on the strand, so the cipher can be installed directly
+			_cipher = std::make_unique<AesCfb8>(sharedSecret);
+		}
+
+		virtual void post(std::function<void()> f) final
+		{
+			_service->post(_strand.wrap(std::move(f)));
+		}
 	};
 
-	class TcpServerImpl
+	ConnectionId nextConnectionId()
+	{
+		// shared by all servers so that ids stay unique when multiple acceptors listen on the same endpoint
+		static std::atomic<ConnectionId> next{1};
+		return next++;
+	}
+
+	void listen(boost::asio::ip::tcp::acceptor& acceptor, boost::asio::ip::tcp::endpoint endpoint, TcpServerSettings const& settings)
 	{
+		using ReusePort = boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>;
+
+		acceptor.open(endpoint.protocol());
+		acceptor.set_option(boost::asio::ip::tcp::acceptor::reuse_address(true));
+
+		if(settings.reusePort)
+			acceptor.set_option(ReusePort(true));
+
+		acceptor.bind(endpoint);
+		acceptor.listen();
+	}
+
+	class AsioTcpServerImpl : public ITcpServerImpl
+	{
+		boost::asio::io_service* _service;
 		boost::asio::ip::tcp::acceptor _acceptor;
-		ConnectionId _nextConnectionId = 1;
 		IConnectionHandler* _handler;
+		WriteQueueLimits _writeQueueLimits;
 
 		void startAccept()
 		{
-			auto connection = std::make_shared<TcpServerConnection>(&_acceptor.get_io_service(), _nextConnectionId++);
+			auto connection = std::make_shared<TcpServerConnection>(_service, nextConnectionId(), _writeQueueLimits);
+			auto& socket = connection->_socket;
+			auto& endpoint = connection->_endpoint;
 
-			_acceptor.async_accept(connection->_socket, connection->_endpoint,
+			_acceptor.async_accept(socket, endpoint,
 			                       [this, connection = std::move(connection)](auto ec) mutable
 			                       {
 				                       if(ec)
@@ -167,7 +274,11 @@ namespace vitamine::detail
 
 		void startRead(std::shared_ptr<TcpServerConnection>&& connection)
 		{
-			connection->_socket.async_read_some(boost::asio::buffer(connection->_readBuf), connection->_strand.wrap(
+			auto& socket = connection->_socket;
+			auto buffer = boost::asio::buffer(connection->_readBuf);
+			auto& strand = connection->_strand;
+
+			socket.async_read_some(buffer, strand.wrap(
 				[this, connection = std::move(connection)](boost::system::error_code ec, auto size) mutable
 				{
 					if(ec || connection->_disconnectMarker)
@@ -176,28 +287,52 @@ namespace vitamine::detail
 						return;
 					}
 
+					if(connection->_cipher)
+						connection->_cipher->decrypt(connection->_readBuf, connection->_readBuf, size);
+
 					_handler->onDataReceived(connection, {connection->_readBuf, size});
 					startRead(std::move(connection));
 				}));
 		}
 
 	public:
-		TcpServerImpl(boost::asio::io_service* service, boost::asio::ip::tcp::endpoint endpoint, IConnectionHandler* handler)
-		: _acceptor(*service, endpoint), _handler(handler)
-		{}
+		AsioTcpServerImpl(boost::asio::io_service* service, boost::asio::ip::tcp::endpoint endpoint, IConnectionHandler* handler, TcpServerSettings const& settings)
+		: _service(service), _acceptor(*service), _handler(handler), _writeQueueLimits(settings.writeQueueLimits)
+		{
+			listen(_acceptor, endpoint, settings);
+		}
 
-		void asyncServe()
+		virtual void asyncServe() final
 		{
 			startAccept();
 		}
 	};
+
+	std::unique_ptr<ITcpServerImpl> createAsioTcpServer(boost::asio::io_service* service, boost::asio::ip::tcp::endpoint endpoint, IConnectionHandler* handler, TcpServerSettings const& settings)
+	{
+		return std::make_unique<AsioTcpServerImpl>(service, endpoint, handler, settings);
+	}
 }
 
 namespace vitamine
 {
-	TcpServer::TcpServer(boost::asio::io_service* service, boost::asio::ip::tcp::endpoint endpoint, IConnectionHandler* handler)
-	: _impl(std::make_unique<detail::TcpServerImpl>(service, endpoint, handler))
-	{}
+	TcpServer::TcpServer(boost::asio::io_service* service, boost::asio::ip::tcp::endpoint endpoint, IConnectionHandler* handler, TcpServerSettings const& settings)
+	{
+		if(settings.backend == TcpServerBackend::IO_URING)
+		{
+			static bool const uringSupported = IoUring::supported();
+
+			if(uringSupported)
+			{
+				_impl = detail::createUringTcpServer(service, endpoint, handler, settings);
+				return;
+			}
+
+			std::printf("io_uring is not supported, falling back to asio\n");
+		}
+
+		_impl = detail::createAsioTcpServer(service, endpoint, handler, settings);
+	}
 
 	TcpServer::~TcpServer() = default;
 
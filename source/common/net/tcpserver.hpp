@@ -5,21 +5,43 @@
 #include <boost/asio/io_service.hpp>
 #include <boost/asio/ip/tcp.hpp>
 
+#include <common/net/writequeue.hpp>
+
 namespace vitamine::detail
 {
-	class TcpServerImpl;
+	struct ITcpServerImpl;
 }
 
 namespace vitamine
 {
 	struct IConnectionHandler;
 
+	enum struct TcpServerBackend
+	{
+		ASIO,
+
+		// drives accept, recv and send through io_uring, falls back to asio if the kernel does not support it
+		// the io_service passed to the server must be run by a single thread
+		IO_URING,
+	};
+
+	struct TcpServerSettings
+	{
+		TcpServerBackend backend = TcpServerBackend::ASIO;
+
+		// allows multiple servers, usually one per reactor thread, to listen on the same endpoint
+		// the kernel then distributes incoming connections between them
+		bool reusePort = false;
+
+		WriteQueueLimits writeQueueLimits;
+	};
+
 	class TcpServer
 	{
-		std::unique_ptr<detail::TcpServerImpl> _impl;
+		std::unique_ptr<detail::ITcpServerImpl> _impl;
 
 	public:
-		TcpServer(boost::asio::io_service* service, boost::asio::ip::tcp::endpoint endpoint, IConnectionHandler* handler);
+		TcpServer(boost::asio::io_service* service, boost::asio::ip::tcp::endpoint endpoint, IConnectionHandler* handler, TcpServerSettings const& settings = {});
 		~TcpServer();
 
 		void asyncServe();
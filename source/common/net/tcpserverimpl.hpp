@@ -0,0 +1,35 @@
+#pragma once
+
+#include <memory>
+
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/ip/tcp.hpp>
+
+#include <common/net/connection.hpp>
+#include <common/net/tcpserver.hpp>
+
+namespace vitamine
+{
+	struct IConnectionHandler;
+}
+
+namespace vitamine::detail
+{
+	struct ITcpServerImpl
+	{
+		virtual void asyncServe() = 0;
+		virtual ~ITcpServerImpl() = default;
+
+	protected:
+		ITcpServerImpl() = default;
+	};
+
+	// opens, binds and starts listening on the acceptor according to the server settings
+	void listen(boost::asio::ip::tcp::acceptor& acceptor, boost::asio::ip::tcp::endpoint endpoint, TcpServerSettings const& settings);
+
+	// allocates connection ids that are unique across all servers in the process
+	ConnectionId nextConnectionId();
+
+	std::unique_ptr<ITcpServerImpl> createAsioTcpServer(boost::asio::io_service* service, boost::asio::ip::tcp::endpoint endpoint, IConnectionHandler* handler, TcpServerSettings const& settings);
+	std::unique_ptr<ITcpServerImpl> createUringTcpServer(boost::asio::io_service* service, boost::asio::ip::tcp::endpoint endpoint, IConnectionHandler* handler, TcpServerSettings const& settings);
+}
@@ -0,0 +1,307 @@
+#include <common/net/uring.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <system_error>
+
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/utsname.h>
+#include <unistd.h>
+
+namespace vitamine
+{
+	static
+	int sysIoUringSetup(UInt32 entries, io_uring_params* params)
+	{
+		return (int)syscall(__NR_io_uring_setup, entries, params);
+	}
+
+	static
+	int sysIoUringEnter(int fd, UInt32 toSubmit, UInt32 minComplete, UInt32 flags)
+	{
+		return (int)syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, nullptr, 0);
+	}
+
+	static
+	int sysIoUringRegister(int fd, UInt32 opcode, void const* arg, UInt32 argCount)
+	{
+		return (int)syscall(__NR_io_uring_register, fd, opcode, arg, argCount);
+	}
+
+	static
+	void* mapRing(int fd, UInt size, UInt64 offset)
+	{
+		auto ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+
+		if(ptr == MAP_FAILED)
+			throw std::system_error(errno, std::system_category(), "io_uring mmap");
+
+		return ptr;
+	}
+
+	template <typename T>
+	static
+	T* ringPtr(void* base, UInt32 offset)
+	{
+		return (T*)((UInt8*)base + offset);
+	}
+
+	IoUring::IoUring(UInt32 entries)
+	{
+		io_uring_params params = {};
+
+		// completions for a busy server outnumber submissions because of multishot requests
+		params.flags = IORING_SETUP_CQSIZE;
+		params.cq_entries = 4 * entries;
+
+		_fd = sysIoUringSetup(entries, &params);
+
+		if(_fd < 0)
+			throw std::system_error(errno, std::system_category(), "io_uring_setup");
+
+		_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(UInt32);
+		_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+		if(params.features & IORING_FEAT_SINGLE_MMAP)
+			_sqRingSize = _cqRingSize = std::max(_sqRingSize, _cqRingSize);
+
+		try
+		{
+			_sqRing = mapRing(_fd, _sqRingSize, IORING_OFF_SQ_RING);
+			_cqRing = params.features & IORING_FEAT_SINGLE_MMAP ? _sqRing : mapRing(_fd, _cqRingSize, IORING_OFF_CQ_RING);
+
+			_sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+			_sqes = (io_uring_sqe*)mapRing(_fd, _sqesSize, IORING_OFF_SQES);
+		}
+		catch(...)
+		{
+			release();
+			throw;
+		}
+
+		_sqHead = ringPtr<UInt32>(_sqRing, params.sq_off.head);
+		_sqTail = ringPtr<UInt32>(_sqRing, params.sq_off.tail);
+		_sqArray = ringPtr<UInt32>(_sqRing, params.sq_off.array);
+		_sqFlags = ringPtr<UInt32>(_sqRing, params.sq_off.flags);
+		_sqMask = *ringPtr<UInt32>(_sqRing, params.sq_off.ring_mask);
+		_sqEntries = *ringPtr<UInt32>(_sqRing, params.sq_off.ring_entries);
+		_sqLocalTail = *_sqTail;
+
+		_cqHead = ringPtr<UInt32>(_cqRing, params.cq_off.head);
+		_cqTail = ringPtr<UInt32>(_cqRing, params.cq_off.tail);
+		_cqMask = *ringPtr<UInt32>(_cqRing, params.cq_off.ring_mask);
+		_cqes = ringPtr<io_uring_cqe>(_cqRing, params.cq_off.cqes);
+
+		// submission entries are always used in order, so the indirection array is the identity mapping
+		for(UInt32 i = 0; i != _sqEntries; ++i)
+			_sqArray[i] = i;
+	}
+
+	IoUring::~IoUring()
+	{
+		release();
+	}
+
+	void IoUring::release()
+	{
+		if(_sqes)
+			munmap(_sqes, _sqesSize);
+
+		if(_cqRing && _cqRing != _sqRing)
+			munmap(_cqRing, _cqRingSize);
+
+		if(_sqRing)
+			munmap(_sqRing, _sqRingSize);
+
+		if(_fd >= 0)
+			close(_fd);
+	}
+
+	UInt IoUring::deferCompletions()
+	{
+		auto head = *_cqHead;
+		auto tail = __atomic_load_n(_cqTail, __ATOMIC_ACQUIRE);
+
+		for(; head != tail; ++head)
+			_deferredCompletions.push_back(_cqes[head & _cqMask]);
+
+		auto count = (UInt)(head - *_cqHead);
+		__atomic_store_n(_cqHead, head, __ATOMIC_RELEASE);
+		return count;
+	}
+
+	io_uring_sqe* IoUring::getSqe()
+	{
+		// an entry may only be reused once the kernel has consumed it
+		while(_sqLocalTail - __atomic_load_n(_sqHead, __ATOMIC_ACQUIRE) == _sqEntries)
+		{
+			submit();
+
+			if(_sqLocalTail - __atomic_load_n(_sqHead, __ATOMIC_ACQUIRE) != _sqEntries)
+				break;
+
+			// the kernel flushes its overflowed completions into the freed slots on the next submit
+			if(deferCompletions() == 0)
+				throw std::system_error(EBUSY, std::system_category(), "io_uring submission queue full");
+		}
+
+		auto sqe = &_sqes[_sqLocalTail++ & _sqMask];
+		std::memset(sqe, 0, sizeof *sqe);
+		return sqe;
+	}
+
+	void IoUring::submit()
+	{
+		__atomic_store_n(_sqTail, _sqLocalTail, __ATOMIC_RELEASE);
+
+		// includes entries left over from an earlier submit that failed with EBUSY
+		auto pending = _sqLocalTail - __atomic_load_n(_sqHead, __ATOMIC_ACQUIRE);
+
+		// completions that did not fit into the completion queue are kept by the kernel until it is entered to get events
+		if(__atomic_load_n(_sqFlags, __ATOMIC_RELAXED) & IORING_SQ_CQ_OVERFLOW)
+		{
+			if(sysIoUringEnter(_fd, pending, 0, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR && errno != EBUSY && errno != EAGAIN)
+				throw std::system_error(errno, std::system_category(), "io_uring_enter");
+
+			pending = _sqLocalTail - __atomic_load_n(_sqHead, __ATOMIC_ACQUIRE);
+		}
+
+		while(pending != 0)
+		{
+			auto result = sysIoUringEnter(_fd, pending, 0, 0);
+
+			if(result < 0)
+			{
+				if(errno == EINTR)
+					continue;
+
+				// completion queue overflow, the caller will drain completions and submit again
+				if(errno == EBUSY || errno == EAGAIN)
+					return;
+
+				throw std::system_error(errno, std::system_category(), "io_uring_enter");
+			}
+
+			pending -= result;
+		}
+	}
+
+	void IoUring::registerBufferRing(io_uring_buf_ring* ring, UInt32 entries, UInt16 group)
+	{
+		io_uring_buf_reg reg = {};
+		reg.ring_addr = (UInt64)ring;
+		reg.ring_entries = entries;
+		reg.bgid = group;
+
+		if(sysIoUringRegister(_fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+			throw std::system_error(errno, std::system_category(), "io_uring_register");
+	}
+
+	void IoUring::unregisterBufferRing(UInt16 group)
+	{
+		io_uring_buf_reg reg = {};
+		reg.bgid = group;
+		sysIoUringRegister(_fd, IORING_UNREGISTER_PBUF_RING, &reg, 1);
+	}
+
+	bool IoUring::supported()
+	{
+		// multishot recv with provided buffer rings requires linux 6.0
+		utsname name;
+
+		if(uname(&name) != 0)
+			return false;
+
+		int major = 0, minor = 0;
+
+		if(std::sscanf(name.release, "%d.%d", &major, &minor) != 2 || major < 6)
+			return false;
+
+		try
+		{
+			IoUring ring(8);
+
+			constexpr UInt PROBE_OPS = 256;
+
+			// io_uring_probe ends in a flexible array member
+			alignas(io_uring_probe) UInt8 probeMemory[sizeof(io_uring_probe) + PROBE_OPS * sizeof(io_uring_probe_op)] = {};
+			auto probe = (io_uring_probe*)probeMemory;
+
+			if(sysIoUringRegister(ring.fd(), IORING_REGISTER_PROBE, probe, PROBE_OPS) < 0)
+				return false;
+
+			for(auto op : {IORING_OP_ACCEPT, IORING_OP_RECV, IORING_OP_SENDMSG})
+				if(op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED))
+					return false;
+
+			return true;
+		}
+		catch(std::system_error const&)
+		{
+			// io_uring may be disabled by sysctl or a seccomp filter
+			return false;
+		}
+	}
+
+	bool IoUring::bufferRingsSupported()
+	{
+		constexpr UInt32 ENTRIES = 1;
+		constexpr UInt16 GROUP = 0;
+
+		int sockets[2];
+
+		if(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sockets) != 0)
+			return false;
+
+		auto ringMemory = mmap(nullptr, sizeof(io_uring_buf), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+		if(ringMemory == MAP_FAILED)
+		{
+			close(sockets[0]);
+			close(sockets[1]);
+			return false;
+		}
+
+		bool result = false;
+
+		try
+		{
+			IoUring ring(8);
+			auto bufferRing = (io_uring_buf_ring*)ringMemory;
+			ring.registerBufferRing(bufferRing, ENTRIES, GROUP);
+
+			UInt8 buffer[16];
+			bufferRing->bufs[0].addr = (UInt64)buffer;
+			bufferRing->bufs[0].len = sizeof buffer;
+			bufferRing->bufs[0].bid = 0;
+			__atomic_store_n(&bufferRing->tail, 1, __ATOMIC_RELEASE);
+
+			UInt8 data = 0;
+			write(sockets[1], &data, sizeof data);
+
+			auto sqe = ring.getSqe();
+			sqe->opcode = IORING_OP_RECV;
+			sqe->fd = sockets[0];
+			sqe->flags = IOSQE_BUFFER_SELECT;
+			sqe->buf_group = GROUP;
+			ring.submit();
+
+			// the data is already there, so the recv completes inline during submission
+			while(ring.drainCompletions([&](auto const& cqe){ result = cqe.res == sizeof data; }) == 0)
+				sysIoUringEnter(ring.fd(), 0, 1, IORING_ENTER_GETEVENTS);
+
+			ring.unregisterBufferRing(GROUP);
+		}
+		catch(std::system_error const&)
+		{}
+
+		munmap(ringMemory, sizeof(io_uring_buf));
+		close(sockets[0]);
+		close(sockets[1]);
+		return result;
+	}
+}
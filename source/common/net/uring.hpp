@@ -0,0 +1,115 @@
+#pragma once
+
+#include <deque>
+
+#include <linux/io_uring.h>
+
+#include <common/types.hpp>
+
+namespace vitamine
+{
+	// minimal io_uring wrapper on top of the raw system calls
+	// not thread-safe, a ring is owned by the reactor thread that created it
+	class IoUring
+	{
+		int _fd = -1;
+
+		void* _sqRing = nullptr;
+		UInt _sqRingSize = 0;
+		void* _cqRing = nullptr;
+		UInt _cqRingSize = 0;
+		io_uring_sqe* _sqes = nullptr;
+		UInt _sqesSize = 0;
+
+		UInt32* _sqHead;
+		UInt32* _sqTail;
+		UInt32* _sqArray;
+		UInt32* _sqFlags;
+		UInt32 _sqMask;
+		UInt32 _sqEntries;
+		UInt32 _sqLocalTail;
+
+		UInt32* _cqHead;
+		UInt32* _cqTail;
+		UInt32 _cqMask;
+		io_uring_cqe* _cqes;
+
+		// completions taken out of a full completion queue to let the kernel accept submissions again
+		std::deque<io_uring_cqe> _deferredCompletions;
+
+		void release();
+
+		// moves all available completions to _deferredCompletions, returns how many were moved
+		UInt deferCompletions();
+
+	public:
+		explicit IoUring(UInt32 entries);
+		~IoUring();
+
+		IoUring(IoUring const&) = delete;
+		IoUring& operator=(IoUring const&) = delete;
+
+		[[nodiscard]]
+		int fd() const
+		{
+			return _fd;
+		}
+
+		// returns a zeroed submission queue entry, flushing the queue to the kernel first if it is full
+		// if the kernel refuses entries because its completion queue overflows, completions are set aside for the next drainCompletions
+		[[nodiscard]]
+		io_uring_sqe* getSqe();
+
+		// hands all queued entries to the kernel without waiting for completions
+		// stops early if the completion queue overflows, the caller has to drain completions and submit again
+		void submit();
+
+		// invokes f for every available completion and marks them as consumed, in the order the kernel posted them
+		template <typename F>
+		UInt drainCompletions(F&& f)
+		{
+			UInt count = 0;
+
+			for(;; ++count)
+			{
+				io_uring_cqe cqe;
+
+				// f may defer completions by requesting entries, those are older than anything left in the queue
+				if(!_deferredCompletions.empty())
+				{
+					cqe = _deferredCompletions.front();
+					_deferredCompletions.pop_front();
+				}
+				else
+				{
+					auto head = *_cqHead;
+
+					if(head == __atomic_load_n(_cqTail, __ATOMIC_ACQUIRE))
+						break;
+
+					// copy, so the slot can be released before the callback possibly submits new requests
+					cqe = _cqes[head & _cqMask];
+					__atomic_store_n(_cqHead, head + 1, __ATOMIC_RELEASE);
+				}
+
+				f(cqe);
+			}
+
+			return count;
+		}
+
+		void registerBufferRing(io_uring_buf_ring* ring, UInt32 entries, UInt16 group);
+		void unregisterBufferRing(UInt16 group);
+
+		// checks if the running kernel supports everything the io_uring tcp server needs
+		[[nodiscard]]
+		static
+		bool supported();
+
+		// some kernels accept the registration of provided buffer rings, but never hand out buffers from them
+		// this performs an actual buffer-selecting recv to find out
+		[[nodiscard]]
+		static
+		bool bufferRingsSupported();
+	};
+}
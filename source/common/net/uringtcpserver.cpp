@@ -0,0 +1,582 @@
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <boost/asio.hpp>
+#include <boost/asio/posix/stream_descriptor.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/system/system_error.hpp>
+
+#include <common/aescfb8.hpp>
+#include <common/sharedbuffer.hpp>
+#include <common/net/connection.hpp>
+#include <common/net/connectionhandler.hpp>
+#include <common/net/tcpserverimpl.hpp>
+#include <common/net/uring.hpp>
+#include <common/net/writequeue.hpp>
+
+namespace vitamine::detail
+{
+	constexpr UInt32 URING_QUEUE_ENTRIES = 1024;
+
+	// must be a power of two
+	constexpr UInt32 URING_READ_BUFFER_COUNT = 1024;
+	constexpr UInt32 URING_READ_BUFFER_SIZE = 4096;
+	constexpr UInt16 URING_READ_BUFFER_GROUP = 0;
+
+	// stored in the low bits of the request user data, the rest is the connection pointer
+	enum struct UringRequest : UInt64
+	{
+		ACCEPT          = 0,
+		RECV            = 1,
+		SEND            = 2,
+		PROVIDE_BUFFERS = 3,
+	};
+
+	constexpr UInt64 URING_REQUEST_MASK = 3;
+
+	class UringTcpServerImpl;
+
+	class UringConnection : public IConnection, public std::enable_shared_from_this<UringConnection>
+	{
+		friend class UringTcpServerImpl;
+
+		UringTcpServerImpl* _server;
+		boost::asio::io_service* _service;
+		// -1 once the connection has been released
+		int _fd;
+		ConnectionId _id;
+		std::string _endpoint;
+		std::atomic<bool> _disconnectMarker;
+
+		// the remaining members are only accessed by the reactor thread
+		bool _recvActive = false;
+		bool _sendActive = false;
+		bool _disconnectReported = false;
+
+		SendInbox _sendInbox;
+		WriteQueue _writeQueue;
+		std::vector<iovec> _activeWriteQueueBuffers;
+		UInt _activeWriteQueueOffset = 0;
+		msghdr _message = {};
+
+		std::unique_ptr<AesCfb8> _cipher;
+		std::vector<UInt8> _encryptedWriteBuffer;
+
+		void* _userPtr;
+
+		[[nodiscard]]
+		UInt64 userData(UringRequest request)
+		{
+			static_assert(alignof(UringConnection) > URING_REQUEST_MASK);
+			return (UInt64)this | (UInt64)request;
+		}
+
+	public:
+		UringConnection(UringTcpServerImpl* server, boost::asio::io_service* service, int fd, ConnectionId id, std::string endpoint, WriteQueueLimits const& limits)
+		: _server(server), _service(service), _fd(fd), _id(id), _endpoint(std::move(endpoint)), _disconnectMarker(false), _sendInbox(limits), _writeQueue(limits)
+		{}
+
+		virtual ConnectionId id() const final
+		{
+			return _id;
+		}
+
+		virtual std::string endpoint() const final
+		{
+			return _endpoint;
+		}
+
+		virtual void userPointer(void* ptr) final
+		{
+			_userPtr = ptr;
+		}
+
+		virtual void* userPointer() final
+		{
+			return _userPtr;
+		}
+
+		virtual WriteQueueDepth writeQueueDepth() const final
+		{
+			return _writeQueue.depth();
+		}
+
+		virtual void send(SharedBuffer buffer, SendPolicy policy) final;
+		virtual void disconnect() final;
+
+		virtual void enableEncryption(Span<UInt8 const> sharedSecret) final
+		{
+			// the data callback runs on the reactor thread, so the cipher can be installed directly
+			_cipher = std::make_unique<AesCfb8>(sharedSecret);
+		}
+
+		virtual void post(std::function<void()> f) final
+		{
+			_service->post(std::move(f));
+		}
+	};
+
+	class UringTcpServerImpl : public ITcpServerImpl
+	{
+		boost::asio::io_service* _service;
+		boost::asio::ip::tcp::acceptor _acceptor;
+		IConnectionHandler* _handler;
+		WriteQueueLimits _writeQueueLimits;
+		std::vector<OutgoingPacket> _flushedPackets;
+
+		IoUring _ring;
+		boost::asio::posix::stream_descriptor _ringDescriptor;
+		bool _submitScheduled = false;
+
+		// null if the kernel does not support provided buffer rings, buffers are then returned with provide requests
+		io_uring_buf_ring* _readBufferRing = nullptr;
+		UInt16 _readBufferRingTail = 0;
+		std::unique_ptr<UInt8[]> _readBuffers;
+
+		// keeps connections alive while the kernel may still complete requests for them
+		std::unordered_map<UringConnection*, std::shared_ptr<UringConnection>> _connections;
+
+		void provideReadBuffers(UInt16 firstBufferId, UInt32 count)
+		{
+			auto sqe = _ring.getSqe();
+			sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+			sqe->fd = count;
+			sqe->addr = (UInt64)&_readBuffers[(UInt)firstBufferId * URING_READ_BUFFER_SIZE];
+			sqe->len = URING_READ_BUFFER_SIZE;
+			sqe->buf_group = URING_READ_BUFFER_GROUP;
+			sqe->off = firstBufferId;
+			sqe->flags = IOSQE_CQE_SKIP_SUCCESS;
+			sqe->user_data = (UInt64)UringRequest::PROVIDE_BUFFERS;
+			scheduleSubmit();
+		}
+
+		void recycleReadBuffer(UInt16 bufferId)
+		{
+			if(!_readBufferRing)
+			{
+				provideReadBuffers(bufferId, 1);
+				return;
+			}
+
+			auto& entry = _readBufferRing->bufs[_readBufferRingTail & (URING_READ_BUFFER_COUNT - 1)];
+			entry.addr = (UInt64)&_readBuffers[(UInt)bufferId * URING_READ_BUFFER_SIZE];
+			entry.len = URING_READ_BUFFER_SIZE;
+			entry.bid = bufferId;
+			__atomic_store_n(&_readBufferRing->tail, ++_readBufferRingTail, __ATOMIC_RELEASE);
+		}
+
+		// submissions are collected while the reactor runs other handlers and handed to the kernel in one system call
+		void scheduleSubmit()
+		{
+			if(_submitScheduled)
+				return;
+
+			_submitScheduled = true;
+			_service->post([this]
+			{
+				_submitScheduled = false;
+
+				// requesting entries may have set completions aside, which the ring descriptor does not signal
+				drainAndSubmit();
+			});
+		}
+
+		void startAccept()
+		{
+			auto sqe = _ring.getSqe();
+			sqe->opcode = IORING_OP_ACCEPT;
+			sqe->fd = _acceptor.native_handle();
+			sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+			sqe->accept_flags = SOCK_CLOEXEC;
+			sqe->user_data = (UInt64)UringRequest::ACCEPT;
+			scheduleSubmit();
+		}
+
+		void startRecv(UringConnection* connection)
+		{
+			connection->_recvActive = true;
+
+			// multishot recv picks a buffer from the provided buffer ring for every chunk of data received
+			auto sqe = _ring.getSqe();
+			sqe->opcode = IORING_OP_RECV;
+			sqe->fd = connection->_fd;
+			sqe->flags = IOSQE_BUFFER_SELECT;
+			sqe->buf_group = URING_READ_BUFFER_GROUP;
+			sqe->ioprio = IORING_RECV_MULTISHOT;
+			sqe->user_data = connection->userData(UringRequest::RECV);
+			scheduleSubmit();
+		}
+
+		void submitSend(UringConnection* connection)
+		{
+			auto& buffers = connection->_activeWriteQueueBuffers;
+			auto offset = connection->_activeWriteQueueOffset;
+
+			connection->_message.msg_iov = buffers.data() + offset;
+			connection->_message.msg_iovlen = std::min<UInt>(buffers.size() - offset, IOV_MAX);
+
+			auto sqe = _ring.getSqe();
+			sqe->opcode = IORING_OP_SENDMSG;
+			sqe->fd = connection->_fd;
+			sqe->addr = (UInt64)&connection->_message;
+			sqe->len = 1;
+			sqe->msg_flags = MSG_NOSIGNAL;
+			sqe->user_data = connection->userData(UringRequest::SEND);
+			scheduleSubmit();
+		}
+
+		void startWrite(UringConnection* connection)
+		{
+			if(!connection->_writeQueue.activate())
+			{
+				if(connection->_disconnectMarker)
+					shutdown(connection->_fd, SHUT_RDWR);
+
+				return;
+			}
+
+			if(connection->_cipher)
+			{
+				// shared packets cannot be encrypted in place, so the whole write is encrypted into a private buffer
+				auto& encrypted = connection->_encryptedWriteBuffer;
+				encrypted.resize(connection->_writeQueue.activeBytes());
+				auto out = encrypted.data();
+
+				for(auto& buffer : connection->_writeQueue.active())
+				{
+					buffer.forEachSegment([&](void const* data, UInt size)
+					{
+						connection->_cipher->encrypt((UInt8 const*)data, out, size);
+						out += size;
+					});
+				}
+
+				connection->_activeWriteQueueBuffers.push_back({encrypted.data(), encrypted.size()});
+			}
+			else
+			{
+				// segmented packets contribute one gather entry per segment
+				for(auto& buffer : connection->_writeQueue.active())
+				{
+					buffer.forEachSegment([&](void const* data, UInt size)
+					{
+						connection->_activeWriteQueueBuffers.push_back({const_cast<void*>(data), size});
+					});
+				}
+			}
+
+			connection->_activeWriteQueueOffset = 0;
+			connection->_sendActive = true;
+			submitSend(connection);
+		}
+
+		// all writes of a send request are gathered into a single sendmsg, a short write resumes where it stopped
+		void onSendCompleted(UringConnection* connection, Int32 result)
+		{
+			auto& buffers = connection->_activeWriteQueueBuffers;
+
+			if(result >= 0)
+			{
+				auto remaining = (UInt)result;
+				auto& offset = connection->_activeWriteQueueOffset;
+
+				while(offset != buffers.size() && remaining >= buffers[offset].iov_len)
+					remaining -= buffers[offset++].iov_len;
+
+				if(offset != buffers.size())
+				{
+					buffers[offset].iov_base = (UInt8*)buffers[offset].iov_base + remaining;
+					buffers[offset].iov_len -= remaining;
+					submitSend(connection);
+					return;
+				}
+			}
+
+			connection->_sendActive = false;
+			connection->_writeQueue.complete();
+			connection->_activeWriteQueueBuffers.clear();
+
+			if(result >= 0)
+				startWrite(connection);
+			else
+				shutdown(connection->_fd, SHUT_RDWR);
+
+			releaseIfDone(connection);
+		}
+
+		void onRecvCompleted(UringConnection* connection, Int32 result, UInt32 flags)
+		{
+			if(result > 0)
+			{
+				auto bufferId = (UInt16)(flags >> IORING_CQE_BUFFER_SHIFT);
+				auto data = &_readBuffers[(UInt)bufferId * URING_READ_BUFFER_SIZE];
+
+				if(connection->_cipher)
+					connection->_cipher->decrypt(data, data, (UInt)result);
+
+				if(!connection->_disconnectMarker)
+					_handler->onDataReceived(_connections.at(connection), {data, (UInt)result});
+
+				recycleReadBuffer(bufferId);
+			}
+
+			if(!(flags & IORING_CQE_F_MORE))
+			{
+				connection->_recvActive = false;
+
+				// the kernel ran out of provided buffers, the multishot request needs to be rearmed
+				if((result > 0 || result == -ENOBUFS) && !connection->_disconnectMarker)
+				{
+					startRecv(connection);
+					return;
+				}
+			}
+
+			if((result <= 0 && result != -ENOBUFS) || connection->_disconnectMarker)
+			{
+				if(connection->_recvActive)
+					shutdown(connection->_fd, SHUT_RDWR);
+
+				reportDisconnect(connection);
+				releaseIfDone(connection);
+			}
+		}
+
+		void onAcceptCompleted(Int32 result, UInt32 flags)
+		{
+			if(!(flags & IORING_CQE_F_MORE))
+				startAccept();
+
+			if(result < 0)
+			{
+				if(result == -ECANCELED)
+					return;
+
+				throw boost::system::system_error(-result, boost::system::system_category());
+			}
+
+			int fd = result;
+			int enable = 1;
+
+			if(setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof enable) != 0)
+			{
+				close(fd);
+				return;
+			}
+
+			boost::asio::ip::tcp::endpoint endpoint;
+			auto endpointSize = (socklen_t)endpoint.capacity();
+			getpeername(fd, endpoint.data(), &endpointSize);
+			endpoint.resize(endpointSize);
+
+			auto connection = std::make_shared<UringConnection>(this, _service, fd, nextConnectionId(), boost::lexical_cast<std::string>(endpoint), _writeQueueLimits);
+			_connections.emplace(&*connection, connection);
+
+			_handler->onClientConnected(connection);
+			startRecv(&*connection);
+		}
+
+		void reportDisconnect(UringConnection* connection)
+		{
+			if(connection->_disconnectReported)
+				return;
+
+			connection->_disconnectReported = true;
+			connection->_disconnectMarker = true;
+			_handler->onClientDisconnected(_connections.at(connection));
+		}
+
+		void releaseIfDone(UringConnection* connection)
+		{
+			if(connection->_recvActive || connection->_sendActive || !connection->_disconnectReported)
+				return;
+
+			// handlers posted before the release may still hold the connection, the fd number can be reused by then
+			close(connection->_fd);
+			connection->_fd = -1;
+			_connections.erase(connection);
+		}
+
+		void onCompletion(io_uring_cqe const& cqe)
+		{
+			auto request = (UringRequest)(cqe.user_data & URING_REQUEST_MASK);
+			auto connection = (UringConnection*)(cqe.user_data & ~URING_REQUEST_MASK);
+
+			switch(request)
+			{
+			case UringRequest::ACCEPT: onAcceptCompleted(cqe.res, cqe.flags); break;
+			case UringRequest::RECV:   onRecvCompleted(connection, cqe.res, cqe.flags); break;
+			case UringRequest::SEND:   onSendCompleted(connection, cqe.res); break;
+
+			case UringRequest::PROVIDE_BUFFERS:
+				// successful completions are skipped
+				throw boost::system::system_error(-cqe.res, boost::system::system_category());
+			}
+		}
+
+		void startWait()
+		{
+			// the wait is armed before draining completions, so a completion arriving while draining is never missed
+			_ringDescriptor.async_wait(boost::asio::posix::stream_descriptor::wait_read, [this](auto ec)
+			{
+				if(ec)
+				{
+					if(ec == boost::asio::error::operation_aborted)
+						return;
+
+					throw boost::system::system_error(ec);
+				}
+
+				startWait();
+				drainAndSubmit();
+			});
+		}
+
+		void drainAndSubmit()
+		{
+			while(_ring.drainCompletions([this](auto const& cqe){ onCompletion(cqe); }) != 0)
+			{}
+
+			_ring.submit();
+		}
+
+	public:
+		UringTcpServerImpl(boost::asio::io_service* service, boost::asio::ip::tcp::endpoint endpoint, IConnectionHandler* handler, TcpServerSettings const& settings)
+		: _service(service), _acceptor(*service), _handler(handler), _writeQueueLimits(settings.writeQueueLimits), _ring(URING_QUEUE_ENTRIES), _ringDescriptor(*service)
+		{
+			listen(_acceptor, endpoint, settings);
+			_readBuffers = std::make_unique<UInt8[]>(URING_READ_BUFFER_COUNT * URING_READ_BUFFER_SIZE);
+
+			static bool const bufferRingsSupported = IoUring::bufferRingsSupported();
+
+			if(bufferRingsSupported)
+			{
+				auto ringSize = URING_READ_BUFFER_COUNT * sizeof(io_uring_buf);
+				auto ringMemory = mmap(nullptr, ringSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+				if(ringMemory == MAP_FAILED)
+					throw boost::system::system_error(errno, boost::system::system_category());
+
+				_readBufferRing = (io_uring_buf_ring*)ringMemory;
+				_ring.registerBufferRing(_readBufferRing, URING_READ_BUFFER_COUNT, URING_READ_BUFFER_GROUP);
+
+				for(UInt32 i = 0; i != URING_READ_BUFFER_COUNT; ++i)
+					recycleReadBuffer((UInt16)i);
+			}
+			else
+				provideReadBuffers(0, URING_READ_BUFFER_COUNT);
+
+			_ringDescriptor.assign(_ring.fd());
+		}
+
+		~UringTcpServerImpl()
+		{
+			// the ring owns its file descriptor
+			_ringDescriptor.release();
+
+			for(auto& [_, connection] : _connections)
+				close(connection->_fd);
+
+			if(_readBufferRing)
+			{
+				_ring.unregisterBufferRing(URING_READ_BUFFER_GROUP);
+				munmap(_readBufferRing, URING_READ_BUFFER_COUNT * sizeof(io_uring_buf));
+			}
+		}
+
+		void flushImpl(UringConnection* connection)
+		{
+			// connections of a reactor are flushed one after another, so the packet list can be shared
+			if(!connection->_sendInbox.take(_flushedPackets) && !connection->_disconnectMarker)
+				evictImpl(connection);
+
+			for(auto& packet : _flushedPackets)
+			{
+				if(connection->_disconnectMarker)
+					break;
+
+				if(connection->_writeQueue.push(std::move(packet.buffer), packet.policy) == WriteQueuePushResult::LIMIT_EXCEEDED)
+					evictImpl(connection);
+			}
+
+			_flushedPackets.clear();
+
+			if(!connection->_disconnectMarker && !connection->_sendActive)
+				startWrite(connection);
+		}
+
+		// the client does not keep up with the data sent to it, drop everything and shut down without waiting for pending writes
+		void evictImpl(UringConnection* connection)
+		{
+			if(connection->_disconnectReported)
+				return;
+
+			std::printf("write queue limit exceeded, disconnecting %s\n", connection->_endpoint.c_str());
+
+			connection->_disconnectMarker = true;
+			connection->_writeQueue.discardPending();
+			shutdown(connection->_fd, SHUT_RDWR);
+		}
+
+		void disconnectImpl(UringConnection* connection)
+		{
+			// the recv has ended, the socket is shut down or closed once the last send completes
+			if(connection->_disconnectReported)
+				return;
+
+			connection->_disconnectMarker = true;
+
+			// like closing the socket in the asio backend, this terminates the pending recv
+			// if a send is in flight, the socket is shut down once all queued data is written
+			if(!connection->_sendActive)
+				shutdown(connection->_fd, SHUT_RDWR);
+		}
+
+		virtual void asyncServe() final
+		{
+			startAccept();
+			startWait();
+		}
+	};
+
+	void UringConnection::send(SharedBuffer buffer, SendPolicy policy)
+	{
+		// discard packets after the connection has been marked for disconnect
+		if(_disconnectMarker)
+			return;
+
+		if(!_sendInbox.push(std::move(buffer), policy))
+			return;
+
+		_service->post([self = shared_from_this()]
+		{
+			self->_server->flushImpl(&*self);
+		});
+	}
+
+	void UringConnection::disconnect()
+	{
+		_service->post([self = shared_from_this()]
+		{
+			self->_server->disconnectImpl(&*self);
+		});
+	}
+
+	std::unique_ptr<ITcpServerImpl> createUringTcpServer(boost::asio::io_service* service, boost::asio::ip::tcp::endpoint endpoint, IConnectionHandler* handler, TcpServerSettings const& settings)
+	{
+		return std::make_unique<UringTcpServerImpl>(service, endpoint, handler, settings);
+	}
+}
@@ -0,0 +1,159 @@
+#include <common/net/writequeue.hpp>
+
+#include <cassert>
+#include <utility>
+
+namespace vitamine
+{
+	WriteQueueDepth WriteQueue::depth() const
+	{
+		auto bytes = _bytes.load(std::memory_order_relaxed);
+		auto packets = _packets.load(std::memory_order_relaxed);
+		return {bytes, packets, bytes > _limits.softBytes || packets > _limits.softPackets};
+	}
+
+	WriteQueuePushResult WriteQueue::push(SharedBuffer&& buffer, SendPolicy policy)
+	{
+		auto bytes = _bytes.load(std::memory_order_relaxed);
+		auto packets = _packets.load(std::memory_order_relaxed);
+
+		// the packet this one replaces, if any
+		auto superseded = _supersedable.end();
+
+		if(policy.supersedeKey != 0)
+		{
+			superseded = _supersedable.find(policy.supersedeKey);
+
+			if(superseded != _supersedable.end())
+			{
+				bytes -= _pending[superseded->second].buffer.size();
+				packets -= 1;
+			}
+		}
+		else if(policy.droppable && (bytes > _limits.softBytes || packets > _limits.softPackets))
+			return WriteQueuePushResult::DROPPED;
+
+		bytes += buffer.size();
+		packets += 1;
+
+		// empty slots count as well, compaction keeps them below the number of packets
+		if(bytes > _limits.hardBytes || packets + _superseded > _limits.hardPackets)
+			return WriteQueuePushResult::LIMIT_EXCEEDED;
+
+		if(superseded != _supersedable.end())
+		{
+			_pending[superseded->second].buffer = {};
+			superseded->second = _pending.size();
+			++_superseded;
+		}
+		else if(policy.supersedeKey != 0)
+			_supersedable.emplace(policy.supersedeKey, _pending.size());
+
+		_pending.push_back({std::move(buffer), policy.supersedeKey});
+		_bytes.store(bytes, std::memory_order_relaxed);
+		_packets.store(packets, std::memory_order_relaxed);
+
+		if(_superseded > _pending.size() / 2)
+			compactPending();
+
+		return WriteQueuePushResult::QUEUED;
+	}
+
+	void WriteQueue::compactPending()
+	{
+		UInt count = 0;
+
+		for(UInt i = 0; i != _pending.size(); ++i)
+		{
+			if(!_pending[i].buffer)
+				continue;
+
+			if(_pending[i].supersedeKey != 0)
+				_supersedable[_pending[i].supersedeKey] = count;
+
+			if(i != count)
+				_pending[count] = std::move(_pending[i]);
+
+			++count;
+		}
+
+		_pending.resize(count);
+		_superseded = 0;
+	}
+
+	bool WriteQueue::activate()
+	{
+		assert(_active.empty());
+
+		for(auto& entry : _pending)
+		{
+			if(entry.buffer)
+			{
+				_activeBytes += entry.buffer.size();
+				_active.push_back(std::move(entry.buffer));
+			}
+		}
+
+		_pending.clear();
+		_supersedable.clear();
+		_superseded = 0;
+		return !_active.empty();
+	}
+
+	void WriteQueue::complete()
+	{
+		_bytes.fetch_sub(_activeBytes, std::memory_order_relaxed);
+		_packets.fetch_sub(_active.size(), std::memory_order_relaxed);
+		_active.clear();
+		_activeBytes = 0;
+	}
+
+	void WriteQueue::discardPending()
+	{
+		UInt bytes = 0;
+		UInt packets = 0;
+
+		for(auto& entry : _pending)
+		{
+			if(entry.buffer)
+			{
+				bytes += entry.buffer.size();
+				packets += 1;
+			}
+		}
+
+		_bytes.fetch_sub(bytes, std::memory_order_relaxed);
+		_packets.fetch_sub(packets, std::memory_order_relaxed);
+		_pending.clear();
+		_supersedable.clear();
+		_superseded = 0;
+	}
+
+	bool SendInbox::push(SharedBuffer&& buffer, SendPolicy policy)
+	{
+		std::lock_guard lock(_mutex);
+
+		if(_bytes + buffer.size() > _hardBytes || _packets.size() >= _hardPackets)
+			_overflowed = true;
+		else
+		{
+			_bytes += buffer.size();
+			_packets.push_back({std::move(buffer), policy});
+		}
+
+		return !std::exchange(_flushScheduled, true);
+	}
+
+	bool SendInbox::take(std::vector<OutgoingPacket>& out)
+	{
+		assert(out.empty());
+
+		std::lock_guard lock(_mutex);
+
+		// preserve allocated capacity of both vectors by using swap instead of move assignment
+		out.swap(_packets);
+		_bytes = 0;
+		_flushScheduled = false;
+		return !std::exchange(_overflowed, false);
+	}
+}
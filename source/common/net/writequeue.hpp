@@ -0,0 +1,136 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include <common/sharedbuffer.hpp>
+#include <common/types.hpp>
+#include <common/net/connection.hpp>
+
+namespace vitamine
+{
+	struct WriteQueueLimits
+	{
+		// above the soft limit droppable packets are discarded and the connection reports itself as congested
+		UInt softBytes = 4 << 20;
+		UInt softPackets = 16384;
+
+		// a send that would exceed the hard limit disconnects the client
+		UInt hardBytes = 64 << 20;
+		UInt hardPackets = 262144;
+	};
+
+	struct OutgoingPacket
+	{
+		SharedBuffer buffer;
+		SendPolicy policy;
+	};
+
+	enum struct WriteQueuePushResult
+	{
+		QUEUED,
+		DROPPED,
+		LIMIT_EXCEEDED,
+	};
+
+	// outbound packets of a connection
+	// packets are appended to the pending list while the active list is written, then the lists are swapped
+	// must only be modified by the reactor thread that owns the connection, depth() may be called from any thread
+	class WriteQueue
+	{
+		struct PendingPacket
+		{
+			SharedBuffer buffer;
+			UInt64 supersedeKey;
+		};
+
+		WriteQueueLimits _limits;
+
+		// superseded packets are left empty, so the packets after them keep their order
+		// the list is compacted once more than half of it is empty
+		std::vector<PendingPacket> _pending;
+		std::vector<SharedBuffer> _active;
+		UInt _activeBytes = 0;
+		UInt _superseded = 0;
+
+		// indices into _pending
+		std::unordered_map<UInt64, UInt> _supersedable;
+
+		void compactPending();
+
+		std::atomic<UInt> _bytes = 0;
+		std::atomic<UInt> _packets = 0;
+
+	public:
+		explicit WriteQueue(WriteQueueLimits const& limits)
+		: _limits(limits)
+		{}
+
+		[[nodiscard]]
+		WriteQueueDepth depth() const;
+
+		[[nodiscard]]
+		WriteQueuePushResult push(SharedBuffer&& buffer, SendPolicy policy);
+
+		[[nodiscard]]
+		bool writing() const
+		{
+			return !_active.empty();
+		}
+
+		[[nodiscard]]
+		std::vector<SharedBuffer> const& active() const
+		{
+			return _active;
+		}
+
+		[[nodiscard]]
+		UInt activeBytes() const
+		{
+			return _activeBytes;
+		}
+
+		// moves all pending packets to the active list, returns false if there is nothing to write
+		// must not be called while writing
+		bool activate();
+
+		// releases the active list after it has been written
+		void complete();
+
+		// discards all packets that are not being written yet
+		void discardPending();
+	};
+
+	// collects packets sent from any thread until the owning reactor moves them into the write queue
+	// a burst of sends, e.g. all packets of a tick or of a handler run, costs a single post and a single gather write
+	// holds at most what the write queue's hard limit allows, in case the reactor falls behind
+	class SendInbox
+	{
+		UInt _hardBytes;
+		UInt _hardPackets;
+
+		std::mutex _mutex;
+		std::vector<OutgoingPacket> _packets;
+		UInt _bytes = 0;
+		bool _flushScheduled = false;
+		bool _overflowed = false;
+
+	public:
+		explicit SendInbox(WriteQueueLimits const& limits)
+		: _hardBytes(limits.hardBytes), _hardPackets(limits.hardPackets)
+		{}
+
+		// returns true if the caller has to schedule a flush on the reactor
+		// packets that do not fit are discarded and reported by the next take
+		[[nodiscard]]
+		bool push(SharedBuffer&& buffer, SendPolicy policy);
+
+		// swaps the collected packets into 'out', which must be empty
+		// packets sent after this call schedule a new flush
+		// returns false if packets were discarded since the last call, the connection has to be evicted then
+		[[nodiscard]]
+		bool take(std::vector<OutgoingPacket>& out);
+	};
+}
@@ -0,0 +1,197 @@
+#pragma once
+
+#include <cassert>
+#include <cstring>
+#include <memory>
+#include <utility>
+
+#include <boost/container/small_vector.hpp>
+
+#include <common/buffer.hpp>
+#include <common/bufferpool.hpp>
+#include <common/span.hpp>
+#include <common/types.hpp>
+
+namespace vitamine
+{
+	// leaves room for the shared_ptr control block, so that a block fits the pool's 4 KiB size class
+	constexpr UInt SEGMENTED_BUFFER_BLOCK_SIZE = 4096 - 64;
+
+	// smaller references are copied, a segment of their own would cost more than the copy
+	constexpr UInt SEGMENTED_BUFFER_MIN_REFERENCE_SIZE = 256;
+
+	// chain of segments, each pointing into a block written by the buffer itself or into immutable data owned elsewhere
+	// large payloads are composed by reference instead of being copied and are written with a single gather write
+	// appending a buffer to another shares its blocks, this is safe because bytes are never modified once written
+	class SegmentedBuffer
+	{
+		struct Block
+		{
+			UInt8 data[SEGMENTED_BUFFER_BLOCK_SIZE];
+
+			// leaves the data uninitialized
+			Block() {}
+		};
+
+		struct Segment
+		{
+			// keeps the data alive
+			std::shared_ptr<void const> owner;
+			UInt8 const* data;
+			UInt size;
+		};
+
+		boost::container::small_vector<Segment, 4> _segments;
+		UInt _size = 0;
+
+		// unused space behind the last segment, only if it points into a block owned by this buffer
+		UInt8* _tail = nullptr;
+		UInt _tailSpace = 0;
+
+		// unused space in front of the first segment, only if it points into a block owned by this buffer
+		UInt _headSpace = 0;
+
+		// the block starts with headroom if it is the first one, so that framing headers can be prepended
+		void appendBlock()
+		{
+			auto block = std::allocate_shared<Block>(PoolAllocator<Block>());
+			auto headroom = _segments.empty() ? BUFFER_HEADROOM : 0;
+
+			_tail = block->data + headroom;
+			_tailSpace = SEGMENTED_BUFFER_BLOCK_SIZE - headroom;
+
+			if(_segments.empty())
+				_headSpace = headroom;
+
+			_segments.push_back({std::move(block), _tail, 0});
+		}
+
+	public:
+		SegmentedBuffer() = default;
+
+		// a copy would share the unused space of the last block and overwrite bytes the original still exposes
+		SegmentedBuffer(SegmentedBuffer const&) = delete;
+		SegmentedBuffer& operator=(SegmentedBuffer const&) = delete;
+
+		// the moved from buffer is left empty, so it cannot write into the blocks it gave away either
+		SegmentedBuffer(SegmentedBuffer&& other) noexcept
+		: _segments(std::move(other._segments)), _size(std::exchange(other._size, 0))
+		, _tail(std::exchange(other._tail, nullptr)), _tailSpace(std::exchange(other._tailSpace, 0)), _headSpace(std::exchange(other._headSpace, 0))
+		{
+			other._segments.clear();
+		}
+
+		SegmentedBuffer& operator=(SegmentedBuffer&& other) noexcept
+		{
+			if(this != &other)
+			{
+				_segments = std::move(other._segments);
+				other._segments.clear();
+				_size = std::exchange(other._size, 0);
+				_tail = std::exchange(other._tail, nullptr);
+				_tailSpace = std::exchange(other._tailSpace, 0);
+				_headSpace = std::exchange(other._headSpace, 0);
+			}
+
+			return *this;
+		}
+
+		[[nodiscard]]
+		UInt size() const
+		{
+			return _size;
+		}
+
+		[[nodiscard]]
+		UInt segmentCount() const
+		{
+			return _segments.size();
+		}
+
+		template <typename F>
+		void forEachSegment(F&& f) const
+		{
+			for(auto& segment : _segments)
+				f(segment.data, segment.size);
+		}
+
+		void write(void const* data, UInt size)
+		{
+			auto it = (UInt8 const*)data;
+			_size += size;
+
+			while(size != 0)
+			{
+				if(_tailSpace == 0)
+					appendBlock();
+
+				auto count = std::min(size, _tailSpace);
+				std::memcpy(_tail, it, count);
+				_segments.back().size += count;
+
+				_tail += count;
+				_tailSpace -= count;
+				it += count;
+				size -= count;
+			}
+		}
+
+		// 'owner' must keep 'data' alive and unmodified
+		void writeReference(Span<UInt8 const> data, std::shared_ptr<void const> owner)
+		{
+			if(data.size() < SEGMENTED_BUFFER_MIN_REFERENCE_SIZE)
+			{
+				write(data.data(), data.size());
+				return;
+			}
+
+			if(_segments.empty())
+				_headSpace = 0;
+
+			_segments.push_back({std::move(owner), data.data(), data.size()});
+			_size += data.size();
+			_tail = nullptr;
+			_tailSpace = 0;
+		}
+
+		// shares the segments of 'other' instead of copying the data
+		void write(SegmentedBuffer const& other)
+		{
+			if(_segments.empty())
+				_headSpace = 0;
+
+			for(auto& segment : other._segments)
+				_segments.push_back(segment);
+
+			_size += other._size;
+			_tail = nullptr;
+			_tailSpace = 0;
+		}
+
+		void prepend(void const* data, UInt size)
+		{
+			if(_segments.empty())
+				appendBlock();
+
+			if(size > _headSpace)
+			{
+				// rare, headers usually fit into the headroom of the first block
+				auto block = std::allocate_shared<Block>(PoolAllocator<Block>());
+				_segments.insert(_segments.begin(), {std::move(block), nullptr, 0});
+				_segments.front().data = ((Block const*)_segments.front().owner.get())->data + SEGMENTED_BUFFER_BLOCK_SIZE;
+				_headSpace = SEGMENTED_BUFFER_BLOCK_SIZE;
+			}
+
+			assert(size <= _headSpace);
+
+			auto& front = _segments.front();
+			front.data -= size;
+			front.size += size;
+			_headSpace -= size;
+			_size += size;
+
+			// the block is owned by this buffer, so the data in front of the segment may be written to
+			std::memcpy(const_cast<UInt8*>(front.data), data, size);
+		}
+	};
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <memory>
+#include <utility>
+
+#include <common/buffer.hpp>
+#include <common/segmentedbuffer.hpp>
+#include <common/types.hpp>
+
+namespace vitamine
+{
+	// immutable, reference counted buffer
+	// a packet that is sent to many connections is serialized once and every write queue references the same data
+	class SharedBuffer
+	{
+		// exactly one of these is set, unless the buffer is empty
+		std::shared_ptr<Buffer const> _buffer;
+		std::shared_ptr<SegmentedBuffer const> _segments;
+
+	public:
+		SharedBuffer() = default;
+
+		explicit SharedBuffer(Buffer&& buffer)
+		: _buffer(std::make_shared<Buffer const>(std::move(buffer)))
+		{}
+
+		explicit SharedBuffer(SegmentedBuffer&& buffer)
+		: _segments(std::make_shared<SegmentedBuffer const>(std::move(buffer)))
+		{}
+
+		explicit operator bool() const
+		{
+			return _buffer || _segments;
+		}
+
+		[[nodiscard]]
+		UInt size() const
+		{
+			return _buffer ? _buffer->size() : _segments->size();
+		}
+
+		[[nodiscard]]
+		UInt segmentCount() const
+		{
+			return _buffer ? 1 : _segments->segmentCount();
+		}
+
+		template <typename F>
+		void forEachSegment(F&& f) const
+		{
+			if(_buffer)
+				f(_buffer->data(), _buffer->size());
+			else
+				_segments->forEachSegment(f);
+		}
+	};
+}
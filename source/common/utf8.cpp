@@ -0,0 +1,441 @@
+#include <common/utf8.hpp>
+
+#include <cstring>
+
+#if defined(__SSE2__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace vitamine
+{
+	// bytes that start a sequence the converters have to rewrite, none of them is ever a continuation byte
+	// utf-8: U+0000 and the leads of four byte sequences
+	// modified utf-8: additionally C0, the lead of an encoded U+0000, and ED, the lead of every surrogate
+	template <bool modified>
+	static
+	bool isSpecialByte(UInt8 b)
+	{
+		return b == 0 || b >= 0xf0 || modified && (b == 0xc0 || b == 0xed);
+	}
+
+	template <bool modified>
+	static
+	UInt findSpecialByte(UInt8 const* data, UInt size)
+	{
+		UInt i = 0;
+
+#ifdef __AVX2__
+		for(; i + 32 <= size; i += 32)
+		{
+			auto block = _mm256_loadu_si256((__m256i const*)(data + i));
+			auto special = _mm256_or_si256(_mm256_cmpeq_epi8(block, _mm256_setzero_si256()),
+			                               _mm256_cmpeq_epi8(_mm256_max_epu8(block, _mm256_set1_epi8((char)0xf0)), block));
+
+			if constexpr(modified)
+				special = _mm256_or_si256(special, _mm256_or_si256(_mm256_cmpeq_epi8(block, _mm256_set1_epi8((char)0xc0)),
+				                                                   _mm256_cmpeq_epi8(block, _mm256_set1_epi8((char)0xed))));
+
+			if(auto mask = (UInt32)_mm256_movemask_epi8(special); mask != 0)
+				return i + __builtin_ctz(mask);
+		}
+#endif
+
+#ifdef __SSE2__
+		for(; i + 16 <= size; i += 16)
+		{
+			auto block = _mm_loadu_si128((__m128i const*)(data + i));
+			auto special = _mm_or_si128(_mm_cmpeq_epi8(block, _mm_setzero_si128()),
+			                            _mm_cmpeq_epi8(_mm_max_epu8(block, _mm_set1_epi8((char)0xf0)), block));
+
+			if constexpr(modified)
+				special = _mm_or_si128(special, _mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8((char)0xc0)),
+				                                             _mm_cmpeq_epi8(block, _mm_set1_epi8((char)0xed))));
+
+			if(auto mask = (UInt32)_mm_movemask_epi8(special); mask != 0)
+				return i + __builtin_ctz(mask);
+		}
+#endif
+
+		for(; i != size; ++i)
+			if(isSpecialByte<modified>(data[i]))
+				return i;
+
+		return size;
+	}
+
+	UInt asciiPrefixLength(Span<Char8 const> str)
+	{
+		auto data = (UInt8 const*)str.data();
+		auto size = str.size();
+		UInt i = 0;
+
+#ifdef __AVX2__
+		for(; i + 32 <= size; i += 32)
+			if(auto mask = (UInt32)_mm256_movemask_epi8(_mm256_loadu_si256((__m256i const*)(data + i))); mask != 0)
+				return i + __builtin_ctz(mask);
+#endif
+
+#ifdef __SSE2__
+		for(; i + 16 <= size; i += 16)
+			if(auto mask = (UInt32)_mm_movemask_epi8(_mm_loadu_si128((__m128i const*)(data + i))); mask != 0)
+				return i + __builtin_ctz(mask);
+#endif
+
+		for(; i != size; ++i)
+			if(data[i] >= 0x80)
+				return i;
+
+		return size;
+	}
+
+	bool isValidUtf8Scalar(Span<Char8 const> str)
+	{
+		auto data = (UInt8 const*)str.data();
+		auto size = str.size();
+		UInt i = 0;
+
+		while(i != size)
+		{
+			auto lead = data[i];
+
+			if(lead < 0x80)
+			{
+				++i;
+				continue;
+			}
+
+			// range of the first continuation byte, the others are always 80 to BF
+			UInt length;
+			UInt8 min = 0x80, max = 0xbf;
+
+			if(lead < 0xc2)
+				return false;
+			else if(lead < 0xe0)
+				length = 2;
+			else if(lead < 0xf0)
+			{
+				length = 3;
+				min = lead == 0xe0 ? 0xa0 : 0x80; // overlong
+				max = lead == 0xed ? 0x9f : 0xbf; // surrogates
+			}
+			else if(lead < 0xf5)
+			{
+				length = 4;
+				min = lead == 0xf0 ? 0x90 : 0x80; // overlong
+				max = lead == 0xf4 ? 0x8f : 0xbf; // above U+10FFFF
+			}
+			else
+				return false;
+
+			if(size - i < length)
+				return false;
+
+			if(data[i + 1] < min || data[i + 1] > max)
+				return false;
+
+			for(UInt j = 2; j < length; ++j)
+				if((data[i + j] & 0xc0) != 0x80)
+					return false;
+
+			i += length;
+		}
+
+		return true;
+	}
+
+#ifdef __SSSE3__
+	// classes of errors in a pair of adjacent bytes, after Keiser and Lemire, "Validating UTF-8 In Less Than One Instruction Per Byte"
+	// every byte is classified by the high and low nibble of its predecessor and its own high nibble, a pair is invalid if all three agree on a class
+	constexpr UInt8 UTF8_TOO_SHORT        = 1 << 0; // lead followed by ascii or another lead
+	constexpr UInt8 UTF8_TOO_LONG         = 1 << 1; // ascii followed by a continuation
+	constexpr UInt8 UTF8_OVERLONG_3       = 1 << 2; // E0 80..9F
+	constexpr UInt8 UTF8_TOO_LARGE        = 1 << 3; // F4 90..BF, F5..FF
+	constexpr UInt8 UTF8_SURROGATE        = 1 << 4; // ED A0..BF
+	constexpr UInt8 UTF8_OVERLONG_2       = 1 << 5; // C0..C1
+	constexpr UInt8 UTF8_TOO_LARGE_1000   = 1 << 6; // F5..FF 80..8F
+	constexpr UInt8 UTF8_OVERLONG_4       = 1 << 6; // F0 80..8F
+	constexpr UInt8 UTF8_TWO_CONTINUATION = 1 << 7; // continuation followed by a continuation, only valid within a sequence
+	constexpr UInt8 UTF8_CARRY            = UTF8_TOO_SHORT | UTF8_TOO_LONG | UTF8_TWO_CONTINUATION;
+
+	// nonzero where the block has an error, 'previous' is the block in front of it
+	static
+	__m128i checkUtf8Block(__m128i block, __m128i previous)
+	{
+		auto const byte1High = _mm_setr_epi8(
+			UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG,
+			UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG,
+			(char)UTF8_TWO_CONTINUATION, (char)UTF8_TWO_CONTINUATION, (char)UTF8_TWO_CONTINUATION, (char)UTF8_TWO_CONTINUATION,
+			UTF8_TOO_SHORT | UTF8_OVERLONG_2,
+			UTF8_TOO_SHORT,
+			UTF8_TOO_SHORT | UTF8_OVERLONG_3 | UTF8_SURROGATE,
+			UTF8_TOO_SHORT | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000 | UTF8_OVERLONG_4);
+
+		auto const byte1Low = _mm_setr_epi8(
+			(char)(UTF8_CARRY | UTF8_OVERLONG_3 | UTF8_OVERLONG_2 | UTF8_OVERLONG_4),
+			(char)(UTF8_CARRY | UTF8_OVERLONG_2),
+			(char)UTF8_CARRY,
+			(char)UTF8_CARRY,
+			(char)(UTF8_CARRY | UTF8_TOO_LARGE),
+			(char)(UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000),
+			(char)(UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000),
+			(char)(UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000),
+			(char)(UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000),
+			(char)(UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000),
+			(char)(UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000),
+			(char)(UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000),
+			(char)(UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000),
+			(char)(UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000 | UTF8_SURROGATE),
+			(char)(UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000),
+			(char)(UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000));
+
+		auto const byte2High = _mm_setr_epi8(
+			UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT,
+			UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT,
+			(char)(UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTINUATION | UTF8_OVERLONG_3 | UTF8_TOO_LARGE_1000 | UTF8_OVERLONG_4),
+			(char)(UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTINUATION | UTF8_OVERLONG_3 | UTF8_TOO_LARGE),
+			(char)(UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTINUATION | UTF8_SURROGATE | UTF8_TOO_LARGE),
+			(char)(UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTINUATION | UTF8_SURROGATE | UTF8_TOO_LARGE),
+			UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT);
+
+		auto nibbles = _mm_set1_epi8(0x0f);
+		auto prev1 = _mm_alignr_epi8(block, previous, 15);
+
+		auto special = _mm_and_si128(
+			_mm_and_si128(_mm_shuffle_epi8(byte1High, _mm_and_si128(_mm_srli_epi16(prev1, 4), nibbles)),
+			              _mm_shuffle_epi8(byte1Low, _mm_and_si128(prev1, nibbles))),
+			_mm_shuffle_epi8(byte2High, _mm_and_si128(_mm_srli_epi16(block, 4), nibbles)));
+
+		// the second and third continuation of three and four byte sequences are the two continuation case that is valid
+		auto prev2 = _mm_alignr_epi8(block, previous, 14);
+		auto prev3 = _mm_alignr_epi8(block, previous, 13);
+		auto third = _mm_subs_epu8(prev2, _mm_set1_epi8((char)(0xe0 - 0x80)));
+		auto fourth = _mm_subs_epu8(prev3, _mm_set1_epi8((char)(0xf0 - 0x80)));
+		auto mustContinue = _mm_and_si128(_mm_or_si128(third, fourth), _mm_set1_epi8((char)0x80));
+
+		return _mm_xor_si128(special, mustContinue);
+	}
+#endif
+
+	bool isValidUtf8(Span<Char8 const> str)
+	{
+		auto data = (UInt8 const*)str.data();
+		auto size = str.size();
+
+		// an ascii prefix is valid and ends on a character boundary
+		auto i = asciiPrefixLength(str);
+
+#ifdef __SSSE3__
+		// nonzero where a sequence is cut off by the end of the last block
+		auto const incompleteLimits = _mm_setr_epi8(
+			-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+			(char)(0xf0 - 1), (char)(0xe0 - 1), (char)(0xc0 - 1));
+
+		auto previous = _mm_setzero_si128();
+		auto incomplete = _mm_setzero_si128();
+		auto error = _mm_setzero_si128();
+
+		auto check = [&](__m128i block)
+		{
+			if(_mm_movemask_epi8(block) == 0)
+			{
+				error = _mm_or_si128(error, incomplete);
+				incomplete = _mm_setzero_si128();
+			}
+			else
+			{
+				error = _mm_or_si128(error, checkUtf8Block(block, previous));
+				incomplete = _mm_subs_epu8(block, incompleteLimits);
+			}
+
+			previous = block;
+		};
+
+		for(; i + 16 <= size; i += 16)
+			check(_mm_loadu_si128((__m128i const*)(data + i)));
+
+		// zero padding ends every sequence that continues past the end of the string
+		if(i != size)
+		{
+			UInt8 tail[16] = {};
+			std::memcpy(tail, data + i, size - i);
+			check(_mm_loadu_si128((__m128i const*)tail));
+		}
+
+		error = _mm_or_si128(error, incomplete);
+		return _mm_movemask_epi8(_mm_cmpeq_epi8(error, _mm_setzero_si128())) == 0xffff;
+#else
+		return isValidUtf8Scalar(Span(str.data() + i, size - i));
+#endif
+	}
+
+	static
+	UInt8* encodeUtf16CodeUnit(UInt8* out, UInt32 unit)
+	{
+		out[0] = 0xe0 | unit >> 12;
+		out[1] = 0x80 | (unit >> 6 & 0x3f);
+		out[2] = 0x80 | (unit & 0x3f);
+		return out + 3;
+	}
+
+	bool modifiedUtf8ToUtf8(Span<Char8 const> str, Span<Char8 const>* out, Arena& arena)
+	{
+		auto in = (UInt8 const*)str.data();
+		auto size = str.size();
+
+		// allocated once the first sequence has to be rewritten, every rewritten sequence gets shorter
+		UInt8* result = nullptr;
+		UInt length = 0;
+
+		// input in front of 'pos' that has been validated but not copied to the result yet
+		UInt pending = 0;
+		UInt pos = 0;
+
+		auto rewrite = [&](UInt consumed)
+		{
+			if(!result)
+				result = (UInt8*)arena.allocate(size, 1);
+
+			std::memcpy(result + length, in + pending, pos - pending);
+			length += pos - pending;
+			pos += consumed;
+			pending = pos;
+		};
+
+		while(true)
+		{
+			// the run in front of the special byte is the same in both encodings
+			auto special = pos + findSpecialByte<true>(in + pos, size - pos);
+
+			if(!isValidUtf8(Span((Char8 const*)in + pos, special - pos)))
+				return false;
+
+			pos = special;
+
+			if(pos == size)
+				break;
+
+			auto lead = in[pos];
+
+			if(lead == 0xc0)
+			{
+				if(size - pos < 2 || in[pos + 1] != 0x80)
+					return false;
+
+				rewrite(2);
+				result[length++] = 0;
+			}
+			else if(lead == 0xed)
+			{
+				if(size - pos < 3 || in[pos + 1] < 0x80 || in[pos + 1] > 0xbf || (in[pos + 2] & 0xc0) != 0x80)
+					return false;
+
+				// U+D000 to U+D7FF are not surrogates and need no conversion
+				if(in[pos + 1] < 0xa0)
+				{
+					pos += 3;
+					continue;
+				}
+
+				// a high surrogate that has to be followed by a low one
+				if(in[pos + 1] >= 0xb0 || size - pos < 6 || in[pos + 3] != 0xed)
+					return false;
+
+				if(in[pos + 4] < 0xb0 || in[pos + 4] > 0xbf || (in[pos + 5] & 0xc0) != 0x80)
+					return false;
+
+				auto high = (UInt32)(in[pos + 1] & 0x0f) << 6 | (in[pos + 2] & 0x3f);
+				auto low = (UInt32)(in[pos + 4] & 0x0f) << 6 | (in[pos + 5] & 0x3f);
+				auto codePoint = 0x10000 + (high << 10 | low);
+
+				rewrite(6);
+				result[length++] = 0xf0 | codePoint >> 18;
+				result[length++] = 0x80 | (codePoint >> 12 & 0x3f);
+				result[length++] = 0x80 | (codePoint >> 6 & 0x3f);
+				result[length++] = 0x80 | (codePoint & 0x3f);
+			}
+			else
+			{
+				// U+0000 and four byte sequences do not occur in modified utf-8
+				return false;
+			}
+		}
+
+		if(!result)
+		{
+			*out = str;
+			return true;
+		}
+
+		std::memcpy(result + length, in + pending, size - pending);
+		length += size - pending;
+
+		*out = Span((Char8 const*)result, length);
+		return true;
+	}
+
+	// four byte sequences that are cut off by the end of the string are copied as they are, both functions below must agree on this
+	UInt modifiedUtf8Size(Span<Char8 const> str)
+	{
+		auto in = (UInt8 const*)str.data();
+		auto size = str.size();
+		auto result = size;
+
+		for(auto pos = findSpecialByte<false>(in, size); pos != size; pos += findSpecialByte<false>(in + pos, size - pos))
+		{
+			if(in[pos] == 0)
+			{
+				result += 1;
+				pos += 1;
+			}
+			else if(size - pos >= 4)
+			{
+				result += 2;
+				pos += 4;
+			}
+			else
+				pos += 1;
+		}
+
+		return result;
+	}
+
+	void utf8ToModifiedUtf8(Span<Char8 const> str, Char8* out)
+	{
+		auto in = (UInt8 const*)str.data();
+		auto size = str.size();
+		auto result = (UInt8*)out;
+		UInt pos = 0;
+
+		while(true)
+		{
+			auto special = pos + findSpecialByte<false>(in + pos, size - pos);
+			std::memcpy(result, in + pos, special - pos);
+			result += special - pos;
+			pos = special;
+
+			if(pos == size)
+				break;
+
+			if(in[pos] == 0)
+			{
+				*result++ = 0xc0;
+				*result++ = 0x80;
+				pos += 1;
+			}
+			else if(size - pos >= 4)
+			{
+				auto codePoint = (UInt32)(in[pos] & 0x07) << 18
+				               | (UInt32)(in[pos + 1] & 0x3f) << 12
+				               | (UInt32)(in[pos + 2] & 0x3f) << 6
+				               | (UInt32)(in[pos + 3] & 0x3f);
+
+				codePoint -= 0x10000;
+				result = encodeUtf16CodeUnit(result, 0xd800 + (codePoint >> 10));
+				result = encodeUtf16CodeUnit(result, 0xdc00 + (codePoint & 0x3ff));
+				pos += 4;
+			}
+			else
+				*result++ = in[pos++];
+		}
+	}
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <common/arena.hpp>
+#include <common/span.hpp>
+#include <common/types.hpp>
+
+namespace vitamine
+{
+	// utf-8 as in RFC 3629: no overlong encodings, no surrogates and no code points above U+10FFFF
+	// strings are validated 16 bytes at a time, runs of ascii are skipped 32 bytes at a time with avx2
+	[[nodiscard]]
+	bool isValidUtf8(Span<Char8 const> str);
+
+	// reference implementation for isValidUtf8
+	[[nodiscard]]
+	bool isValidUtf8Scalar(Span<Char8 const> str);
+
+	// number of leading bytes that are ascii
+	[[nodiscard]]
+	UInt asciiPrefixLength(Span<Char8 const> str);
+
+	// modified utf-8 is what java's DataOutput.writeUTF writes and what nbt strings use
+	// it differs from utf-8 in two ways: U+0000 is encoded as C0 80 and supplementary characters as surrogate pairs of three bytes each
+	// strings without either are the same in both encodings, the converters below only copy when one of them occurs
+
+	// converts and validates modified utf-8, lone surrogates are invalid as utf-8 has no representation for them
+	// 'out' points into 'str' if it needs no conversion, otherwise it is allocated from the arena
+	[[nodiscard]]
+	bool modifiedUtf8ToUtf8(Span<Char8 const> str, Span<Char8 const>* out, Arena& arena);
+
+	// size of the modified utf-8 encoding of a valid utf-8 string, the same as its size if no conversion is needed
+	[[nodiscard]]
+	UInt modifiedUtf8Size(Span<Char8 const> str);
+
+	// 'out' must have room for modifiedUtf8Size(str) bytes
+	void utf8ToModifiedUtf8(Span<Char8 const> str, Char8* out);
+}
@@ -0,0 +1,162 @@
+#include <proxyd/authentication.hpp>
+
+#include <stdexcept>
+
+#include <boost/uuid/name_generator.hpp>
+
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#include <openssl/rsa.h>
+#include <openssl/x509.h>
+
+namespace vitamine::proxyd
+{
+	constexpr unsigned SERVER_KEY_BITS = 1024;
+
+	ServerKeyPair::ServerKeyPair()
+	: _key(EVP_RSA_gen(SERVER_KEY_BITS))
+	{
+		if(!_key)
+			throw std::runtime_error("failed to generate server key pair");
+
+		auto size = i2d_PUBKEY(_key, nullptr);
+
+		if(size <= 0)
+		{
+			EVP_PKEY_free(_key);
+			throw std::runtime_error("failed to encode server public key");
+		}
+
+		_publicKey.resize(size);
+		auto out = _publicKey.data();
+		i2d_PUBKEY(_key, &out);
+	}
+
+	ServerKeyPair::~ServerKeyPair()
+	{
+		EVP_PKEY_free(_key);
+	}
+
+	bool ServerKeyPair::decrypt(Span<UInt8 const> in, std::vector<UInt8>* out) const
+	{
+		auto context = EVP_PKEY_CTX_new(_key, nullptr);
+
+		if(!context)
+			return false;
+
+		std::size_t size = 0;
+		auto ok = EVP_PKEY_decrypt_init(context) == 1
+		       && EVP_PKEY_CTX_set_rsa_padding(context, RSA_PKCS1_PADDING) == 1
+		       && EVP_PKEY_decrypt(context, nullptr, &size, in.data(), in.size()) == 1;
+
+		if(ok)
+		{
+			out->resize(size);
+			ok = EVP_PKEY_decrypt(context, out->data(), &size, in.data(), in.size()) == 1;
+			out->resize(size);
+		}
+
+		EVP_PKEY_CTX_free(context);
+		return ok;
+	}
+
+	bool encryptWithPublicKey(Span<UInt8 const> publicKey, Span<UInt8 const> in, std::vector<UInt8>* out)
+	{
+		auto keyData = publicKey.data();
+		auto key = d2i_PUBKEY(nullptr, &keyData, (long)publicKey.size());
+
+		if(!key)
+			return false;
+
+		auto context = EVP_PKEY_CTX_new(key, nullptr);
+		std::size_t size = 0;
+
+		auto ok = context
+		       && EVP_PKEY_encrypt_init(context) == 1
+		       && EVP_PKEY_CTX_set_rsa_padding(context, RSA_PKCS1_PADDING) == 1
+		       && EVP_PKEY_encrypt(context, nullptr, &size, in.data(), in.size()) == 1;
+
+		if(ok)
+		{
+			out->resize(size);
+			ok = EVP_PKEY_encrypt(context, out->data(), &size, in.data(), in.size()) == 1;
+			out->resize(size);
+		}
+
+		EVP_PKEY_CTX_free(context);
+		EVP_PKEY_free(key);
+		return ok;
+	}
+
+	std::string computeServerHash(Span<Char8 const> serverId, Span<UInt8 const> sharedSecret, Span<UInt8 const> publicKey)
+	{
+		UInt8 digest[20];
+		unsigned digestSize = sizeof digest;
+
+		auto context = EVP_MD_CTX_new();
+		EVP_DigestInit_ex(context, EVP_sha1(), nullptr);
+		EVP_DigestUpdate(context, serverId.data(), serverId.size());
+		EVP_DigestUpdate(context, sharedSecret.data(), sharedSecret.size());
+		EVP_DigestUpdate(context, publicKey.data(), publicKey.size());
+		EVP_DigestFinal_ex(context, digest, &digestSize);
+		EVP_MD_CTX_free(context);
+
+		// the digest is interpreted as a two's complement number and printed without leading zeros
+		std::string result;
+		bool negative = digest[0] & 0x80;
+
+		if(negative)
+		{
+			result.push_back('-');
+
+			bool carry = true;
+
+			for(auto i = (int)sizeof digest - 1; i >= 0; --i)
+			{
+				digest[i] = ~digest[i] + carry;
+				carry = carry && digest[i] == 0;
+			}
+		}
+
+		static constexpr char const DIGITS[] = "0123456789abcdef";
+		bool leading = true;
+
+		for(auto byte : digest)
+		{
+			for(auto digit : {byte >> 4, byte & 0xf})
+			{
+				if(leading && digit == 0)
+					continue;
+
+				leading = false;
+				result.push_back(DIGITS[digit]);
+			}
+		}
+
+		if(leading)
+			result.push_back('0');
+
+		return result;
+	}
+
+	void generateRandomBytes(UInt8* out, UInt size)
+	{
+		if(RAND_bytes(out, (int)size) != 1)
+			throw std::runtime_error("failed to generate random bytes");
+	}
+
+	void StubSessionVerifier::verify(std::string const& username, std::string const& serverHash, Callback callback)
+	{
+		(void)serverHash;
+
+		if(!_accept)
+		{
+			callback(std::nullopt);
+			return;
+		}
+
+		// the same generator as offline mode uses
+		boost::uuids::name_generator uuidGenerator{boost::uuids::uuid{0,0,0,0, 0,0,0,0, 0,0,0,0, 0,0,0,0}};
+		callback(SessionProfile{uuidGenerator(username), username});
+	}
+}
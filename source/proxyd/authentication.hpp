@@ -0,0 +1,91 @@
+#pragma once
+
+#include <functional>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <boost/uuid/uuid.hpp>
+
+#include <common/span.hpp>
+#include <common/types.hpp>
+
+struct evp_pkey_st;
+
+namespace vitamine::proxyd
+{
+	constexpr UInt SHARED_SECRET_SIZE = 16;
+	constexpr UInt VERIFY_TOKEN_SIZE = 4;
+
+	// 1024 bit rsa key pair generated at startup, clients encrypt the shared secret with the public key
+	class ServerKeyPair
+	{
+		evp_pkey_st* _key;
+		std::vector<UInt8> _publicKey;
+
+	public:
+		ServerKeyPair();
+		~ServerKeyPair();
+
+		ServerKeyPair(ServerKeyPair const&) = delete;
+		ServerKeyPair& operator=(ServerKeyPair const&) = delete;
+
+		// x.509 SubjectPublicKeyInfo in der format, as sent in the encryption request
+		[[nodiscard]]
+		Span<UInt8 const> publicKey() const
+		{
+			return _publicKey;
+		}
+
+		// pkcs#1 v1.5, returns false if the data does not decrypt
+		[[nodiscard]]
+		bool decrypt(Span<UInt8 const> in, std::vector<UInt8>* out) const;
+	};
+
+	// what a client does with the public key of the encryption request, pkcs#1 v1.5 as well
+	// returns false if the key cannot be parsed
+	[[nodiscard]]
+	bool encryptWithPublicKey(Span<UInt8 const> publicKey, Span<UInt8 const> in, std::vector<UInt8>* out);
+
+	// the hash the client and the session server agree on, a signed hexadecimal sha-1 digest
+	[[nodiscard]]
+	std::string computeServerHash(Span<Char8 const> serverId, Span<UInt8 const> sharedSecret, Span<UInt8 const> publicKey);
+
+	void generateRandomBytes(UInt8* out, UInt size);
+
+	struct SessionProfile
+	{
+		boost::uuids::uuid uuid;
+		std::string username;
+	};
+
+	// checks with a session server that the client logged in with the given server hash
+	// called on a reactor thread during login, which must not wait for the answer
+	struct ISessionVerifier
+	{
+		// receives the player's profile, or nothing if the session could not be verified
+		// may run on any thread, possibly after the client has disconnected
+		using Callback = std::function<void(std::optional<SessionProfile> profile)>;
+
+		virtual void verify(std::string const& username, std::string const& serverHash, Callback callback) = 0;
+
+		virtual ~ISessionVerifier() = default;
+
+	protected:
+		ISessionVerifier() = default;
+	};
+
+	// answers every request at once without asking a session server, for testing online mode locally
+	// accepted players keep their name and get the uuid they would have in offline mode
+	class StubSessionVerifier final : public ISessionVerifier
+	{
+		bool _accept;
+
+	public:
+		explicit StubSessionVerifier(bool accept)
+		: _accept(accept)
+		{}
+
+		virtual void verify(std::string const& username, std::string const& serverHash, Callback callback) final;
+	};
+}
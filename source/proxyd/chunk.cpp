@@ -0,0 +1,94 @@
+#include <proxyd/chunk.hpp>
+
+#include <proxyd/bitpack.hpp>
+#include <proxyd/framing.hpp>
+#include <proxyd/nbt.hpp>
+#include <proxyd/packets.hpp>
+#include <proxyd/serialize.hpp>
+#include <generated/ids.hpp>
+
+namespace vitamine::proxyd
+{
+	std::unique_ptr<Chunk> generateChunk()
+	{
+		auto chunk = std::make_unique<Chunk>();
+		chunk->sections[0] = std::make_unique<ChunkSection>();
+
+		for(UInt8 x = 0; x != 16; ++x)
+		for(UInt8 z = 0; z != 16; ++z)
+			chunk->sections[0]->blocks[0][z][x] = BLOCKID_MINECRAFT_BEDROCK;
+
+		for(UInt8 x = 0; x != 16; ++x)
+		for(UInt8 z = 0; z != 16; ++z)
+		for(UInt8 y = 1; y != 14; ++y)
+			chunk->sections[0]->blocks[y][z][x] = BLOCKID_MINECRAFT_STONE;
+
+		for(UInt8 x = 0; x != 16; ++x)
+		for(UInt8 z = 0; z != 16; ++z)
+			chunk->sections[0]->blocks[14][z][x] = BLOCKID_MINECRAFT_DIRT;
+
+		for(UInt8 x = 0; x != 16; ++x)
+		for(UInt8 z = 0; z != 16; ++z)
+			chunk->sections[0]->blocks[15][z][x] = BLOCKID_MINECRAFT_GRASS_BLOCK;
+
+		for(UInt8 x = 0; x != 16; ++x)
+		for(UInt8 z = 0; z != 16; ++z)
+			chunk->heightmap[z][x] = 16;
+
+		return chunk;
+	}
+
+	SegmentedBuffer serializeChunkPacket(Chunk const& chunk, ChunkCoord coord, Int32 compressionThreshold)
+	{
+		UInt16 bitmask = 0;
+		UInt sectionCount = 0;
+
+		for(auto i = 0; i != 16; ++i)
+			if(chunk.sections[i])
+			{
+				bitmask |= 1 << i;
+				++sectionCount;
+			}
+
+		Int64 heightmap[36];
+		bitpack16to9(&chunk.heightmap[0][0], sizeof chunk.heightmap / sizeof chunk.heightmap[0][0], (UInt8*)heightmap);
+
+		Buffer heightmaps;
+		NbtWriter heightmapsWriter(heightmaps);
+		heightmapsWriter.beginCompound("");
+		heightmapsWriter.array("MOTION_BLOCKING", spanFromArray(heightmap));
+		heightmapsWriter.endCompound();
+
+		// the section data is written once and referenced by the packet
+		SegmentedBuffer buffer;
+
+		for(auto& section : chunk.sections)
+		{
+			if(!section)
+				continue;
+
+			serializeInt(buffer, (UInt16)(16 * 16 * 16)); // block count
+			serializeInt(buffer, (UInt8)14); // bits per block
+			// no palette
+
+			Int64 data[16 * 16 * 16 * 14 / 64];
+			bitpack16to14(&section->blocks[0][0][0], sizeof section->blocks / 2, (UInt8*)data);
+
+			serializeVarInt(buffer, (Int32)(sizeof data / sizeof *data)); // length of data array in longs
+			serializeIntArray(buffer, spanFromArray(data));
+		}
+
+		serializeIntArray(buffer, Span(&chunk.biomes[0][0], sizeof chunk.biomes / sizeof chunk.biomes[0][0]));
+
+		PacketChunkData chunkData;
+		chunkData.x = coord.x;
+		chunkData.z = coord.z;
+		chunkData.fullChunk = true;
+		chunkData.primaryBitmask = bitmask;
+		chunkData.heightmaps = Span((UInt8 const*)heightmaps.data(), heightmaps.size());
+		chunkData.data = std::move(buffer);
+		chunkData.blockEntities = {};
+
+		return serializePacket<SegmentedBuffer>(chunkData, compressionThreshold);
+	}
+}
@@ -3,6 +3,9 @@
 #include <memory>
 #include <mutex>
 
+#include <common/coord.hpp>
+#include <common/segmentedbuffer.hpp>
+#include <common/sharedbuffer.hpp>
 #include <common/types.hpp>
 
 namespace vitamine::proxyd
@@ -18,5 +21,22 @@ namespace vitamine::proxyd
 		std::unique_ptr<ChunkSection> sections[16];
 		Int32 biomes[16][16] = {};
 		UInt16 heightmap[16][16] = {};
+
+		// incremented by every block change, invalidates the cached packet
+		UInt64 version = 0;
+
+		// framed chunk data packet shared by all players that load the chunk
+		// only valid for the version and compression threshold it was built with
+		SharedBuffer cachedPacket;
+		UInt64 cachedPacketVersion = 0;
+		Int32 cachedPacketCompressionThreshold = 0;
 	};
+
+	// flat world of bedrock, stone and dirt covered by grass
+	[[nodiscard]]
+	std::unique_ptr<Chunk> generateChunk();
+
+	// framed chunk data packet for the current state of the chunk, the caller must hold the chunk's mutex
+	[[nodiscard]]
+	SegmentedBuffer serializeChunkPacket(Chunk const& chunk, ChunkCoord coord, Int32 compressionThreshold);
 }
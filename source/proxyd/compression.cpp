@@ -0,0 +1,171 @@
+#include <proxyd/compression.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <vector>
+
+#include <zlib.h>
+
+namespace vitamine::proxyd::detail
+{
+	// the level is reconsidered once per window, based on the fraction of the window spent compressing
+	constexpr Int64 COMPRESSION_LOAD_WINDOW_NANOS = 1'000'000'000;
+	constexpr Int64 COMPRESSION_LOAD_HIGH_PERCENT = 20;
+	constexpr Int64 COMPRESSION_LOAD_LOW_PERCENT = 5;
+
+	static std::atomic<int> minCompressionLevel = CompressionLevels().min;
+	static std::atomic<int> maxCompressionLevel = CompressionLevels().max;
+
+	static
+	Int64 nowNanos()
+	{
+		auto now = std::chrono::steady_clock::now().time_since_epoch();
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+	}
+
+	class Deflater
+	{
+		z_stream _stream = {};
+		int _level = maxCompressionLevel;
+		std::vector<UInt8> _output;
+
+		Int64 _windowStart = nowNanos();
+		Int64 _busyNanos = 0;
+
+		void adaptLevel(Int64 now)
+		{
+			auto elapsed = now - _windowStart;
+
+			if(elapsed < COMPRESSION_LOAD_WINDOW_NANOS)
+				return;
+
+			auto level = _level;
+
+			if(_busyNanos * 100 > elapsed * COMPRESSION_LOAD_HIGH_PERCENT)
+				--level;
+			else if(_busyNanos * 100 < elapsed * COMPRESSION_LOAD_LOW_PERCENT)
+				++level;
+
+			level = std::clamp(level, (int)minCompressionLevel, (int)maxCompressionLevel);
+
+			// the stream was reset after the last packet, so changing parameters does not flush anything
+			if(level != _level && deflateParams(&_stream, level, Z_DEFAULT_STRATEGY) == Z_OK)
+				_level = level;
+
+			_windowStart = now;
+			_busyNanos = 0;
+		}
+
+	public:
+		Deflater()
+		{
+			if(deflateInit(&_stream, _level) != Z_OK)
+				throw std::bad_alloc();
+		}
+
+		~Deflater()
+		{
+			deflateEnd(&_stream);
+		}
+
+		Deflater(Deflater const&) = delete;
+		Deflater& operator=(Deflater const&) = delete;
+
+		Span<UInt8 const> deflate(Span<Span<UInt8 const> const> segments)
+		{
+			auto start = nowNanos();
+			adaptLevel(start);
+
+			UInt inputSize = 0;
+
+			for(auto segment : segments)
+				inputSize += segment.size();
+
+			// the output buffer is large enough to finish in one pass, it only ever grows
+			auto bound = deflateBound(&_stream, inputSize);
+
+			if(_output.size() < bound)
+				_output.resize(bound);
+
+			_stream.next_out = _output.data();
+			_stream.avail_out = _output.size();
+
+			for(auto segment : segments)
+			{
+				_stream.next_in = (Bytef*)segment.data();
+				_stream.avail_in = segment.size();
+				::deflate(&_stream, Z_NO_FLUSH);
+			}
+
+			::deflate(&_stream, Z_FINISH);
+
+			auto size = _stream.total_out;
+			deflateReset(&_stream);
+
+			_busyNanos += nowNanos() - start;
+			return {_output.data(), size};
+		}
+	};
+
+	class Inflater
+	{
+		z_stream _stream = {};
+		std::vector<UInt8> _output;
+
+	public:
+		Inflater()
+		{
+			if(inflateInit(&_stream) != Z_OK)
+				throw std::bad_alloc();
+		}
+
+		~Inflater()
+		{
+			inflateEnd(&_stream);
+		}
+
+		Inflater(Inflater const&) = delete;
+		Inflater& operator=(Inflater const&) = delete;
+
+		bool inflate(Span<UInt8 const> in, UInt size, Span<UInt8 const>* out)
+		{
+			if(_output.size() < size)
+				_output.resize(size);
+
+			_stream.next_in = (Bytef*)in.data();
+			_stream.avail_in = in.size();
+			_stream.next_out = _output.data();
+			_stream.avail_out = size;
+
+			auto result = ::inflate(&_stream, Z_FINISH);
+			auto ok = result == Z_STREAM_END && _stream.avail_in == 0 && _stream.avail_out == 0;
+			inflateReset(&_stream);
+
+			*out = {_output.data(), size};
+			return ok;
+		}
+	};
+
+	Span<UInt8 const> deflateSegments(Span<Span<UInt8 const> const> segments)
+	{
+		thread_local Deflater deflater;
+		return deflater.deflate(segments);
+	}
+
+	bool inflateExact(Span<UInt8 const> in, UInt size, Span<UInt8 const>* out)
+	{
+		thread_local Inflater inflater;
+		return inflater.inflate(in, size, out);
+	}
+}
+
+namespace vitamine::proxyd
+{
+	void setCompressionLevels(CompressionLevels levels)
+	{
+		detail::minCompressionLevel = std::clamp(levels.min, 1, 9);
+		detail::maxCompressionLevel = std::clamp(levels.max, (int)detail::minCompressionLevel, 9);
+	}
+}
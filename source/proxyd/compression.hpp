@@ -0,0 +1,48 @@
+#pragma once
+
+#include <boost/container/small_vector.hpp>
+
+#include <common/buffer.hpp>
+#include <common/segmentedbuffer.hpp>
+#include <common/span.hpp>
+#include <common/types.hpp>
+
+namespace vitamine::proxyd
+{
+	// zlib levels the compressor may choose from
+	// each thread starts at the maximum and lowers the level while it spends too much time compressing
+	struct CompressionLevels
+	{
+		int min = 1;
+		int max = 6;
+	};
+
+	// applies to all threads, including those that are already compressing
+	void setCompressionLevels(CompressionLevels levels);
+}
+
+namespace vitamine::proxyd::detail
+{
+	// compresses the concatenation of the segments with the calling thread's deflate context
+	// the result stays valid until the next call on the same thread
+	Span<UInt8 const> deflateSegments(Span<Span<UInt8 const> const> segments);
+
+	// returns false unless the input is a single zlib stream that decompresses to exactly the given size
+	// on success, the result stays valid until the next call on the same thread
+	bool inflateExact(Span<UInt8 const> in, UInt size, Span<UInt8 const>* out);
+
+	inline
+	Span<UInt8 const> deflateBuffer(Buffer const& buffer)
+	{
+		Span<UInt8 const> segment((UInt8 const*)buffer.data(), buffer.size());
+		return deflateSegments({&segment, 1});
+	}
+
+	inline
+	Span<UInt8 const> deflateBuffer(SegmentedBuffer const& buffer)
+	{
+		boost::container::small_vector<Span<UInt8 const>, 8> segments;
+		buffer.forEachSegment([&](auto data, auto size){ segments.emplace_back((UInt8 const*)data, size); });
+		return deflateSegments({segments.data(), segments.size()});
+	}
+}
@@ -2,9 +2,15 @@
 
 #include <cstring>
 
+#if defined(__SSE2__) || defined(__BMI2__)
+#include <immintrin.h>
+#endif
+
+#include <common/byteswap.hpp>
 #include <common/span.hpp>
 #include <common/traits.hpp>
 #include <common/types.hpp>
+#include <common/utf8.hpp>
 
 #include <boost/endian/conversion.hpp>
 #include <boost/uuid/uuid.hpp>
@@ -20,8 +26,9 @@ namespace vitamine::proxyd
 		ERROR_DATA_INVALID,
 	};
 
+	// reference implementation for deserializeVarInt
 	inline
-	DeserializeStatus deserializeVarInt(UInt8 const** bufpp, UInt* sizep, Int32* out)
+	DeserializeStatus deserializeVarIntScalar(UInt8 const** bufpp, UInt* sizep, Int32* out)
 	{
 		UInt32 result = 0;
 		UInt count = 0;
@@ -46,6 +53,106 @@ namespace vitamine::proxyd
 		return DeserializeStatus::OK;
 	}
 
+	namespace detail
+	{
+		// 'word' holds the encoded bytes in little endian order, 'length' is the encoded length
+		inline
+		UInt32 decodeVarInt32(UInt64 word, UInt length)
+		{
+			auto bits = word & (~0ull >> (64 - 8 * length));
+
+			// gather the low 7 bits of every byte, bits beyond 32 are dropped like in the scalar version
+#ifdef __BMI2__
+			return (UInt32)_pext_u64(bits, 0x0000007f7f7f7f7full);
+#else
+			return (UInt32)((bits & 0x7fu)
+			              | (bits >> 1 & 0x3f80u)
+			              | (bits >> 2 & 0x1fc000u)
+			              | (bits >> 3 & 0xfe00000u)
+			              | (bits >> 4 & 0x7f0000000ull));
+#endif
+		}
+
+		inline
+		UInt64 loadLittleEndian64(UInt8 const* buf)
+		{
+			UInt64 word;
+			std::memcpy(&word, buf, sizeof word);
+			return boost::endian::little_to_native(word);
+		}
+	}
+
+	inline
+	DeserializeStatus deserializeVarInt(UInt8 const** bufpp, UInt* sizep, Int32* out)
+	{
+		// the fast path reads 8 bytes at once
+		if(*sizep < 8)
+			return deserializeVarIntScalar(bufpp, sizep, out);
+
+		auto word = detail::loadLittleEndian64(*bufpp);
+
+		// bytes with a clear high bit terminate the varint, only the first VARINT32_MAX_LENGTH bytes are candidates
+		auto stops = ~word & 0x0000008080808080ull;
+
+		if(stops == 0)
+			return DeserializeStatus::ERROR_DATA_INVALID;
+
+		auto length = (UInt)(__builtin_ctzll(stops) + 1) / 8;
+
+		*bufpp += length;
+		*sizep -= length;
+		*out = (Int32)detail::decodeVarInt32(word, length);
+		return DeserializeStatus::OK;
+	}
+
+	// decodes 'count' consecutive varints
+	inline
+	DeserializeStatus deserializeVarIntBatch(UInt8 const** bufpp, UInt* sizep, Int32* out, UInt count)
+	{
+		auto bufp = *bufpp;
+		auto size = *sizep;
+		UInt i = 0;
+
+#ifdef __SSE2__
+		// the terminators of all varints within a 16 byte block are found with a single movemask
+		// the block is only processed while another 8 bytes can be read behind it for the last varint
+		while(i != count && size >= 16 + 8)
+		{
+			auto block = _mm_loadu_si128((__m128i const*)bufp);
+			auto stops = ~(UInt32)_mm_movemask_epi8(block) & 0xffffu;
+			UInt consumed = 0;
+
+			while(i != count && stops != 0)
+			{
+				auto end = (UInt)__builtin_ctz(stops) + 1;
+				auto length = end - consumed;
+
+				if(length > VARINT32_MAX_LENGTH)
+					return DeserializeStatus::ERROR_DATA_INVALID;
+
+				out[i++] = (Int32)detail::decodeVarInt32(detail::loadLittleEndian64(bufp + consumed), length);
+				consumed = end;
+				stops &= stops - 1;
+			}
+
+			// no terminator in 16 bytes
+			if(consumed == 0)
+				return DeserializeStatus::ERROR_DATA_INVALID;
+
+			bufp += consumed;
+			size -= consumed;
+		}
+#endif
+
+		for(; i != count; ++i)
+			if(auto status = deserializeVarInt(&bufp, &size, &out[i]); status != DeserializeStatus::OK)
+				return status;
+
+		*bufpp = bufp;
+		*sizep = size;
+		return DeserializeStatus::OK;
+	}
+
 	inline
 	DeserializeStatus deserializeBytes(UInt8 const** bufpp, UInt* sizep, UInt blockSize, UInt8 const** out)
 	{
@@ -70,6 +177,18 @@ namespace vitamine::proxyd
 		return DeserializeStatus::OK;
 	}
 
+	// reads 'count' consecutive big endian integers, all of them are converted in a single vectorized pass
+	template <typename T>
+	DeserializeStatus deserializeIntArray(UInt8 const** bufpp, UInt* sizep, T* out, UInt count)
+	{
+		UInt8 const* ptr;
+		if(auto status = deserializeBytes(bufpp, sizep, count * sizeof(T), &ptr); status != DeserializeStatus::OK)
+			return status;
+
+		copyBigEndianArray<T>(out, ptr, count);
+		return DeserializeStatus::OK;
+	}
+
 	template <typename T>
 	DeserializeStatus deserializeFloat(UInt8 const** bufpp, UInt* sizep, T* out)
 	{
@@ -97,6 +216,7 @@ namespace vitamine::proxyd
 		return DeserializeStatus::OK;
 	}
 
+	// protocol strings are utf-8, anything else is rejected before it reaches a handler
 	inline
 	DeserializeStatus deserializeString(UInt8 const** bufpp, UInt* sizep, Span<Char8 const>* out)
 	{
@@ -111,7 +231,12 @@ namespace vitamine::proxyd
 		if(auto status = deserializeBytes(bufpp, sizep, length, &ptr); status != DeserializeStatus::OK)
 			return status;
 
-		*out = {(Char8 const*)ptr, (UInt)length};
+		Span<Char8 const> str((Char8 const*)ptr, (UInt)length);
+
+		if(!isValidUtf8(str))
+			return DeserializeStatus::ERROR_DATA_INVALID;
+
+		*out = str;
 		return DeserializeStatus::OK;
 	}
 
@@ -141,4 +266,35 @@ namespace vitamine::proxyd
 		*out = uuid;
 		return DeserializeStatus::OK;
 	}
+
+	// unchecked loads for fixed layouts, the caller has already checked that the data is large enough
+
+	template <typename T>
+	T loadBigEndian(UInt8 const* data)
+	{
+		T value;
+		std::memcpy(&value, data, sizeof value);
+		return boost::endian::big_to_native(value);
+	}
+
+	template <typename T>
+	T loadBigEndianFloat(UInt8 const* data)
+	{
+		auto bits = loadBigEndian<typename UIntForSize<sizeof(T)>::Type>(data);
+		T value;
+		std::memcpy(&value, &bits, sizeof value);
+		return value;
+	}
+
+	inline
+	boost::uuids::uuid loadUuid(UInt8 const* data)
+	{
+		auto hi = loadBigEndian<UInt64>(data);
+		auto lo = loadBigEndian<UInt64>(data + 8);
+
+		boost::uuids::uuid uuid;
+		std::memcpy(uuid.begin(),     &lo, 8);
+		std::memcpy(uuid.begin() + 8, &hi, 8);
+		return uuid;
+	}
 }
@@ -3,7 +3,9 @@
 #include <stdexcept>
 #include <variant>
 
+#include <common/arena.hpp>
 #include <common/buffer.hpp>
+#include <common/span.hpp>
 #include <common/types.hpp>
 #include <proxyd/deserialize.hpp>
 #include <proxyd/serialize.hpp>
@@ -51,8 +53,8 @@ namespace vitamine::proxyd
 		std::variant<UInt8, Int32, Float32, Span<Char8 const>, bool, EntityMetadataPose> value;
 	};
 
-	inline
-	void serializeEntityMetadata(Buffer& buffer, std::vector<EntityMetadata> const& meta)
+	template <typename OutputBuffer>
+	void serializeEntityMetadata(OutputBuffer& buffer, Span<EntityMetadata const> meta)
 	{
 		for(auto& entry : meta)
 		{
@@ -91,7 +93,48 @@ namespace vitamine::proxyd
 	}
 
 	inline
-	DeserializeStatus deserializeEntityMetadata(UInt8 const** bufpp, UInt* sizep, std::vector<EntityMetadata>* out)
+	UInt serializedSizeEntityMetadata(Span<EntityMetadata const> meta)
+	{
+		// terminator
+		UInt size = sizeof(UInt8);
+
+		for(auto& entry : meta)
+		{
+			size += sizeof entry.index + serializedSizeVarInt((Int32)entry.type);
+
+			switch(entry.type)
+			{
+			case EntityMetadataType::BYTE:
+				size += sizeof(UInt8);
+				break;
+
+			case EntityMetadataType::VARINT:
+				size += serializedSizeVarInt(std::get<Int32>(entry.value));
+				break;
+
+			case EntityMetadataType::FLOAT:
+				size += sizeof(Float32);
+				break;
+
+			case EntityMetadataType::BOOL:
+				size += sizeof(UInt8);
+				break;
+
+			case EntityMetadataType::POSE:
+				size += serializedSizeVarInt((Int32)std::get<EntityMetadataPose>(entry.value));
+				break;
+
+			default:
+				// TODO: implement
+				throw std::runtime_error("unimplemented");
+			}
+		}
+
+		return size;
+	}
+
+	inline
+	DeserializeStatus deserializeEntityMetadata(UInt8 const** bufpp, UInt* sizep, Span<EntityMetadata const>* out, Arena& arena)
 	{
 		// TODO: implement
 		throw std::runtime_error("unimplemented");
@@ -1,15 +1,43 @@
 #pragma once
 
+#include <cassert>
+#include <type_traits>
+
 #include <common/buffer.hpp>
+#include <common/segmentedbuffer.hpp>
 #include <common/span.hpp>
 #include <common/types.hpp>
+#include <proxyd/compression.hpp>
 #include <proxyd/deserialize.hpp>
 #include <proxyd/serialize.hpp>
 
 namespace vitamine::proxyd::detail
 {
 	constexpr UInt INCOMING_PACKET_MAX_TOTAL_LENGTH = 1024;
-	constexpr UInt INCOMING_PACKET_MAX_LENGTH_VALUE = INCOMING_PACKET_MAX_TOTAL_LENGTH - VARINT32_MAX_LENGTH;
+
+	// limits the memory a small compressed frame can expand to
+	constexpr UInt INCOMING_PACKET_MAX_UNCOMPRESSED_LENGTH = 32768;
+
+	// compressed packet format: [length, dataLength, zlib([id, data])]
+	// dataLength is the size of [id, data] before compression, 0 if the packet is below the threshold and sent as is
+	template <typename OutputBuffer>
+	void compressPacketBody(OutputBuffer& body, Int32 compressionThreshold)
+	{
+		UInt8 header[VARINT32_MAX_ENCODED_SIZE];
+
+		if(body.size() < (UInt)compressionThreshold)
+		{
+			body.prepend(header, encodeVarInt32(header, 0));
+			return;
+		}
+
+		auto compressed = deflateBuffer(body);
+
+		OutputBuffer out;
+		out.write(compressed.data(), compressed.size());
+		out.prepend(header, encodeVarInt32(header, body.size()));
+		body = std::move(out);
+	}
 }
 
 namespace vitamine::proxyd
@@ -20,7 +48,22 @@ namespace vitamine::proxyd
 		Span<UInt8 const> data;
 	};
 
-	inline
+	// largest frames accepted from a peer, this bounds the memory a peer can make us buffer
+	struct ServerboundFrameLimits
+	{
+		static constexpr UInt MAX_TOTAL_LENGTH = detail::INCOMING_PACKET_MAX_TOTAL_LENGTH;
+		static constexpr UInt MAX_UNCOMPRESSED_LENGTH = detail::INCOMING_PACKET_MAX_UNCOMPRESSED_LENGTH;
+	};
+
+	// clientbound frames carry whole chunks, the protocol limits their length to a 3 byte varint
+	// only for tools that connect to a server they trust
+	struct ClientboundFrameLimits
+	{
+		static constexpr UInt MAX_TOTAL_LENGTH = (1 << 21) - 1 + VARINT32_MAX_LENGTH;
+		static constexpr UInt MAX_UNCOMPRESSED_LENGTH = 1 << 23;
+	};
+
+	template <typename Limits = ServerboundFrameLimits>
 	DeserializeStatus deserializePacketFrame(UInt8 const** bufpp, UInt* sizep, PacketFrame* out)
 	{
 		auto bufp = *bufpp;
@@ -32,7 +75,7 @@ namespace vitamine::proxyd
 		if(auto status = deserializeVarInt(&bufp, &size, &length); status != DeserializeStatus::OK)
 			return status;
 
-		if(length < 0 || length > detail::INCOMING_PACKET_MAX_LENGTH_VALUE)
+		if(length < 0 || (UInt)length > Limits::MAX_TOTAL_LENGTH - VARINT32_MAX_LENGTH)
 			return DeserializeStatus::ERROR_DATA_INVALID;
 
 		UInt8 const* data;
@@ -54,30 +97,83 @@ namespace vitamine::proxyd
 		return DeserializeStatus::OK;
 	}
 
-	template <typename Packet>
-	Buffer serializePacket(Packet const& packet)
+	template <typename Limits = ServerboundFrameLimits>
+	DeserializeStatus deserializeCompressedPacketFrame(UInt8 const** bufpp, UInt* sizep, PacketFrame* out)
 	{
-		Buffer buffer;
-		serializePacketPayload(buffer, packet);
+		auto bufp = *bufpp;
+		auto size = *sizep;
 
-		UInt8 headerBuffer[2 * detail::VARINT32_MAX_ENCODED_SIZE];
-		auto idLength = detail::wireSizeVarInt32(Packet::ID);
-		auto lengthLength = detail::encodeVarInt32(headerBuffer, buffer.size() + idLength);
-		detail::encodeVarInt32(headerBuffer + lengthLength, Packet::ID);
+		// packet format: [length, dataLength, data]
+		// length includes length of dataLength, data is [id, data] and zlib compressed unless dataLength is 0
+		Int32 length;
+		if(auto status = deserializeVarInt(&bufp, &size, &length); status != DeserializeStatus::OK)
+			return status;
 
-		buffer.prepend(headerBuffer, lengthLength + idLength);
+		if(length < 0 || (UInt)length > Limits::MAX_TOTAL_LENGTH - VARINT32_MAX_LENGTH)
+			return DeserializeStatus::ERROR_DATA_INVALID;
 
-		return buffer;
+		UInt8 const* data;
+		if(auto status = deserializeBytes(&bufp, &size, length, &data); status != DeserializeStatus::OK)
+			return status;
+
+		auto dataLength = static_cast<UInt>(length);
+
+		Int32 uncompressedLength;
+		if(auto status = deserializeVarInt(&data, &dataLength, &uncompressedLength); status != DeserializeStatus::OK)
+			return status;
+
+		if(uncompressedLength < 0 || (UInt)uncompressedLength > Limits::MAX_UNCOMPRESSED_LENGTH)
+			return DeserializeStatus::ERROR_DATA_INVALID;
+
+		if(uncompressedLength != 0)
+		{
+			// the decompressed frame lives in a per-thread buffer that is reused by the next frame
+			Span<UInt8 const> uncompressed;
+			if(!detail::inflateExact({data, dataLength}, uncompressedLength, &uncompressed))
+				return DeserializeStatus::ERROR_DATA_INVALID;
+
+			data = uncompressed.data();
+			dataLength = uncompressed.size();
+		}
+
+		Int32 id;
+		if(auto status = deserializeVarInt(&data, &dataLength, &id); status != DeserializeStatus::OK)
+			return status;
+
+		*bufpp = bufp;
+		*sizep = size;
+		*out = {id, {data, dataLength}};
+		return DeserializeStatus::OK;
 	}
 
-	inline
-	void debugPrint(PacketFrame frame)
+	// a negative compression threshold produces the uncompressed format used before compression is negotiated
+	template <typename OutputBuffer = Buffer, typename Packet>
+	OutputBuffer serializePacket(Packet const& packet, Int32 compressionThreshold = -1)
 	{
-		std::printf("id=%d (hex: 0x%02x), length=%d (hex: 0x%x)\n", (int)frame.id, (int)frame.id, (int)frame.data.size(), (int)frame.data.size());
+		OutputBuffer buffer;
 
-		for(auto x : frame.data)
-			std::printf("%02x ", +x);
+		if constexpr(std::is_same_v<OutputBuffer, Buffer>)
+		{
+			// sized exactly up front, so the storage grows once and the fields are written without capacity checks
+			auto size = serializedSize(packet);
+			UncheckedWriter writer(buffer.extend(size));
+			serializePacketPayload(writer, packet);
+			assert(writer.position() == (UInt8*)buffer.data() + size);
+		}
+		else
+			serializePacketPayload(buffer, packet);
 
-		std::printf("\n");
+		// the header fits into the buffer's headroom, so prepending it does not move the payload
+		static_assert(3 * detail::VARINT32_MAX_ENCODED_SIZE <= BUFFER_HEADROOM);
+
+		UInt8 headerBuffer[detail::VARINT32_MAX_ENCODED_SIZE];
+		buffer.prepend(headerBuffer, detail::encodeVarInt32(headerBuffer, Packet::ID));
+
+		if(compressionThreshold >= 0)
+			detail::compressPacketBody(buffer, compressionThreshold);
+
+		buffer.prepend(headerBuffer, detail::encodeVarInt32(headerBuffer, buffer.size()));
+
+		return buffer;
 	}
 }
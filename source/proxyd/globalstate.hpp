@@ -1,5 +1,6 @@
 #pragma once
 
+#include <array>
 #include <atomic>
 #include <mutex>
 #include <unordered_map>
@@ -9,7 +10,9 @@
 
 #include <common/clockmonotonic.hpp>
 #include <common/types.hpp>
+#include <proxyd/authentication.hpp>
 #include <proxyd/chunk.hpp>
+#include <proxyd/compression.hpp>
 #include <proxyd/playertracker.hpp>
 #include <proxyd/types.hpp>
 
@@ -17,12 +20,23 @@ namespace vitamine::proxyd
 {
 	class StateMachine;
 
+	// serverbound packet ids are counted individually below this limit, all larger ids share the last slot
+	constexpr UInt UNHANDLED_PACKET_COUNTER_SLOTS = 128;
+
 	struct ServerSettings
 	{
 		Int8 maxViewDistance = 32;
 		bool reducedDebugInfo = false;
 
 		Dimension dimension = Dimension::OVERWORLD;
+
+		// encrypts connections and verifies players with the session verifier
+		bool onlineMode = false;
+
+		// packets at least this large, including their id, are compressed once a player has logged in
+		// a negative value disables compression
+		Int32 compressionThreshold = 256;
+		CompressionLevels compressionLevels;
 	};
 
 	struct GlobalState
@@ -31,7 +45,17 @@ namespace vitamine::proxyd
 		std::atomic<EntityId> nextEntityId{1};
 
 		ServerSettings serverSettings;
-		MonotonicClock clock;
+
+		// replays substitute a virtual clock
+		MonotonicClock monotonicClock;
+		Clock* clock = &monotonicClock;
+
+		// only used in online mode
+		std::unique_ptr<ServerKeyPair> keyPair;
+		ISessionVerifier* sessionVerifier = nullptr;
+
+		// packets dropped because the client's current phase does not handle their id
+		std::array<std::atomic<UInt64>, UNHANDLED_PACKET_COUNTER_SLOTS> unhandledPackets = {};
 
 		mutable std::mutex playersMutex;
 		std::unordered_set<StateMachine*> players;
@@ -1,30 +1,140 @@
 #include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <vector>
 
 #include <boost/asio/io_service.hpp>
 #include <boost/asio/signal_set.hpp>
 #include <boost/asio/ip/tcp.hpp>
 
+#include <common/bufferpool.hpp>
+#include <common/net/capture.hpp>
+#include <common/net/reactorpool.hpp>
 #include <common/net/tcpserver.hpp>
 #include <proxyd/proxyserver.hpp>
+#include <proxyd/sessionserver.hpp>
 
-int main()
+static
+void usage(char const* argv0)
+{
+	std::printf("usage: %s [--threads <count>] [--pin-threads] [--backend asio|io_uring] [--compression-threshold <bytes>] [--compression-levels <min> <max>] [--online-mode [--session-server <host> | --stub-sessions accept|deny]] [--capture <path> [--capture-outbound]]\n", argv0);
+	std::exit(1);
+}
+
+int main(int argc, char** argv)
 {
 	using namespace boost::asio;
 	using namespace vitamine;
 	using namespace vitamine::proxyd;
 
+	ReactorPoolSettings poolSettings;
+
+	TcpServerSettings serverSettings;
+	serverSettings.reusePort = true;
+
+	ServerSettings proxySettings;
+
+	char const* sessionServerHost = DEFAULT_SESSION_SERVER_HOST;
+	char const* stubSessions = nullptr;
+
+	char const* capturePath = nullptr;
+	bool captureOutbound = false;
+
+	for(int i = 1; i < argc; ++i)
+	{
+		if(std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+			poolSettings.threadCount = std::strtoul(argv[++i], nullptr, 10);
+		else if(std::strcmp(argv[i], "--pin-threads") == 0)
+			poolSettings.pinThreads = true;
+		else if(std::strcmp(argv[i], "--backend") == 0 && i + 1 < argc)
+		{
+			if(std::strcmp(argv[++i], "asio") == 0)
+				serverSettings.backend = TcpServerBackend::ASIO;
+			else if(std::strcmp(argv[i], "io_uring") == 0)
+				serverSettings.backend = TcpServerBackend::IO_URING;
+			else
+				usage(argv[0]);
+		}
+		else if(std::strcmp(argv[i], "--compression-threshold") == 0 && i + 1 < argc)
+			proxySettings.compressionThreshold = std::strtol(argv[++i], nullptr, 10);
+		else if(std::strcmp(argv[i], "--compression-levels") == 0 && i + 2 < argc)
+		{
+			proxySettings.compressionLevels.min = std::strtol(argv[++i], nullptr, 10);
+			proxySettings.compressionLevels.max = std::strtol(argv[++i], nullptr, 10);
+		}
+		else if(std::strcmp(argv[i], "--online-mode") == 0)
+			proxySettings.onlineMode = true;
+		else if(std::strcmp(argv[i], "--session-server") == 0 && i + 1 < argc)
+			sessionServerHost = argv[++i];
+		else if(std::strcmp(argv[i], "--stub-sessions") == 0 && i + 1 < argc)
+		{
+			stubSessions = argv[++i];
+
+			if(std::strcmp(stubSessions, "accept") != 0 && std::strcmp(stubSessions, "deny") != 0)
+				usage(argv[0]);
+		}
+		else if(std::strcmp(argv[i], "--capture") == 0 && i + 1 < argc)
+			capturePath = argv[++i];
+		else if(std::strcmp(argv[i], "--capture-outbound") == 0)
+			captureOutbound = true;
+		else
+			usage(argv[0]);
+	}
+
 	auto endpoint = ip::tcp::endpoint(ip::tcp::v4(), 1337);
 
-	io_service service;
+	ReactorPool pool(poolSettings);
 
-	signal_set set(service);
+	signal_set set(*pool.service(0));
 	set.add(SIGINT);
 	set.add(SIGTERM);
-	set.async_wait([&](...){ service.stop(); });
+	set.async_wait([&](...){ pool.stop(); });
+
+	// captures can be fed back into the server with vitareplay
+	// the writer outlives the server, whose connections record until they are destroyed
+	std::unique_ptr<CaptureWriter> captureWriter;
+
+	if(capturePath)
+		captureWriter = std::make_unique<CaptureWriter>(capturePath, CaptureSettings{proxySettings.compressionThreshold, proxySettings.onlineMode});
+
+	// the stub answers without a session server, so online mode logins can be tested locally, e.g. with vitabot
+	std::unique_ptr<ISessionVerifier> sessionVerifier;
+
+	if(proxySettings.onlineMode && stubSessions)
+		sessionVerifier = std::make_unique<StubSessionVerifier>(std::strcmp(stubSessions, "accept") == 0);
+	else if(proxySettings.onlineMode)
+		sessionVerifier = std::make_unique<SessionServerVerifier>(sessionServerHost);
+
+	ProxyServer proxy(pool.service(0), proxySettings, sessionVerifier.get());
+	IConnectionHandler* handler = &proxy;
+
+	std::unique_ptr<RecordingConnectionHandler> recorder;
+
+	if(captureWriter)
+	{
+		recorder = std::make_unique<RecordingConnectionHandler>(&proxy, &*captureWriter, captureOutbound);
+		handler = &*recorder;
+		std::printf("capturing %s traffic to %s\n", captureOutbound ? "inbound and outbound" : "inbound", capturePath);
+	}
+
+	// one acceptor per reactor, connections stay on the reactor that accepted them
+	std::vector<std::unique_ptr<TcpServer>> servers;
+
+	for(UInt i = 0; i != pool.size(); ++i)
+	{
+		servers.push_back(std::make_unique<TcpServer>(pool.service(i), endpoint, handler, serverSettings));
+		servers.back()->asyncServe();
+	}
+
+	std::printf("listening on port %d with %zu reactor threads\n", (int)endpoint.port(), (std::size_t)pool.size());
+	pool.run();
 
-	ProxyServer proxy(&service);
-	TcpServer server(&service, endpoint, &proxy);
-	server.asyncServe();
+	auto stats = bufferPoolStats();
+	std::printf("buffer pool: %llu hits, %llu misses\n", (unsigned long long)stats.hits, (unsigned long long)stats.misses);
 
-	service.run();
+	for(UInt id = 0; id != UNHANDLED_PACKET_COUNTER_SLOTS; ++id)
+		if(auto count = proxy.unhandledPackets(id))
+			std::printf("unhandled packet 0x%02x%s: %llu\n", (unsigned)id, id == UNHANDLED_PACKET_COUNTER_SLOTS - 1 ? " and above" : "", (unsigned long long)count);
 }
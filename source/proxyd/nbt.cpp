@@ -1,15 +1,14 @@
-#include <stdexcept>
+#include <algorithm>
+#include <memory>
+#include <vector>
 
 #include <proxyd/nbt.hpp>
 #include <proxyd/serialize.hpp>
 
 namespace vitamine::proxyd
 {
-	// TODO: nbt strings are actually modified UTF-8:
-	// https://docs.oracle.com/javase/8/docs/api/java/io/DataInput.html#modified-utf-8
-
-	inline
-	void serializeNbtValue(Buffer& buffer, NbtType type, NbtValue const& value)
+	template <typename OutputBuffer>
+	void serializeNbtValue(OutputBuffer& buffer, NbtType type, NbtValue const& value)
 	{
 		switch(type)
 		{
@@ -38,8 +37,7 @@ namespace vitamine::proxyd
 			break;
 
 		case NbtType::STRING:
-			serializeInt(buffer, (UInt16)value.str.size());
-			serializeBytes(buffer, Span((UInt8 const*)value.str.data(), value.str.size()));
+			serializeNbtString(buffer, value.str);
 			break;
 
 		case NbtType::BYTE_ARRAY:
@@ -49,18 +47,12 @@ namespace vitamine::proxyd
 
 		case NbtType::INT_ARRAY:
 			serializeInt(buffer, (Int32)value.ai32.size());
-
-			for(auto i : value.ai32)
-				serializeInt(buffer, i);
-
+			serializeIntArray(buffer, value.ai32);
 			break;
 
 		case NbtType::LONG_ARRAY:
 			serializeInt(buffer, (Int32)value.ai64.size());
-
-			for(auto i : value.ai64)
-				serializeInt(buffer, i);
-
+			serializeIntArray(buffer, value.ai64);
 			break;
 
 		case NbtType::LIST:
@@ -82,17 +74,370 @@ namespace vitamine::proxyd
 		}
 	}
 
-	void serializeNbt(Buffer& buffer, Nbt const& tag)
+	template <typename OutputBuffer>
+	void serializeNbt(OutputBuffer& buffer, Nbt const& tag)
 	{
 		serializeInt(buffer, (UInt8)tag.type);
-		serializeInt(buffer, (Int16)tag.name.size());
-		serializeBytes(buffer, Span((UInt8 const*)tag.name.data(), tag.name.size()));
+		serializeNbtString(buffer, tag.name);
 		serializeNbtValue(buffer, tag.type, tag.value);
 	}
 
-	DeserializeStatus deserializeNbt(UInt8 const** bufpp, UInt* sizep, Nbt* out)
+	template void serializeNbt(Buffer& buffer, Nbt const& tag);
+	template void serializeNbt(SegmentedBuffer& buffer, Nbt const& tag);
+	template void serializeNbt(UncheckedWriter& buffer, Nbt const& tag);
+
+	static
+	UInt serializedSizeNbtValue(NbtType type, NbtValue const& value)
+	{
+		switch(type)
+		{
+		case NbtType::BYTE:       return sizeof value.i8;
+		case NbtType::SHORT:      return sizeof value.i16;
+		case NbtType::INT:        return sizeof value.i32;
+		case NbtType::LONG:       return sizeof value.i64;
+		case NbtType::FLOAT:      return sizeof value.f32;
+		case NbtType::DOUBLE:     return sizeof value.f64;
+		case NbtType::STRING:     return sizeof(UInt16) + modifiedUtf8Size(value.str);
+		case NbtType::BYTE_ARRAY: return sizeof(Int32) + value.ai8.size();
+		case NbtType::INT_ARRAY:  return sizeof(Int32) + value.ai32.size() * sizeof(Int32);
+		case NbtType::LONG_ARRAY: return sizeof(Int32) + value.ai64.size() * sizeof(Int64);
+
+		case NbtType::LIST:
+		{
+			UInt size = sizeof(UInt8) + sizeof(Int32);
+
+			for(auto& elem : value.list.values)
+				size += serializedSizeNbtValue(value.list.type, elem);
+
+			return size;
+		}
+
+		case NbtType::COMPOUND:
+		{
+			// end marker
+			UInt size = sizeof(UInt8);
+
+			for(auto& elem : value.compound)
+				size += serializedSizeNbt(elem);
+
+			return size;
+		}
+		}
+
+		return 0;
+	}
+
+	UInt serializedSizeNbt(Nbt const& tag)
+	{
+		return sizeof(UInt8) + sizeof(UInt16) + modifiedUtf8Size(tag.name) + serializedSizeNbtValue(tag.type, tag.value);
+	}
+
+	// deeper nesting is rejected, the vanilla client and server use the same limit
+	constexpr UInt NBT_MAX_DEPTH = 512;
+
+	namespace detail
+	{
+		// a compound or list whose payload is being parsed
+		struct NbtFrame
+		{
+			NbtType type;
+			Span<Char8 const> name;
+
+			// list elements and the root tag are completed in place, tags in a compound are appended to the pending tags
+			NbtValue* target;
+
+			// compound: index of the first of its tags in the pending tags
+			UInt firstTag;
+
+			// list
+			NbtType elementType;
+			Span<NbtValue> elements;
+			UInt nextElement;
+		};
+
+		// reused by every parse on the thread, so parsing does not allocate once the vectors have grown
+		struct NbtParserState
+		{
+			std::vector<NbtFrame> frames;
+
+			// tags of all open compounds, the tags of one compound are contiguous and moved to the arena when it ends
+			std::vector<Nbt> pendingTags;
+		};
+	}
+
+	static
+	bool isValidNbtType(UInt8 type)
+	{
+		return type >= (UInt8)NbtType::BYTE && type <= (UInt8)NbtType::LONG_ARRAY;
+	}
+
+	// lower bound of the encoded size of a value, bounds list allocations by the remaining input
+	static
+	UInt minSerializedSizeNbtValue(NbtType type)
+	{
+		switch(type)
+		{
+		case NbtType::BYTE:       return 1;
+		case NbtType::SHORT:      return 2;
+		case NbtType::INT:        return 4;
+		case NbtType::LONG:       return 8;
+		case NbtType::FLOAT:      return 4;
+		case NbtType::DOUBLE:     return 8;
+		case NbtType::STRING:     return 2;
+		case NbtType::BYTE_ARRAY: return 4;
+		case NbtType::INT_ARRAY:  return 4;
+		case NbtType::LONG_ARRAY: return 4;
+		case NbtType::LIST:       return 5;
+		case NbtType::COMPOUND:   return 1;
+		}
+
+		return 1;
+	}
+
+	static
+	DeserializeStatus deserializeNbtString(UInt8 const** bufpp, UInt* sizep, Span<Char8 const>* out, Arena& arena)
+	{
+		UInt16 length;
+		if(auto status = deserializeInt(bufpp, sizep, &length); status != DeserializeStatus::OK)
+			return status;
+
+		UInt8 const* data;
+		if(auto status = deserializeBytes(bufpp, sizep, length, &data); status != DeserializeStatus::OK)
+			return status;
+
+		if(!modifiedUtf8ToUtf8(Span((Char8 const*)data, length), out, arena))
+			return DeserializeStatus::ERROR_DATA_INVALID;
+
+		return DeserializeStatus::OK;
+	}
+
+	// the array is byte swapped into the arena in one pass, the input is not necessarily aligned
+	template <typename T>
+	static
+	DeserializeStatus deserializeNbtArray(UInt8 const** bufpp, UInt* sizep, Span<T const>* out, Arena& arena)
+	{
+		Int32 length;
+		if(auto status = deserializeInt(bufpp, sizep, &length); status != DeserializeStatus::OK)
+			return status;
+
+		if(length < 0)
+			return DeserializeStatus::ERROR_DATA_INVALID;
+
+		// the length is checked against the input before it is used to allocate
+		if((UInt)length * sizeof(T) > *sizep)
+			return DeserializeStatus::ERROR_DATA_INCOMPLETE;
+
+		auto values = (T*)arena.allocate(length * sizeof(T), alignof(T));
+
+		if(auto status = deserializeIntArray(bufpp, sizep, values, length); status != DeserializeStatus::OK)
+			return status;
+
+		*out = {values, (UInt)length};
+		return DeserializeStatus::OK;
+	}
+
+	// values of every type but compound and list, which are parsed by the caller
+	static
+	DeserializeStatus deserializeNbtScalar(UInt8 const** bufpp, UInt* sizep, NbtType type, NbtValue* out, Arena& arena)
 	{
-		// TODO: implement
-		throw std::runtime_error("unimplemented");
+		switch(type)
+		{
+		case NbtType::BYTE:   return deserializeInt(bufpp, sizep, &out->i8);
+		case NbtType::SHORT:  return deserializeInt(bufpp, sizep, &out->i16);
+		case NbtType::INT:    return deserializeInt(bufpp, sizep, &out->i32);
+		case NbtType::LONG:   return deserializeInt(bufpp, sizep, &out->i64);
+		case NbtType::FLOAT:  return deserializeFloat(bufpp, sizep, &out->f32);
+		case NbtType::DOUBLE: return deserializeFloat(bufpp, sizep, &out->f64);
+		case NbtType::STRING: return deserializeNbtString(bufpp, sizep, &out->str, arena);
+
+		case NbtType::BYTE_ARRAY:
+		{
+			Int32 length;
+			if(auto status = deserializeInt(bufpp, sizep, &length); status != DeserializeStatus::OK)
+				return status;
+
+			if(length < 0)
+				return DeserializeStatus::ERROR_DATA_INVALID;
+
+			UInt8 const* data;
+			if(auto status = deserializeBytes(bufpp, sizep, length, &data); status != DeserializeStatus::OK)
+				return status;
+
+			out->ai8 = {(Int8 const*)data, (UInt)length};
+			return DeserializeStatus::OK;
+		}
+
+		case NbtType::INT_ARRAY:  return deserializeNbtArray(bufpp, sizep, &out->ai32, arena);
+		case NbtType::LONG_ARRAY: return deserializeNbtArray(bufpp, sizep, &out->ai64, arena);
+
+		case NbtType::LIST:
+		case NbtType::COMPOUND:
+			break;
+		}
+
+		return DeserializeStatus::ERROR_DATA_INVALID;
+	}
+
+	// the tree is built without recursion, nesting is only limited by NBT_MAX_DEPTH
+	// byte arrays and strings that are the same in utf-8 point into the input, everything else is allocated from the arena
+	DeserializeStatus deserializeNbt(UInt8 const** bufpp, UInt* sizep, Nbt* out, Arena& arena)
+	{
+		thread_local detail::NbtParserState state;
+		auto& frames = state.frames;
+		auto& pendingTags = state.pendingTags;
+
+		frames.clear();
+		pendingTags.clear();
+
+		auto bufp = *bufpp;
+		auto size = *sizep;
+
+		UInt8 rootType;
+		if(auto status = deserializeInt(&bufp, &size, &rootType); status != DeserializeStatus::OK)
+			return status;
+
+		if(!isValidNbtType(rootType))
+			return DeserializeStatus::ERROR_DATA_INVALID;
+
+		Nbt root;
+		root.type = (NbtType)rootType;
+
+		if(auto status = deserializeNbtString(&bufp, &size, &root.name, arena); status != DeserializeStatus::OK)
+			return status;
+
+		// starts parsing a compound or list payload, or parses any other payload right away
+		// target is null for tags in a compound, which are appended to the pending tags once complete
+		auto beginValue = [&](NbtType type, Span<Char8 const> name, NbtValue* target) -> DeserializeStatus
+		{
+			if(type != NbtType::COMPOUND && type != NbtType::LIST)
+			{
+				if(target)
+					return deserializeNbtScalar(&bufp, &size, type, target, arena);
+
+				Nbt tag;
+				tag.type = type;
+				tag.name = name;
+
+				if(auto status = deserializeNbtScalar(&bufp, &size, type, &tag.value, arena); status != DeserializeStatus::OK)
+					return status;
+
+				pendingTags.push_back(tag);
+				return DeserializeStatus::OK;
+			}
+
+			if(frames.size() == NBT_MAX_DEPTH)
+				return DeserializeStatus::ERROR_DATA_INVALID;
+
+			detail::NbtFrame frame = {};
+			frame.type = type;
+			frame.name = name;
+			frame.target = target;
+			frame.firstTag = pendingTags.size();
+
+			if(type == NbtType::LIST)
+			{
+				UInt8 elementType;
+				if(auto status = deserializeInt(&bufp, &size, &elementType); status != DeserializeStatus::OK)
+					return status;
+
+				Int32 length;
+				if(auto status = deserializeInt(&bufp, &size, &length); status != DeserializeStatus::OK)
+					return status;
+
+				// empty lists may have the end tag as their element type, which has no NbtType and is read as a list of bytes
+				if(elementType == 0 && length == 0)
+					elementType = (UInt8)NbtType::BYTE;
+
+				if(length < 0 || !isValidNbtType(elementType))
+					return DeserializeStatus::ERROR_DATA_INVALID;
+
+				if(length != 0 && (UInt)length > size / minSerializedSizeNbtValue((NbtType)elementType))
+					return DeserializeStatus::ERROR_DATA_INCOMPLETE;
+
+				frame.elementType = (NbtType)elementType;
+				frame.elements = arena.allocateArray<NbtValue>(length);
+			}
+
+			frames.push_back(frame);
+			return DeserializeStatus::OK;
+		};
+
+		// stores the value of the innermost frame and closes it
+		auto endValue = [&](NbtValue value)
+		{
+			auto frame = frames.back();
+			frames.pop_back();
+
+			if(frame.target)
+			{
+				*frame.target = value;
+				return;
+			}
+
+			Nbt tag;
+			tag.type = frame.type;
+			tag.name = frame.name;
+			tag.value = value;
+			pendingTags.push_back(tag);
+		};
+
+		if(auto status = beginValue(root.type, root.name, &root.value); status != DeserializeStatus::OK)
+			return status;
+
+		while(!frames.empty())
+		{
+			auto& frame = frames.back();
+
+			if(frame.type == NbtType::COMPOUND)
+			{
+				UInt8 type;
+				if(auto status = deserializeInt(&bufp, &size, &type); status != DeserializeStatus::OK)
+					return status;
+
+				if(type == 0)
+				{
+					auto count = pendingTags.size() - frame.firstTag;
+					auto tags = (Nbt*)arena.allocate(count * sizeof(Nbt), alignof(Nbt));
+					std::uninitialized_copy(pendingTags.begin() + frame.firstTag, pendingTags.end(), tags);
+					pendingTags.resize(frame.firstTag);
+
+					NbtValue value;
+					value.compound = {tags, count};
+					endValue(value);
+					continue;
+				}
+
+				if(!isValidNbtType(type))
+					return DeserializeStatus::ERROR_DATA_INVALID;
+
+				Span<Char8 const> name;
+				if(auto status = deserializeNbtString(&bufp, &size, &name, arena); status != DeserializeStatus::OK)
+					return status;
+
+				if(auto status = beginValue((NbtType)type, name, nullptr); status != DeserializeStatus::OK)
+					return status;
+			}
+			else
+			{
+				if(frame.nextElement == frame.elements.size())
+				{
+					NbtValue value;
+					value.list.type = frame.elementType;
+					value.list.values = frame.elements;
+					endValue(value);
+					continue;
+				}
+
+				auto target = &frame.elements[frame.nextElement++];
+
+				if(auto status = beginValue(frame.elementType, {}, target); status != DeserializeStatus::OK)
+					return status;
+			}
+		}
+
+		*bufpp = bufp;
+		*sizep = size;
+		*out = root;
+		return DeserializeStatus::OK;
 	}
 }
@@ -1,9 +1,14 @@
 #pragma once
 
+#include <cstring>
+
+#include <common/arena.hpp>
 #include <common/buffer.hpp>
 #include <common/span.hpp>
 #include <common/types.hpp>
+#include <common/utf8.hpp>
 #include <proxyd/deserialize.hpp>
+#include <proxyd/serialize.hpp>
 
 namespace vitamine::proxyd
 {
@@ -56,6 +61,234 @@ namespace vitamine::proxyd
 		{}
 	};
 
-	void serializeNbt(Buffer& buffer, Nbt const& tag);
-	DeserializeStatus deserializeNbt(UInt8 const** bufpp, UInt* sizep, Nbt* out);
+	// instantiated for Buffer, SegmentedBuffer and UncheckedWriter
+	template <typename OutputBuffer>
+	void serializeNbt(OutputBuffer& buffer, Nbt const& tag);
+	UInt serializedSizeNbt(Nbt const& tag);
+
+	// byte arrays and strings that need no conversion from modified utf-8 point into the input, everything else is allocated from the arena
+	DeserializeStatus deserializeNbt(UInt8 const** bufpp, UInt* sizep, Nbt* out, Arena& arena);
+
+	// nbt strings are modified utf-8 on the wire and utf-8 in Nbt values, strings without U+0000 or supplementary characters are written as they are
+	template <typename OutputBuffer>
+	void serializeNbtString(OutputBuffer& buffer, Span<Char8 const> str)
+	{
+		auto size = modifiedUtf8Size(str);
+		serializeInt(buffer, (UInt16)size);
+
+		if(size == str.size())
+		{
+			buffer.write(str.data(), str.size());
+			return;
+		}
+
+		auto& arena = threadArena();
+		ArenaScope scope(arena);
+
+		auto converted = (Char8*)arena.allocate(size, 1);
+		utf8ToModifiedUtf8(str, converted);
+		buffer.write(converted, size);
+	}
+
+	// writes nbt straight into the output buffer, without building a tree of Nbt values first
+	// the type of a field follows the C++ type of its value, e.g. an Int16 is written as a short
+	// names may be string literals, their length is known at compile time and the whole tag header is a single write
+	// literal names are written without conversion to modified utf-8, so they must not contain U+0000 or supplementary characters
+	// list elements have no tag header and are written with the element functions, which mirror the named ones
+	// a list has no end marker, the caller writes exactly 'count' elements of the type given to beginList
+	template <typename OutputBuffer>
+	class NbtWriter
+	{
+		OutputBuffer& _buffer;
+
+		template <UInt size>
+		void writeHeader(NbtType type, Char8 const(& name)[size])
+		{
+			constexpr UInt length = size - 1;
+			static_assert(length <= 0xffff, "nbt names are limited to 65535 bytes");
+
+			UInt8 header[3 + length];
+			header[0] = (UInt8)type;
+			header[1] = (UInt8)(length >> 8);
+			header[2] = (UInt8)length;
+			std::memcpy(header + 3, name, length);
+			_buffer.write(header, sizeof header);
+		}
+
+		void writeHeader(NbtType type, Span<Char8 const> name)
+		{
+			serializeInt(_buffer, (UInt8)type);
+			serializeNbtString(_buffer, name);
+		}
+
+		void writeListHeader(NbtType elementType, Int32 count)
+		{
+			UInt8 header[5];
+			header[0] = (UInt8)elementType;
+			storeBigEndian(header + 1, count);
+			_buffer.write(header, sizeof header);
+		}
+
+		template <typename T>
+		void writeArray(Span<T const> values)
+		{
+			serializeInt(_buffer, (Int32)values.size());
+			serializeIntArray(_buffer, values);
+		}
+
+	public:
+		explicit NbtWriter(OutputBuffer& buffer)
+		: _buffer(buffer)
+		{}
+
+		// the root of a document is a compound as well, usually with an empty name
+		template <typename Name>
+		void beginCompound(Name const& name)
+		{
+			writeHeader(NbtType::COMPOUND, name);
+		}
+
+		// also ends compound elements of a list, which have no header and start with their first field
+		void endCompound()
+		{
+			serializeInt(_buffer, (UInt8)0);
+		}
+
+		// empty lists may use any element type
+		template <typename Name>
+		void beginList(Name const& name, NbtType elementType, Int32 count)
+		{
+			writeHeader(NbtType::LIST, name);
+			writeListHeader(elementType, count);
+		}
+
+		// an element of a list of lists
+		void beginListElement(NbtType elementType, Int32 count)
+		{
+			writeListHeader(elementType, count);
+		}
+
+		template <typename Name>
+		void field(Name const& name, Int8 value)
+		{
+			writeHeader(NbtType::BYTE, name);
+			serializeInt(_buffer, value);
+		}
+
+		template <typename Name>
+		void field(Name const& name, Int16 value)
+		{
+			writeHeader(NbtType::SHORT, name);
+			serializeInt(_buffer, value);
+		}
+
+		template <typename Name>
+		void field(Name const& name, Int32 value)
+		{
+			writeHeader(NbtType::INT, name);
+			serializeInt(_buffer, value);
+		}
+
+		template <typename Name>
+		void field(Name const& name, Int64 value)
+		{
+			writeHeader(NbtType::LONG, name);
+			serializeInt(_buffer, value);
+		}
+
+		template <typename Name>
+		void field(Name const& name, Float32 value)
+		{
+			writeHeader(NbtType::FLOAT, name);
+			serializeFloat(_buffer, value);
+		}
+
+		template <typename Name>
+		void field(Name const& name, Float64 value)
+		{
+			writeHeader(NbtType::DOUBLE, name);
+			serializeFloat(_buffer, value);
+		}
+
+		template <typename Name>
+		void field(Name const& name, Span<Char8 const> value)
+		{
+			writeHeader(NbtType::STRING, name);
+			serializeNbtString(_buffer, value);
+		}
+
+		template <typename Name>
+		void array(Name const& name, Span<Int8 const> values)
+		{
+			writeHeader(NbtType::BYTE_ARRAY, name);
+			serializeInt(_buffer, (Int32)values.size());
+			_buffer.write(values.data(), values.size());
+		}
+
+		template <typename Name>
+		void array(Name const& name, Span<Int32 const> values)
+		{
+			writeHeader(NbtType::INT_ARRAY, name);
+			writeArray(values);
+		}
+
+		template <typename Name>
+		void array(Name const& name, Span<Int64 const> values)
+		{
+			writeHeader(NbtType::LONG_ARRAY, name);
+			writeArray(values);
+		}
+
+		// the type of an element has to match the element type given to beginList
+		void element(Int8 value)
+		{
+			serializeInt(_buffer, value);
+		}
+
+		void element(Int16 value)
+		{
+			serializeInt(_buffer, value);
+		}
+
+		void element(Int32 value)
+		{
+			serializeInt(_buffer, value);
+		}
+
+		void element(Int64 value)
+		{
+			serializeInt(_buffer, value);
+		}
+
+		void element(Float32 value)
+		{
+			serializeFloat(_buffer, value);
+		}
+
+		void element(Float64 value)
+		{
+			serializeFloat(_buffer, value);
+		}
+
+		void element(Span<Char8 const> value)
+		{
+			serializeNbtString(_buffer, value);
+		}
+
+		void arrayElement(Span<Int8 const> values)
+		{
+			serializeInt(_buffer, (Int32)values.size());
+			_buffer.write(values.data(), values.size());
+		}
+
+		void arrayElement(Span<Int32 const> values)
+		{
+			writeArray(values);
+		}
+
+		void arrayElement(Span<Int64 const> values)
+		{
+			writeArray(values);
+		}
+	};
 }
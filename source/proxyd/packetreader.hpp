@@ -1,7 +1,7 @@
 #pragma once
 
-#include <functional>
-#include <utility>
+#include <algorithm>
+#include <cassert>
 
 #include <common/buffer.hpp>
 #include <common/span.hpp>
@@ -10,40 +10,100 @@
 
 namespace vitamine::proxyd
 {
+	// the handler is called statically, so framing and dispatch compile into the handler's receive loop
+	// Handler needs onPacket(PacketFrame) and onInvalidFrame() accessible to the reader
+	template <typename Handler, typename Limits = ServerboundFrameLimits>
 	class PacketReader
 	{
-		Buffer _readBuffer;
-		std::function<void(PacketFrame)> _onPacket;
-		std::function<void()> _onError;
+		// partial frame left over from the previous read
+		Buffer _pending;
+		Handler* _handler;
+		bool _compressed = false;
+
+		DeserializeStatus deserializeFrame(UInt8 const** bufpp, UInt* sizep, PacketFrame* out)
+		{
+			if(_compressed)
+				return deserializeCompressedPacketFrame<Limits>(bufpp, sizep, out);
+
+			return deserializePacketFrame<Limits>(bufpp, sizep, out);
+		}
+
+		// completes the pending frame with data from the front of the new read
+		// returns false if no further frames should be parsed from the read
+		bool completePendingFrame(UInt8 const** bufpp, UInt* sizep)
+		{
+			// a frame never exceeds the maximum total length, so this is always enough to complete it
+			auto oldSize = _pending.size();
+			auto count = std::min(*sizep, Limits::MAX_TOTAL_LENGTH);
+			_pending.write(*bufpp, count);
+
+			auto bufp = (UInt8 const*)_pending.data();
+			auto size = _pending.size();
+
+			PacketFrame frame;
+
+			switch(deserializeFrame(&bufp, &size, &frame))
+			{
+			case DeserializeStatus::OK:
+			{
+				auto consumed = _pending.size() - size - oldSize;
+				_handler->onPacket(frame);
+				_pending.clear();
+
+				*bufpp += consumed;
+				*sizep -= consumed;
+				return true;
+			}
+
+			case DeserializeStatus::ERROR_DATA_INCOMPLETE:
+				assert(count == *sizep);
+				return false;
+
+			case DeserializeStatus::ERROR_DATA_INVALID:
+				_handler->onInvalidFrame();
+				return false;
+			}
+
+			return false;
+		}
 
 	public:
-		PacketReader(std::function<void(PacketFrame)> onPacket, std::function<void()> onError)
-		: _onPacket(std::move(onPacket)), _onError(std::move(onError))
+		explicit PacketReader(Handler* handler)
+		: _handler(handler)
 		{}
 
+		// takes effect with the next frame, which may already be part of the current read
+		void enableCompression()
+		{
+			_compressed = true;
+		}
+
+		// frames that are completely contained in the read are parsed in place without copying
+		// only a frame split across reads is copied
 		void onBytesReceived(Span<UInt8 const> data)
 		{
-			_readBuffer.write(data.data(), data.size());
+			auto bufp = data.data();
+			auto size = data.size();
 
-			auto bufp = (UInt8 const*)_readBuffer.data();
-			UInt size = data.size();
+			if(_pending.size() != 0 && !completePendingFrame(&bufp, &size))
+				return;
 
 			PacketFrame frame;
 
 			for(;;)
 			{
-				switch(deserializePacketFrame(&bufp, &size, &frame))
+				switch(deserializeFrame(&bufp, &size, &frame))
 				{
 				case DeserializeStatus::OK:
-					_onPacket(frame);
+					_handler->onPacket(frame);
 					break;
 
 				case DeserializeStatus::ERROR_DATA_INCOMPLETE:
-					_readBuffer.discard(_readBuffer.size() - size);
+					_pending.write(bufp, size);
 					return;
 
 				case DeserializeStatus::ERROR_DATA_INVALID:
-					_onError();
+					_handler->onInvalidFrame();
 					return;
 				}
 			}
@@ -1,11 +1,14 @@
 #pragma once
 
+#include <array>
+#include <initializer_list>
 #include <utility>
 #include <variant>
 
-#include <boost/container/small_vector.hpp>
 #include <boost/uuid/uuid.hpp>
 
+#include <common/arena.hpp>
+#include <common/segmentedbuffer.hpp>
 #include <proxyd/deserialize.hpp>
 #include <proxyd/entitymetadata.hpp>
 #include <proxyd/nbt.hpp>
@@ -13,6 +16,10 @@
 
 namespace vitamine::proxyd
 {
+	// the protocol described by packets.def
+	// https://wiki.vg/index.php?title=Protocol&oldid=15289
+	constexpr Int32 PROTOCOL_VERSION = 498;
+
 	using PacketId = Int32;
 
 #define PACKET_BEGIN(name, id) \
@@ -28,22 +35,306 @@ namespace vitamine::proxyd
 #define PACKET_FIELD_STRING(name)             Span<Char8 const> name;
 #define PACKET_FIELD_IMPLICIT_TAILBYTES(name) Span<UInt8 const> name;
 #define PACKET_FIELD_NBT(name)                Nbt name;
+#define PACKET_FIELD_ENCODED_NBT(name)        Span<UInt8 const> name;
 #define PACKET_FIELD_UUID(name)               boost::uuids::uuid name;
 #define PACKET_FIELD_VARBYTES(name)           Span<UInt8 const> name;
-#define PACKET_FIELD_ENTITY_METADATA(name)    std::vector<EntityMetadata> name;
-#define PACKET_FIELD_ARRAY(name, ...)         struct name##_fields { __VA_ARGS__ }; boost::container::small_vector<name##_fields, 4 * sizeof(name##_fields)> name;
+#define PACKET_FIELD_SEGMENTED_VARBYTES(name) SegmentedBuffer name;
+#define PACKET_FIELD_ENTITY_METADATA(name)    Span<EntityMetadata const> name = {};
+#define PACKET_FIELD_VARINT_ARRAY(name)       Span<Int32 const> name = {};
+#define PACKET_FIELD_ARRAY(name, ...)         struct name##_fields { __VA_ARGS__ }; Span<name##_fields const> name = {};
 
 #define PACKET_END() \
 	};
 
+#include <proxyd/packets.def>
+
+	namespace detail
+	{
+		// marks a varint in a list of field sizes
+		constexpr Int VARINT_FIELD_SIZE = -2;
+
+		// negative field sizes mark fields whose size depends on the value
+		constexpr Int sumFixedFieldSizes(std::initializer_list<Int> sizes)
+		{
+			Int sum = 0;
+
+			for(auto size : sizes)
+			{
+				if(size < 0)
+					return -1;
+
+				sum += size;
+			}
+
+			return sum;
+		}
+	}
+
+	// sizes of the fields before and after the only varint of a packet whose other fields are all of fixed size
+	struct VarIntLayout
+	{
+		bool valid;
+		Int head;
+		Int tail;
+	};
+
+	namespace detail
+	{
+		constexpr VarIntLayout varIntLayout(std::initializer_list<Int> sizes)
+		{
+			VarIntLayout layout = {false, 0, 0};
+
+			for(auto size : sizes)
+			{
+				if(size == VARINT_FIELD_SIZE)
+				{
+					if(layout.valid)
+						return {false, 0, 0};
+
+					layout.valid = true;
+				}
+				else if(size < 0)
+					return {false, 0, 0};
+				else if(layout.valid)
+					layout.tail += size;
+				else
+					layout.head += size;
+			}
+
+			return layout;
+		}
+	}
+
+	// size of the payload if it is the same for every instance of the packet, -1 otherwise
+	template <typename Packet>
+	constexpr Int packetFixedSize()
+	{
+		return -1;
+	}
+
+#define PACKET_BEGIN(name, id) \
+	template <> \
+	constexpr Int packetFixedSize<Packet##name>() \
+	{ \
+		return detail::sumFixedFieldSizes({
+
+#define PACKET_FIELD_BOOL(name)               1,
+#define PACKET_FIELD_INT(name, bits)          bits / 8,
+#define PACKET_FIELD_UINT(name, bits)         bits / 8,
+#define PACKET_FIELD_FLOAT(name, bits)        bits / 8,
+#define PACKET_FIELD_VARINT(name, bits)       -1,
+#define PACKET_FIELD_STRING(name)             -1,
+#define PACKET_FIELD_IMPLICIT_TAILBYTES(name) -1,
+#define PACKET_FIELD_NBT(name)                -1,
+#define PACKET_FIELD_ENCODED_NBT(name)        -1,
+#define PACKET_FIELD_UUID(name)               16,
+#define PACKET_FIELD_VARBYTES(name)           -1,
+#define PACKET_FIELD_SEGMENTED_VARBYTES(name) -1,
+#define PACKET_FIELD_ENTITY_METADATA(name)    -1,
+#define PACKET_FIELD_VARINT_ARRAY(name)       -1,
+#define PACKET_FIELD_ARRAY(name, ...)         -1,
+
+#define PACKET_END() \
+		0}); \
+	}
+
+#include <proxyd/packets.def>
+
+	// entity packets are a varint entity id followed by fixed size fields, block changes a fixed size position followed by a varint
+	// those are decoded with a bounds check before and after the varint, and encoded with a single write
+	template <typename Packet>
+	constexpr VarIntLayout packetVarIntLayout()
+	{
+		return {false, 0, 0};
+	}
+
+#define PACKET_BEGIN(name, id) \
+	template <> \
+	constexpr VarIntLayout packetVarIntLayout<Packet##name>() \
+	{ \
+		return detail::varIntLayout({
+
+#define PACKET_FIELD_BOOL(name)               1,
+#define PACKET_FIELD_INT(name, bits)          bits / 8,
+#define PACKET_FIELD_UINT(name, bits)         bits / 8,
+#define PACKET_FIELD_FLOAT(name, bits)        bits / 8,
+#define PACKET_FIELD_VARINT(name, bits)       detail::VARINT_FIELD_SIZE,
+#define PACKET_FIELD_STRING(name)             -1,
+#define PACKET_FIELD_IMPLICIT_TAILBYTES(name) -1,
+#define PACKET_FIELD_NBT(name)                -1,
+#define PACKET_FIELD_ENCODED_NBT(name)        -1,
+#define PACKET_FIELD_UUID(name)               16,
+#define PACKET_FIELD_VARBYTES(name)           -1,
+#define PACKET_FIELD_SEGMENTED_VARBYTES(name) -1,
+#define PACKET_FIELD_ENTITY_METADATA(name)    -1,
+#define PACKET_FIELD_VARINT_ARRAY(name)       -1,
+#define PACKET_FIELD_ARRAY(name, ...)         -1,
+
+#define PACKET_END() \
+		0}); \
+	}
+
+#include <proxyd/packets.def>
+
+
+	// packets of fixed size are decoded with a single bounds check and encoded with a single write
+	// the fields are read and written at constant offsets, adjacent byteswaps can be vectorized by the compiler
+	// the functions are generated for every packet, but skip variable size fields and must only be used on fixed size ones
+
+#define PACKET_BEGIN(name, id) \
+	inline \
+	bool decodeFixedLayout(UInt8 const* data, Packet##name* out) \
+	{ \
+		(void)data; \
+		(void)out; \
+		bool valid = true;
+
+#define PACKET_FIELD_BOOL(name)               valid &= *data <= 1; out->name = *data; data += 1;
+#define PACKET_FIELD_INT(name, bits)          out->name = loadBigEndian<Int##bits>(data); data += bits / 8;
+#define PACKET_FIELD_UINT(name, bits)         out->name = loadBigEndian<UInt##bits>(data); data += bits / 8;
+#define PACKET_FIELD_FLOAT(name, bits)        out->name = loadBigEndianFloat<Float##bits>(data); data += bits / 8;
+#define PACKET_FIELD_VARINT(name, bits)
+#define PACKET_FIELD_STRING(name)
+#define PACKET_FIELD_IMPLICIT_TAILBYTES(name)
+#define PACKET_FIELD_NBT(name)
+#define PACKET_FIELD_ENCODED_NBT(name)
+#define PACKET_FIELD_UUID(name)               out->name = loadUuid(data); data += 16;
+#define PACKET_FIELD_VARBYTES(name)
+#define PACKET_FIELD_SEGMENTED_VARBYTES(name)
+#define PACKET_FIELD_ENTITY_METADATA(name)
+#define PACKET_FIELD_VARINT_ARRAY(name)
+#define PACKET_FIELD_ARRAY(name, ...)
+
+#define PACKET_END() \
+		return valid; \
+	}
+
 #include <proxyd/packets.def>
 
 #define PACKET_BEGIN(name, id) \
 	inline \
-	bool deserializePacketPayload(Span<UInt8 const> buffer, Packet##name* out) \
+	void encodeFixedLayout(UInt8* data, Packet##name const& packet) \
 	{ \
+		(void)data; \
+		(void)packet;
+
+#define PACKET_FIELD_BOOL(name)               *data = packet.name; data += 1;
+#define PACKET_FIELD_INT(name, bits)          storeBigEndian(data, packet.name); data += bits / 8;
+#define PACKET_FIELD_UINT(name, bits)         storeBigEndian(data, packet.name); data += bits / 8;
+#define PACKET_FIELD_FLOAT(name, bits)        storeBigEndianFloat(data, packet.name); data += bits / 8;
+#define PACKET_FIELD_VARINT(name, bits)
+#define PACKET_FIELD_STRING(name)
+#define PACKET_FIELD_IMPLICIT_TAILBYTES(name)
+#define PACKET_FIELD_NBT(name)
+#define PACKET_FIELD_ENCODED_NBT(name)
+#define PACKET_FIELD_UUID(name)               storeUuid(data, packet.name); data += 16;
+#define PACKET_FIELD_VARBYTES(name)
+#define PACKET_FIELD_SEGMENTED_VARBYTES(name)
+#define PACKET_FIELD_ENTITY_METADATA(name)
+#define PACKET_FIELD_VARINT_ARRAY(name)
+#define PACKET_FIELD_ARRAY(name, ...)
+
+#define PACKET_END() \
+	}
+
+#include <proxyd/packets.def>
+
+	template <typename OutputBuffer, typename Packet>
+	void serializeFixedLayout(OutputBuffer& buffer, Packet const& packet)
+	{
+		static_assert(packetFixedSize<Packet>() >= 0);
+
+		std::array<UInt8, packetFixedSize<Packet>()> data;
+		encodeFixedLayout(data.data(), packet);
+		buffer.write(data.data(), data.size());
+	}
+
+	// like the fixed layout functions, but for packets with a varint layout
+	// the fields before the varint are read at constant offsets from the start, the ones after it from the end of the varint
+
+#define PACKET_BEGIN(name, id) \
+	inline \
+	bool decodeVarIntLayout(Span<UInt8 const> buffer, Packet##name* out) \
+	{ \
+		constexpr auto layout = packetVarIntLayout<Packet##name>(); \
+		auto data = buffer.data(); \
+		auto size = buffer.size(); \
+		(void)data; \
+		(void)out; \
+		bool valid = true; \
+		if(size < (UInt)layout.head) \
+			return false;
+
+#define PACKET_FIELD_BOOL(name)               valid &= *data <= 1; out->name = *data; data += 1;
+#define PACKET_FIELD_INT(name, bits)          out->name = loadBigEndian<Int##bits>(data); data += bits / 8;
+#define PACKET_FIELD_UINT(name, bits)         out->name = loadBigEndian<UInt##bits>(data); data += bits / 8;
+#define PACKET_FIELD_FLOAT(name, bits)        out->name = loadBigEndianFloat<Float##bits>(data); data += bits / 8;
+#define PACKET_FIELD_VARINT(name, bits)       size -= layout.head; \
+                                              if(deserializeVarInt(&data, &size, &out->name) != DeserializeStatus::OK || size != (UInt)layout.tail) \
+                                                  return false;
+#define PACKET_FIELD_STRING(name)
+#define PACKET_FIELD_IMPLICIT_TAILBYTES(name)
+#define PACKET_FIELD_NBT(name)
+#define PACKET_FIELD_ENCODED_NBT(name)
+#define PACKET_FIELD_UUID(name)               out->name = loadUuid(data); data += 16;
+#define PACKET_FIELD_VARBYTES(name)
+#define PACKET_FIELD_SEGMENTED_VARBYTES(name)
+#define PACKET_FIELD_ENTITY_METADATA(name)
+#define PACKET_FIELD_VARINT_ARRAY(name)
+#define PACKET_FIELD_ARRAY(name, ...)
+
+#define PACKET_END() \
+		return valid; \
+	}
+
+#include <proxyd/packets.def>
+
+#define PACKET_BEGIN(name, id) \
+	template <typename OutputBuffer> \
+	void serializeVarIntLayout(OutputBuffer& buffer, Packet##name const& packet) \
+	{ \
+		constexpr auto layout = packetVarIntLayout<Packet##name>(); \
+		std::array<UInt8, layout.head + detail::VARINT32_MAX_ENCODED_SIZE + layout.tail> storage; \
+		auto data = storage.data(); \
+		(void)packet;
+
+#define PACKET_FIELD_BOOL(name)               *data = packet.name; data += 1;
+#define PACKET_FIELD_INT(name, bits)          storeBigEndian(data, packet.name); data += bits / 8;
+#define PACKET_FIELD_UINT(name, bits)         storeBigEndian(data, packet.name); data += bits / 8;
+#define PACKET_FIELD_FLOAT(name, bits)        storeBigEndianFloat(data, packet.name); data += bits / 8;
+#define PACKET_FIELD_VARINT(name, bits)       data += detail::encodeVarInt32(data, packet.name);
+#define PACKET_FIELD_STRING(name)
+#define PACKET_FIELD_IMPLICIT_TAILBYTES(name)
+#define PACKET_FIELD_NBT(name)
+#define PACKET_FIELD_ENCODED_NBT(name)
+#define PACKET_FIELD_UUID(name)               storeUuid(data, packet.name); data += 16;
+#define PACKET_FIELD_VARBYTES(name)
+#define PACKET_FIELD_SEGMENTED_VARBYTES(name)
+#define PACKET_FIELD_ENTITY_METADATA(name)
+#define PACKET_FIELD_VARINT_ARRAY(name)
+#define PACKET_FIELD_ARRAY(name, ...)
+
+#define PACKET_END() \
+		buffer.write(storage.data(), data - storage.data()); \
+	}
+
+#include <proxyd/packets.def>
+
+#define PACKET_BEGIN(name, id) \
+	inline \
+	bool deserializePacketPayload(Span<UInt8 const> buffer, Packet##name* out, Arena& arena) \
+	{ \
+		(void)arena; \
 		using Packet = Packet##name; \
 		(void)Packet{}; \
+		if constexpr(packetFixedSize<Packet>() >= 0) \
+		{ \
+			if(buffer.size() != (UInt)packetFixedSize<Packet>()) \
+				return false; \
+			return decodeFixedLayout(buffer.data(), out); \
+		} \
+		if constexpr(packetVarIntLayout<Packet>().valid) \
+			return decodeVarIntLayout(buffer, out); \
 		auto bufp = buffer.data(); \
 		auto size = buffer.size();
 
@@ -58,9 +349,24 @@ namespace vitamine::proxyd
 #define PACKET_FIELD_VARINT(name, bits)       CHECK_DESERIALIZE(deserializeVarInt(&bufp, &size, &out->name))
 #define PACKET_FIELD_STRING(name)             CHECK_DESERIALIZE(deserializeString(&bufp, &size, &out->name))
 #define PACKET_FIELD_IMPLICIT_TAILBYTES(name) CHECK_DESERIALIZE(deserializeImplicitTailBytes(&bufp, &size, &out->name))
-#define PACKET_FIELD_NBT(name)                CHECK_DESERIALIZE(deserializeNbt(&bufp, &size, &out->name))
+#define PACKET_FIELD_NBT(name)                CHECK_DESERIALIZE(deserializeNbt(&bufp, &size, &out->name, arena))
 #define PACKET_FIELD_UUID(name)               CHECK_DESERIALIZE(deserializeUuid(&bufp, &size, &out->name))
-#define PACKET_FIELD_ENTITY_METADATA(name)    CHECK_DESERIALIZE(deserializeEntityMetadata(&bufp, &size, &out->name))
+#define PACKET_FIELD_ENTITY_METADATA(name)    CHECK_DESERIALIZE(deserializeEntityMetadata(&bufp, &size, &out->name, arena))
+
+// the elements are decoded in blocks rather than one varint at a time
+#define PACKET_FIELD_VARINT_ARRAY(name) Int32 name##length; \
+                                        CHECK_DESERIALIZE(deserializeVarInt(&bufp, &size, &name##length)) \
+                                        if(name##length < 0 || (UInt)name##length > size) \
+                                            return false; \
+                                        auto name##elements = arena.allocateArray<Int32>(name##length); \
+                                        CHECK_DESERIALIZE(deserializeVarIntBatch(&bufp, &size, name##elements.data(), name##length)) \
+                                        out->name = name##elements;
+
+// validated by decoding it into the arena, the field refers to the encoded bytes
+#define PACKET_FIELD_ENCODED_NBT(name) auto name##begin = bufp; \
+                                       Nbt name##nbt; \
+                                       CHECK_DESERIALIZE(deserializeNbt(&bufp, &size, &name##nbt, arena)) \
+                                       out->name = Span(name##begin, (UInt)(bufp - name##begin));
 
 #define PACKET_FIELD_VARBYTES(name) Int32 name##length; \
                                     CHECK_DESERIALIZE(deserializeVarInt(&bufp, &size, &name##length)) \
@@ -68,17 +374,24 @@ namespace vitamine::proxyd
                                     CHECK_DESERIALIZE(deserializeBytes(&bufp, &size, name##length, &name##ptr)) \
                                     out->name = Span(name##ptr, name##length);
 
+#define PACKET_FIELD_SEGMENTED_VARBYTES(name) Int32 name##length; \
+                                              CHECK_DESERIALIZE(deserializeVarInt(&bufp, &size, &name##length)) \
+                                              UInt8 const* name##ptr; \
+                                              CHECK_DESERIALIZE(deserializeBytes(&bufp, &size, name##length, &name##ptr)) \
+                                              out->name.write(name##ptr, name##length);
+
 #define PACKET_FIELD_ARRAY(name, ...) Int32 name##length; \
                                       CHECK_DESERIALIZE(deserializeVarInt(&bufp, &size, &name##length)) \
-                                      while(name##length--) \
+                                      /* every element takes at least one byte, this bounds the allocation by the payload size */ \
+                                      if(name##length < 0 || (UInt)name##length > size) \
+                                          return false; \
+                                      auto name##elements = arena.allocateArray<Packet::name##_fields>(name##length); \
+                                      for(auto& fields : name##elements) \
                                       { \
-	                                      Packet::name##_fields fields; \
-	                                      { \
-		                                      auto* out = &fields; \
-		                                      __VA_ARGS__ \
-	                                      } \
-	                                      out->name.push_back(std::move(fields)); \
-                                      }
+	                                      auto* out = &fields; \
+	                                      __VA_ARGS__ \
+                                      } \
+                                      out->name = name##elements;
 
 #define PACKET_END() \
 		return size == 0; \
@@ -88,9 +401,19 @@ namespace vitamine::proxyd
 #undef CHECK_DESERIALIZE
 
 #define PACKET_BEGIN(name, id) \
-	inline \
-	void serializePacketPayload(Buffer& buffer, Packet##name const& packet) \
-	{
+	template <typename OutputBuffer> \
+	void serializePacketPayload(OutputBuffer& buffer, Packet##name const& packet) \
+	{ \
+		if constexpr(packetFixedSize<Packet##name>() >= 0) \
+		{ \
+			serializeFixedLayout(buffer, packet); \
+			return; \
+		} \
+		if constexpr(packetVarIntLayout<Packet##name>().valid) \
+		{ \
+			serializeVarIntLayout(buffer, packet); \
+			return; \
+		}
 
 #define PACKET_FIELD_BOOL(name)               serializeBool(buffer, packet.name);
 #define PACKET_FIELD_INT(name, bits)          serializeInt(buffer, packet.name);
@@ -100,11 +423,16 @@ namespace vitamine::proxyd
 #define PACKET_FIELD_STRING(name)             serializeString(buffer, packet.name);
 #define PACKET_FIELD_IMPLICIT_TAILBYTES(name) serializeBytes(buffer, packet.name);
 #define PACKET_FIELD_NBT(name)                serializeNbt(buffer, packet.name);
+#define PACKET_FIELD_ENCODED_NBT(name)        serializeBytes(buffer, packet.name);
 #define PACKET_FIELD_UUID(name)               serializeUuid(buffer, packet.name);
 #define PACKET_FIELD_VARBYTES(name)           serializeVarInt(buffer, (Int32)packet.name.size()); \
                                               serializeBytes(buffer, packet.name);
+#define PACKET_FIELD_SEGMENTED_VARBYTES(name) serializeVarInt(buffer, (Int32)packet.name.size()); \
+                                              serializeSegments(buffer, packet.name);
 
 #define PACKET_FIELD_ENTITY_METADATA(name) serializeEntityMetadata(buffer, packet.name);
+#define PACKET_FIELD_VARINT_ARRAY(name)    serializeVarInt(buffer, (Int32)packet.name.size()); \
+                                           serializeVarIntArray(buffer, packet.name);
 
 #define PACKET_FIELD_ARRAY(name, ...) serializeVarInt(buffer, (Int32)packet.name.size()); \
                                       for(auto& packet : packet.name) \
@@ -113,6 +441,42 @@ namespace vitamine::proxyd
 #define PACKET_END() \
 	}
 
+#include <proxyd/packets.def>
+
+	// exact number of bytes serializePacketPayload writes
+#define PACKET_BEGIN(name, id) \
+	inline \
+	UInt serializedSize(Packet##name const& packet) \
+	{ \
+		if constexpr(packetFixedSize<Packet##name>() >= 0) \
+			return packetFixedSize<Packet##name>(); \
+		UInt size = 0;
+
+#define PACKET_FIELD_BOOL(name)               size += sizeof packet.name;
+#define PACKET_FIELD_INT(name, bits)          size += sizeof packet.name;
+#define PACKET_FIELD_UINT(name, bits)         size += sizeof packet.name;
+#define PACKET_FIELD_FLOAT(name, bits)        size += sizeof packet.name;
+#define PACKET_FIELD_VARINT(name, bits)       size += serializedSizeVarInt(packet.name);
+#define PACKET_FIELD_STRING(name)             size += serializedSizeString(packet.name);
+#define PACKET_FIELD_IMPLICIT_TAILBYTES(name) size += packet.name.size();
+#define PACKET_FIELD_NBT(name)                size += serializedSizeNbt(packet.name);
+#define PACKET_FIELD_ENCODED_NBT(name)        size += packet.name.size();
+#define PACKET_FIELD_UUID(name)               size += sizeof packet.name;
+#define PACKET_FIELD_VARBYTES(name)           size += serializedSizeVarInt((Int32)packet.name.size()) + packet.name.size();
+#define PACKET_FIELD_SEGMENTED_VARBYTES(name) size += serializedSizeVarInt((Int32)packet.name.size()) + packet.name.size();
+#define PACKET_FIELD_ENTITY_METADATA(name)    size += serializedSizeEntityMetadata(packet.name);
+#define PACKET_FIELD_VARINT_ARRAY(name)       size += serializedSizeVarInt((Int32)packet.name.size()) + serializedSizeVarIntArray(packet.name);
+
+#define PACKET_FIELD_ARRAY(name, ...) size += serializedSizeVarInt((Int32)packet.name.size()); \
+                                      for(auto& packet : packet.name) \
+                                      { \
+	                                      __VA_ARGS__ \
+                                      }
+
+#define PACKET_END() \
+		return size; \
+	}
+
 #include <proxyd/packets.def>
 
 	struct PacketPlayerInfo
@@ -132,18 +496,18 @@ namespace vitamine::proxyd
 		{
 			struct Property
 			{
-				std::string name;
-				std::string value;
+				Span<Char8 const> name;
+				Span<Char8 const> value;
 				bool isSigned;
-				std::string signature;
+				Span<Char8 const> signature;
 			};
 
-			std::string name;
-			std::vector<Property> properties;
+			Span<Char8 const> name;
+			Span<Property const> properties;
 			Int32 gameMode;
 			Int32 ping;
 			bool hasDisplayName;
-			std::string displayName;
+			Span<Char8 const> displayName;
 		};
 
 		struct UpdateGameMode
@@ -159,7 +523,7 @@ namespace vitamine::proxyd
 		struct UpdateDisplayName
 		{
 			bool hasDisplayName;
-			std::string displayName;
+			Span<Char8 const> displayName;
 		};
 
 		struct RemovePlayer
@@ -173,11 +537,11 @@ namespace vitamine::proxyd
 		};
 
 		Action action;
-		std::vector<Entry> entries;
+		Span<Entry const> entries = {};
 	};
 
-	inline
-	void serializePacketPayload(Buffer& buffer, PacketPlayerInfo const& packet)
+	template <typename OutputBuffer>
+	void serializePacketPayload(OutputBuffer& buffer, PacketPlayerInfo const& packet)
 	{
 		serializeVarInt(buffer, (Int32)packet.action);
 		serializeVarInt(buffer, (Int32)packet.entries.size());
@@ -241,4 +605,68 @@ namespace vitamine::proxyd
 			}
 		}
 	}
+
+	inline
+	UInt serializedSize(PacketPlayerInfo const& packet)
+	{
+		UInt size = serializedSizeVarInt((Int32)packet.action) + serializedSizeVarInt((Int32)packet.entries.size());
+
+		for(auto& entry : packet.entries)
+		{
+			size += sizeof entry.uuid;
+
+			switch(packet.action)
+			{
+			case PacketPlayerInfo::ADD_PLAYER:
+			{
+				auto& update = std::get<PacketPlayerInfo::AddPlayer>(entry.update);
+				size += serializedSizeString(update.name);
+				size += serializedSizeVarInt((Int32)update.properties.size());
+
+				for(auto& prop : update.properties)
+				{
+					size += serializedSizeString(prop.name);
+					size += serializedSizeString(prop.value);
+					size += sizeof prop.isSigned;
+
+					if(prop.isSigned)
+						size += serializedSizeString(prop.signature);
+				}
+
+				size += serializedSizeVarInt(update.gameMode);
+				size += serializedSizeVarInt(update.ping);
+				size += sizeof update.hasDisplayName;
+
+				if(update.hasDisplayName)
+					size += serializedSizeString(update.displayName);
+
+				break;
+			}
+
+			case PacketPlayerInfo::UPDATE_GAMEMODE:
+				size += serializedSizeVarInt(std::get<PacketPlayerInfo::UpdateGameMode>(entry.update).gameMode);
+				break;
+
+			case PacketPlayerInfo::UPDATE_LATENCY:
+				size += serializedSizeVarInt(std::get<PacketPlayerInfo::UpdateLatency>(entry.update).ping);
+				break;
+
+			case PacketPlayerInfo::UPDATE_DISPLAYNAME:
+			{
+				auto& update = std::get<PacketPlayerInfo::UpdateDisplayName>(entry.update);
+				size += sizeof update.hasDisplayName;
+
+				if(update.hasDisplayName)
+					size += serializedSizeString(update.displayName);
+
+				break;
+			}
+
+			case PacketPlayerInfo::REMOVE_PLAYER:
+				break;
+			}
+		}
+
+		return size;
+	}
 }
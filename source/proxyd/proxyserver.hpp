@@ -1,16 +1,19 @@
 #pragma once
 
+#include <algorithm>
 #include <cassert>
 #include <cstdio>
 #include <chrono>
 #include <memory>
 #include <mutex>
+#include <stdexcept>
 #include <unordered_map>
 
 #include <boost/asio/steady_timer.hpp>
 #include <boost/asio/io_service.hpp>
 #include <boost/system/system_error.hpp>
 
+#include <common/clock.hpp>
 #include <common/span.hpp>
 #include <common/types.hpp>
 #include <common/net/connectionhandler.hpp>
@@ -48,6 +51,31 @@ namespace vitamine::proxyd
 			});
 		}
 
+	public:
+		// online mode requires a session verifier
+		// without a clock, the server runs on a monotonic clock
+		explicit ProxyServer(boost::asio::io_service* service, ServerSettings const& settings = {}, ISessionVerifier* sessionVerifier = nullptr, Clock* clock = nullptr)
+		: _tickTimer(*service)
+		{
+			_globalState.serverSettings = settings;
+
+			if(clock)
+				_globalState.clock = clock;
+			setCompressionLevels(settings.compressionLevels);
+
+			if(settings.onlineMode)
+			{
+				if(!sessionVerifier)
+					throw std::invalid_argument("online mode requires a session verifier");
+
+				_globalState.keyPair = std::make_unique<ServerKeyPair>();
+				_globalState.sessionVerifier = sessionVerifier;
+			}
+
+			startTickTimer();
+		}
+
+		// called by the tick timer, replays call it directly whenever their virtual clock passes a tick
 		void tickStateMachines()
 		{
 			std::lock_guard lock(_mutex);
@@ -56,11 +84,12 @@ namespace vitamine::proxyd
 				state->onTick();
 		}
 
-	public:
-		explicit ProxyServer(boost::asio::io_service* service)
-		: _tickTimer(*service)
+		// packets dropped because the client's phase does not handle their id
+		// ids from UNHANDLED_PACKET_COUNTER_SLOTS - 1 up share a single count
+		UInt64 unhandledPackets(PacketId id) const
 		{
-			startTickTimer();
+			auto slot = std::min((UInt)id, UNHANDLED_PACKET_COUNTER_SLOTS - 1);
+			return _globalState.unhandledPackets[slot].load(std::memory_order_relaxed);
 		}
 
 		void onClientConnected(std::shared_ptr<IConnection> connection) final
@@ -1,12 +1,21 @@
 #pragma once
 
+#include <algorithm>
+#include <cstring>
 #include <string>
+#include <type_traits>
+
+#ifdef __BMI2__
+#include <immintrin.h>
+#endif
 
 #include <boost/endian/conversion.hpp>
 #include <boost/uuid/uuid.hpp>
 
 #include <common/bits.hpp>
 #include <common/buffer.hpp>
+#include <common/byteswap.hpp>
+#include <common/segmentedbuffer.hpp>
 #include <common/macros.hpp>
 #include <common/span.hpp>
 #include <common/traits.hpp>
@@ -19,7 +28,8 @@ namespace vitamine::proxyd
 		constexpr UInt VARINT32_MAX_ENCODED_SIZE = ceildiv(32, 7);
 
 		inline
-		UInt wireSizeVarInt32(Int32 value)
+		// reference implementation for wireSizeVarInt32
+		UInt wireSizeVarInt32Scalar(Int32 value)
 		{
 			switch(clz(value))
 			{
@@ -71,7 +81,8 @@ namespace vitamine::proxyd
 		}
 
 		inline
-		UInt encodeVarInt32(UInt8* buf, Int32 value)
+		// reference implementation for encodeVarInt32, writes exactly the encoded length
+		UInt encodeVarInt32Scalar(UInt8* buf, Int32 value)
 		{
 			auto v = (UInt32)value;
 
@@ -138,31 +149,149 @@ namespace vitamine::proxyd
 			default: UNREACHABLE
 			}
 		}
+
+		inline
+		UInt wireSizeVarInt32(Int32 value)
+		{
+			auto bits = 32 - __builtin_clz((UInt32)value | 1u);
+			return (bits + 6) / 7;
+		}
+
+		// always writes VARINT32_MAX_ENCODED_SIZE bytes, the bytes behind the encoded length are garbage
+		inline
+		UInt encodeVarInt32(UInt8* buf, Int32 value)
+		{
+			auto v = (UInt32)value;
+			auto length = wireSizeVarInt32(value);
+
+			// spread the value into groups of 7 bits per byte
+#ifdef __BMI2__
+			UInt64 groups = _pdep_u64(v, 0x0000007f7f7f7f7full);
+#else
+			UInt64 groups = (v & 0x7fu)
+			              | (v << 1 & 0x7f00u)
+			              | (v << 2 & 0x7f0000u)
+			              | (v << 3 & 0x7f000000u)
+			              | ((UInt64)v << 4 & 0x7f00000000ull);
+#endif
+
+			// every byte but the last has the continuation bit set
+			auto continuation = 0x80808080ull >> (8 * (VARINT32_MAX_ENCODED_SIZE - length));
+			auto word = boost::endian::native_to_little(groups | continuation);
+			std::memcpy(buf, &word, VARINT32_MAX_ENCODED_SIZE);
+			return length;
+		}
+
+		// 'buf' must have room for values.size() * VARINT32_MAX_ENCODED_SIZE bytes, returns the number of bytes used
+		inline
+		UInt encodeVarInt32Batch(UInt8* buf, Span<Int32 const> values)
+		{
+			UInt length = 0;
+
+			for(auto value : values)
+				length += encodeVarInt32(buf + length, value);
+
+			return length;
+		}
 	}
 
+	// sizes of the encodings produced by the serialize functions below
+	// fixed size values take sizeof the value
+
 	inline
-	void serializeVarInt(Buffer& buffer, Int32 value)
+	UInt serializedSizeVarInt(Int32 value)
+	{
+		return detail::wireSizeVarInt32(value);
+	}
+
+	inline
+	UInt serializedSizeVarIntArray(Span<Int32 const> values)
+	{
+		UInt size = 0;
+
+		for(auto value : values)
+			size += serializedSizeVarInt(value);
+
+		return size;
+	}
+
+	inline
+	UInt serializedSizeString(Span<Char8 const> str)
+	{
+		return serializedSizeVarInt(str.size()) + str.size();
+	}
+
+	inline
+	UInt serializedSizeString(std::string const& str)
+	{
+		return serializedSizeVarInt(str.size()) + str.size();
+	}
+
+	template <typename OutputBuffer>
+	void serializeVarInt(OutputBuffer& buffer, Int32 value)
 	{
 		UInt8 buf[detail::VARINT32_MAX_ENCODED_SIZE];
 		auto length = detail::encodeVarInt32(buf, value);
 		buffer.write(buf, length);
 	}
 
-	template <typename T>
-	void serializeInt(Buffer& buffer, T value)
+	// writes the values as consecutive varints, encoded in blocks on the stack like serializeIntArray
+	template <typename OutputBuffer>
+	void serializeVarIntArray(OutputBuffer& buffer, Span<Int32 const> values)
+	{
+		constexpr UInt BLOCK_SIZE = 256;
+
+		UInt8 block[BLOCK_SIZE * detail::VARINT32_MAX_ENCODED_SIZE];
+
+		for(UInt i = 0; i < values.size(); i += BLOCK_SIZE)
+		{
+			auto count = std::min(values.size() - i, BLOCK_SIZE);
+			auto length = detail::encodeVarInt32Batch(block, Span(values.data() + i, count));
+			buffer.write(block, length);
+		}
+	}
+
+	template <typename OutputBuffer, typename T>
+	void serializeInt(OutputBuffer& buffer, T value)
 	{
 		boost::endian::native_to_big_inplace(value);
 		buffer.write(&value, sizeof value);
 	}
 
-	inline
-	void serializeBool(Buffer& buffer, bool value)
+	// writes the values as consecutive big endian integers
+	// they are converted in blocks on the stack, so that every block takes a single write
+	template <typename OutputBuffer, typename T>
+	void serializeIntArray(OutputBuffer& buffer, Span<T> values)
 	{
-		serializeInt(buffer, (UInt8)value);
+		using Value = std::remove_const_t<T>;
+		constexpr UInt BLOCK_SIZE = 1024 / sizeof(Value);
+
+		UInt8 block[BLOCK_SIZE * sizeof(Value)];
+
+		for(UInt i = 0; i < values.size(); i += BLOCK_SIZE)
+		{
+			auto count = std::min(values.size() - i, BLOCK_SIZE);
+			copyBigEndianArray<Value>(block, values.data() + i, count);
+			buffer.write(block, count * sizeof(Value));
+		}
 	}
 
+	// the buffer grows once and the values are converted in place
 	template <typename T>
-	void serializeFloat(Buffer& buffer, T value)
+	void serializeIntArray(Buffer& buffer, Span<T> values)
+	{
+		using Value = std::remove_const_t<T>;
+		copyBigEndianArray<Value>(buffer.extend(values.size() * sizeof(Value)), values.data(), values.size());
+	}
+
+	template <typename OutputBuffer>
+	void serializeBool(OutputBuffer& buffer, bool value)
+	{
+		serializeInt(buffer, (UInt8)value);
+	}
+
+	template <typename OutputBuffer, typename T>
+	void serializeFloat(OutputBuffer& buffer, T value)
 	{
 		typename UIntForSize<sizeof(T)>::Type intval;
 		std::memcpy(&intval, &value, sizeof value);
@@ -170,27 +299,27 @@ namespace vitamine::proxyd
 		buffer.write(&intval, sizeof intval);
 	}
 
-	inline
-	void serializeString(Buffer& buffer, Span<Char8 const> str)
+	template <typename OutputBuffer>
+	void serializeString(OutputBuffer& buffer, Span<Char8 const> str)
 	{
 		serializeVarInt(buffer, str.size());
 		buffer.write(str.data(), str.size());
 	}
 
-	inline
-	void serializeString(Buffer& buffer, std::string const& str)
+	template <typename OutputBuffer>
+	void serializeString(OutputBuffer& buffer, std::string const& str)
 	{
 		serializeString(buffer, Span<Char8 const>(str.data(), str.size()));
 	}
 
-	inline
-	void serializeBytes(Buffer& buffer, Span<UInt8 const> data)
+	template <typename OutputBuffer>
+	void serializeBytes(OutputBuffer& buffer, Span<UInt8 const> data)
 	{
 		buffer.write(data.data(), data.size());
 	}
 
-	inline
-	void serializeUuid(Buffer& buffer, boost::uuids::uuid uuid)
+	template <typename OutputBuffer>
+	void serializeUuid(OutputBuffer& buffer, boost::uuids::uuid uuid)
 	{
 		UInt64 lo, hi;
 		std::memcpy(&lo, uuid.begin(),     8);
@@ -198,4 +327,44 @@ namespace vitamine::proxyd
 		serializeInt(buffer, hi);
 		serializeInt(buffer, lo);
 	}
+
+	// unchecked stores for fixed layouts, the caller has already made room for the value
+
+	template <typename T>
+	void storeBigEndian(UInt8* data, T value)
+	{
+		boost::endian::native_to_big_inplace(value);
+		std::memcpy(data, &value, sizeof value);
+	}
+
+	template <typename T>
+	void storeBigEndianFloat(UInt8* data, T value)
+	{
+		typename UIntForSize<sizeof(T)>::Type bits;
+		std::memcpy(&bits, &value, sizeof value);
+		storeBigEndian(data, bits);
+	}
+
+	inline
+	void storeUuid(UInt8* data, boost::uuids::uuid uuid)
+	{
+		UInt64 lo, hi;
+		std::memcpy(&lo, uuid.begin(),     8);
+		std::memcpy(&hi, uuid.begin() + 8, 8);
+		storeBigEndian(data,     hi);
+		storeBigEndian(data + 8, lo);
+	}
+
+	template <typename OutputBuffer>
+	void serializeSegments(OutputBuffer& buffer, SegmentedBuffer const& data)
+	{
+		data.forEachSegment([&](void const* segment, UInt size){ buffer.write(segment, size); });
+	}
+
+	// composes by reference instead of copying
+	inline
+	void serializeSegments(SegmentedBuffer& buffer, SegmentedBuffer const& data)
+	{
+		buffer.write(data);
+	}
 }
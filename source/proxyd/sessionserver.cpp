@@ -0,0 +1,209 @@
+#include <proxyd/sessionserver.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <exception>
+#include <memory>
+#include <sstream>
+#include <utility>
+
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/ssl/host_name_verification.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+#include <boost/beast/ssl.hpp>
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <boost/uuid/string_generator.hpp>
+
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+
+namespace vitamine::proxyd
+{
+	namespace detail
+	{
+		namespace beast = boost::beast;
+		namespace http = boost::beast::http;
+		namespace ssl = boost::asio::ssl;
+		using tcp = boost::asio::ip::tcp;
+
+		static
+		std::string urlEncode(std::string const& str)
+		{
+			static constexpr char const DIGITS[] = "0123456789ABCDEF";
+			std::string result;
+
+			for(auto c : str)
+			{
+				auto byte = (UInt8)c;
+
+				if((byte >= '0' && byte <= '9') || (byte >= 'A' && byte <= 'Z') || (byte >= 'a' && byte <= 'z') || byte == '-' || byte == '_')
+					result.push_back(c);
+				else
+				{
+					result.push_back('%');
+					result.push_back(DIGITS[byte >> 4]);
+					result.push_back(DIGITS[byte & 0xf]);
+				}
+			}
+
+			return result;
+		}
+
+		// the session server answers 200 with the profile if the client has joined, 204 otherwise
+		static
+		std::optional<SessionProfile> parseProfile(http::response<http::string_body> const& response)
+		{
+			if(response.result() != http::status::ok)
+				return std::nullopt;
+
+			try
+			{
+				std::istringstream in(response.body());
+				boost::property_tree::ptree tree;
+				boost::property_tree::read_json(in, tree);
+
+				auto id = tree.get<std::string>("id");
+				auto name = tree.get<std::string>("name");
+
+				// the id is sent without dashes, the name has to fit into the login success packet
+				if(id.size() != 32 || name.empty() || name.size() > 16)
+					return std::nullopt;
+
+				return SessionProfile{boost::uuids::string_generator()(id), name};
+			}
+			catch(std::exception const&)
+			{
+				return std::nullopt;
+			}
+		}
+
+		// one https request, kept alive by the handlers of its pending operations
+		class SessionRequest : public std::enable_shared_from_this<SessionRequest>
+		{
+			tcp::resolver _resolver;
+			beast::ssl_stream<beast::tcp_stream> _stream;
+			beast::flat_buffer _buffer;
+			http::request<http::empty_body> _request;
+			http::response<http::string_body> _response;
+			ISessionVerifier::Callback _callback;
+
+			void fail(char const* what, boost::system::error_code ec)
+			{
+				std::printf("session server request failed: %s: %s\n", what, ec.message().c_str());
+				_callback(std::nullopt);
+			}
+
+		public:
+			SessionRequest(boost::asio::io_service& service, ssl::context& sslContext, ISessionVerifier::Callback callback)
+			: _resolver(service), _stream(service, sslContext), _callback(std::move(callback))
+			{}
+
+			void start(std::string const& host, std::string target)
+			{
+				// the server name is needed for sni and checked against the certificate
+				if(!SSL_set_tlsext_host_name(_stream.native_handle(), host.c_str()))
+				{
+					fail("sni", boost::system::error_code((int)ERR_get_error(), boost::asio::error::get_ssl_category()));
+					return;
+				}
+
+				_stream.set_verify_mode(ssl::verify_peer);
+				_stream.set_verify_callback(ssl::host_name_verification(host));
+
+				_request.method(http::verb::get);
+				_request.target(target);
+				_request.version(11);
+				_request.set(http::field::host, host);
+				_request.set(http::field::user_agent, "vitamine");
+
+				// covers everything from connecting to reading the response
+				beast::get_lowest_layer(_stream).expires_after(std::chrono::seconds(SESSION_REQUEST_TIMEOUT_SECONDS));
+
+				_resolver.async_resolve(host, "https", [self = shared_from_this()](auto ec, tcp::resolver::results_type results)
+				{
+					if(ec)
+					{
+						self->fail("resolve", ec);
+						return;
+					}
+
+					self->connect(results);
+				});
+			}
+
+			void connect(tcp::resolver::results_type const& results)
+			{
+				beast::get_lowest_layer(_stream).async_connect(results, [self = shared_from_this()](auto ec, auto const&)
+				{
+					if(ec)
+					{
+						self->fail("connect", ec);
+						return;
+					}
+
+					self->_stream.async_handshake(ssl::stream_base::client, [self](auto ec)
+					{
+						if(ec)
+						{
+							self->fail("handshake", ec);
+							return;
+						}
+
+						self->exchange();
+					});
+				});
+			}
+
+			void exchange()
+			{
+				http::async_write(_stream, _request, [self = shared_from_this()](auto ec, auto)
+				{
+					if(ec)
+					{
+						self->fail("write", ec);
+						return;
+					}
+
+					http::async_read(self->_stream, self->_buffer, self->_response, [self](auto ec, auto)
+					{
+						if(ec)
+						{
+							self->fail("read", ec);
+							return;
+						}
+
+						// the connection is closed without a tls shutdown, the response is complete
+						self->_callback(parseProfile(self->_response));
+					});
+				});
+			}
+		};
+	}
+
+	SessionServerVerifier::SessionServerVerifier(std::string host)
+	: _host(std::move(host)), _work(_service.get_executor()), _sslContext(boost::asio::ssl::context::tls_client)
+	{
+		_sslContext.set_default_verify_paths();
+		_thread = std::thread([this]{ _service.run(); });
+	}
+
+	SessionServerVerifier::~SessionServerVerifier()
+	{
+		_service.stop();
+		_thread.join();
+	}
+
+	void SessionServerVerifier::verify(std::string const& username, std::string const& serverHash, Callback callback)
+	{
+		auto target = "/session/minecraft/hasJoined?username=" + detail::urlEncode(username) + "&serverId=" + detail::urlEncode(serverHash);
+		auto request = std::make_shared<detail::SessionRequest>(_service, _sslContext, std::move(callback));
+
+		// the request's members are only touched by the verifier's thread
+		_service.post([this, request = std::move(request), target = std::move(target)]() mutable
+		{
+			request->start(_host, std::move(target));
+		});
+	}
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <string>
+#include <thread>
+
+#include <boost/asio/executor_work_guard.hpp>
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/ssl/context.hpp>
+
+#include <common/types.hpp>
+#include <proxyd/authentication.hpp>
+
+namespace vitamine::proxyd
+{
+	constexpr char const DEFAULT_SESSION_SERVER_HOST[] = "sessionserver.mojang.com";
+
+	// a login fails if the session server has not answered by then, well before the client's read timeout
+	constexpr UInt SESSION_REQUEST_TIMEOUT_SECONDS = 5;
+
+	// asks the session server over https whether the client has joined with the server hash
+	// requests run on a thread of their own, so a slow session server never stalls a reactor
+	class SessionServerVerifier final : public ISessionVerifier
+	{
+		std::string _host;
+
+		boost::asio::io_service _service;
+		boost::asio::executor_work_guard<boost::asio::io_service::executor_type> _work;
+		boost::asio::ssl::context _sslContext;
+		std::thread _thread;
+
+	public:
+		explicit SessionServerVerifier(std::string host = DEFAULT_SESSION_SERVER_HOST);
+
+		// requests still in flight are abandoned, their callbacks are not run
+		~SessionServerVerifier();
+
+		SessionServerVerifier(SessionServerVerifier const&) = delete;
+		SessionServerVerifier& operator=(SessionServerVerifier const&) = delete;
+
+		virtual void verify(std::string const& username, std::string const& serverHash, Callback callback) final;
+	};
+}
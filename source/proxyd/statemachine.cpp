@@ -2,754 +2,684 @@
 
 #include <unordered_set>
 
-#include <proxyd/bitpack.hpp>
+#include <proxyd/authentication.hpp>
 #include <proxyd/chunk.hpp>
 #include <proxyd/packets.hpp>
 #include <generated/ids.hpp>
 
 namespace
 {
-	// https://wiki.vg/index.php?title=Protocol&oldid=15289
-	constexpr vitamine::Int32 PROTOCOL_VERSION = 498;
-
 	constexpr vitamine::Int64 CLIENT_READ_TIMEOUT_NANOS = 10'000'000'000;
 	constexpr vitamine::Int64 KEEP_ALIVE_INTERVAL_NANOS = 5'000'000'000;
 
 	constexpr vitamine::Char8 const PLUGIN_CHANNEL_MINECRAFT_BRAND[] = "minecraft:brand";
 	constexpr vitamine::Char8 const SERVER_BRAND_STRING[] = "github.com/mgrech/vitamine";
+
+	// empty since minecraft 1.7
+	constexpr vitamine::Char8 const SERVER_ID[] = "";
 }
 
 namespace vitamine::proxyd
 {
-	void StateMachine::onPacket(PacketFrame frame)
+	void StateMachine::completeLogin()
 	{
-		_lastPacketTime = _globalState->clock.now();
+		_playerState.entityId = _globalState->nextEntityId++;
 
-		switch(_phase)
+		if(auto threshold = _globalState->serverSettings.compressionThreshold; threshold >= 0)
 		{
-		case ClientPhase::INITIAL:
-			PacketHandshake handshake;
-			if(frame.id != PacketHandshake::ID || !deserializePacketPayload(frame.data, &handshake))
-			{
-				disconnect();
-				return;
-			}
+			PacketSetCompression setCompression;
+			setCompression.threshold = threshold;
+			sendPacket(setCompression);
 
-			if(handshake.version != PROTOCOL_VERSION)
-			{
-				disconnect("version mismatch");
-				return;
-			}
+			// the client compresses everything it sends after receiving set compression
+			_compressionThreshold = threshold;
+			_reader.enableCompression();
+		}
 
-			switch(handshake.nextState)
-			{
-			case 1: _phase = ClientPhase::STATUS; break;
-			case 2: _phase = ClientPhase::LOGIN; break;
-			default:
-				disconnect("invalid next state"); break;
-			}
+		auto uuid = boost::uuids::to_string(_playerState.uuid);
+		PacketLoginSuccess loginSuccess;
+		loginSuccess.uuid = spanFromStdString(uuid);
+		loginSuccess.username = spanFromStdString(_playerState.username);
+		sendPacket(loginSuccess);
+
+		PacketJoinGame joinGame;
+		joinGame.entityId = _playerState.entityId;
+		joinGame.gameMode = (UInt8)_playerState.gameMode;
+		joinGame.dimension = (Int32)_globalState->serverSettings.dimension;
+		joinGame.maxPlayers = 0;
+		joinGame.levelType = spanFromCString("default");
+		joinGame.viewDistance = _globalState->serverSettings.maxViewDistance;
+		joinGame.reducedDebugInfo = _globalState->serverSettings.reducedDebugInfo;
+		sendPacket(joinGame);
 
-			break;
+		Buffer buffer;
+		serializeString(buffer, spanFromCString(SERVER_BRAND_STRING));
 
-		case ClientPhase::LOGIN:
-		{
-			PacketLoginStart loginStart;
-			if(frame.id != PacketLoginStart::ID || !deserializePacketPayload(frame.data, &loginStart))
-			{
-				disconnect();
-				return;
-			}
+		PacketPluginMessageServer brandMessage;
+		brandMessage.channel = spanFromCString(PLUGIN_CHANNEL_MINECRAFT_BRAND);
+		brandMessage.data = Span((UInt8 const*)buffer.data(), buffer.size());
+		sendPacket(brandMessage);
 
-			std::printf("new player from %s\n", _connection->endpoint().c_str());
+		PacketPlayerAbilitiesServer playerAbilities;
+		playerAbilities.flags = _playerState.abilityFlags;
+		playerAbilities.flyingSpeed = _playerState.flyingSpeed;
+		playerAbilities.walkingSpeed = _playerState.walkingSpeed;
+		sendPacket(playerAbilities);
 
-			// TODO: check for duplicate player names
-			_playerState.username = toStdString(loginStart.name);
-			_playerState.uuid = _globalState->uuidGenerator(_playerState.username);
-			_playerState.entityId = _globalState->nextEntityId++;
-
-			auto uuid = boost::uuids::to_string(_playerState.uuid);
-			PacketLoginSuccess loginSuccess;
-			loginSuccess.uuid = spanFromStdString(uuid);
-			loginSuccess.username = loginStart.name;
-			sendPacket(loginSuccess);
-
-			PacketJoinGame joinGame;
-			joinGame.entityId = _playerState.entityId;
-			joinGame.gameMode = (UInt8)_playerState.gameMode;
-			joinGame.dimension = (Int32)_globalState->serverSettings.dimension;
-			joinGame.maxPlayers = 0;
-			joinGame.levelType = spanFromCString("default");
-			joinGame.viewDistance = _globalState->serverSettings.maxViewDistance;
-			joinGame.reducedDebugInfo = _globalState->serverSettings.reducedDebugInfo;
-			sendPacket(joinGame);
-
-			Buffer buffer;
-			serializeString(buffer, spanFromCString(SERVER_BRAND_STRING));
-
-			PacketPluginMessageServer brandMessage;
-			brandMessage.channel = spanFromCString(PLUGIN_CHANNEL_MINECRAFT_BRAND);
-			brandMessage.data = Span((UInt8 const*)buffer.data(), buffer.size());
-			sendPacket(brandMessage);
-
-			PacketPlayerAbilitiesServer playerAbilities;
-			playerAbilities.flags = _playerState.abilityFlags;
-			playerAbilities.flyingSpeed = _playerState.flyingSpeed;
-			playerAbilities.walkingSpeed = _playerState.walkingSpeed;
-			sendPacket(playerAbilities);
-
-			PacketHeldItemChangeServer heldItemChange;
-			heldItemChange.slot = _playerState.heldItemSlot;
-			sendPacket(heldItemChange);
+		PacketHeldItemChangeServer heldItemChange;
+		heldItemChange.slot = _playerState.heldItemSlot;
+		sendPacket(heldItemChange);
 
-			{
-				std::lock_guard guard(_globalState->playersMutex);
+		{
+			std::lock_guard guard(_globalState->playersMutex);
 
-				{
-					std::vector<PacketPlayerInfo::Entry> entries;
-
-					for(auto& player : _globalState->players)
-					{
-						PacketPlayerInfo::AddPlayer addPlayer;
-						addPlayer.name = player->_playerState.username;
-						addPlayer.gameMode = (Int32)player->_playerState.gameMode;
-						addPlayer.ping = 0;
-						addPlayer.hasDisplayName = false;
-
-						PacketPlayerInfo::Entry entry;
-						entry.uuid = player->_playerState.uuid;
-						entry.update = addPlayer;
-						entries.push_back(entry);
-					}
-
-					PacketPlayerInfo currentPlayers;
-					currentPlayers.action = PacketPlayerInfo::ADD_PLAYER;
-					currentPlayers.entries = entries;
-					sendPacket(currentPlayers);
-				}
+			{
+				auto& arena = threadArena();
+				ArenaScope scope(arena);
 
-				_globalState->players.insert(this);
+				auto entries = arena.allocateArray<PacketPlayerInfo::Entry>(_globalState->players.size());
+				auto entry = entries.begin();
 
+				for(auto& player : _globalState->players)
 				{
-					PacketPlayerInfo::AddPlayer addPlayer;
-					addPlayer.name = _playerState.username;
-					addPlayer.gameMode = (Int32)_playerState.gameMode;
+					PacketPlayerInfo::AddPlayer addPlayer = {};
+					addPlayer.name = spanFromStdString(player->_playerState.username);
+					addPlayer.gameMode = (Int32)player->_playerState.gameMode;
 					addPlayer.ping = 0;
 					addPlayer.hasDisplayName = false;
 
-					PacketPlayerInfo::Entry entry;
-					entry.uuid = _playerState.uuid;
-					entry.update = addPlayer;
-
-					PacketPlayerInfo addPlayerInfo;
-					addPlayerInfo.action = PacketPlayerInfo::ADD_PLAYER;
-					addPlayerInfo.entries.push_back(entry);
-					broadcastGloballyUnsafe(addPlayerInfo, true);
+					entry->uuid = player->_playerState.uuid;
+					entry->update = addPlayer;
+					++entry;
 				}
+
+				PacketPlayerInfo currentPlayers;
+				currentPlayers.action = PacketPlayerInfo::ADD_PLAYER;
+				currentPlayers.entries = entries;
+				sendPacket(currentPlayers);
 			}
 
-			_phase = ClientPhase::PLAY_INIT;
-			break;
-		}
+			_globalState->players.insert(this);
 
-		case ClientPhase::PLAY_INIT:
-			switch(frame.id)
-			{
-			case PacketPlayerPositionRotationClient::ID:
 			{
-				PacketPlayerPositionRotationClient packet;
+				PacketPlayerInfo::AddPlayer addPlayer = {};
+				addPlayer.name = spanFromStdString(_playerState.username);
+				addPlayer.gameMode = (Int32)_playerState.gameMode;
+				addPlayer.ping = 0;
+				addPlayer.hasDisplayName = false;
 
-				if(!deserializePacketPayload(frame.data, &packet))
-				{
-					disconnect();
-					return;
-				}
+				PacketPlayerInfo::Entry entry;
+				entry.uuid = _playerState.uuid;
+				entry.update = addPlayer;
 
-				// discard this packet, the client is ready when receiving the teleport confirmation
-				break;
+				PacketPlayerInfo addPlayerInfo;
+				addPlayerInfo.action = PacketPlayerInfo::ADD_PLAYER;
+				addPlayerInfo.entries = Span(&entry, 1);
+				broadcastGloballyUnsafe(addPlayerInfo, true);
 			}
+		}
 
-			case PacketTeleportConfirm::ID:
-			{
-				PacketTeleportConfirm packet;
+		_phase = ClientPhase::PLAY_INIT;
+	}
 
-				if(!deserializePacketPayload(frame.data, &packet))
-				{
-					disconnect();
-					return;
-				}
+	constexpr StateMachine::PacketDispatchTable StateMachine::makeDispatchTable(ClientPhase phase)
+	{
+		PacketDispatchTable table = {};
 
-				if(!_playerState.confirmTeleport(packet.teleportId))
-					disconnect("PacketTeleportConfirm: invalid teleport id");
+#define PACKET_HANDLER(handlerPhase, name) \
+		if(phase == ClientPhase::handlerPhase) \
+			table[Packet##name::ID] = &dispatchPacket<ClientPhase::handlerPhase, Packet##name>;
+#include <proxyd/handlers.def>
 
-				auto coord = coord_cast<ChunkCoord>(_playerState.position);
+		return table;
+	}
 
-				{
-					auto vd = _playerState.clientSettings.viewDistance;
-					auto spawn = createSpawnPacket(_playerState);
+	constexpr std::array<StateMachine::PacketDispatchTable, CLIENT_PHASE_COUNT> const StateMachine::DISPATCH_TABLES =
+	{
+		makeDispatchTable(ClientPhase::INITIAL),
+		makeDispatchTable(ClientPhase::LOGIN),
+		makeDispatchTable(ClientPhase::LOGIN_ENCRYPTION),
+		makeDispatchTable(ClientPhase::LOGIN_VERIFICATION),
+		makeDispatchTable(ClientPhase::PLAY_INIT),
+		makeDispatchTable(ClientPhase::PLAY),
+		makeDispatchTable(ClientPhase::STATUS),
+	};
 
-					std::unordered_set<StateMachine*> visiblePlayers;
+	void StateMachine::onPacket(PacketFrame frame)
+	{
+		_lastPacketTime = _globalState->clock->now();
 
-					auto lock = _globalState->playerTracker.lock();
-					_globalState->playerTracker.enter(coord, vd, this);
-					broadcastLocallyUnsafe(spawn, false);
+		ClientPhase phase = _phase;
+		auto& table = DISPATCH_TABLES[(UInt)phase];
 
-					for(auto i = -vd; i <= vd; ++i)
-					for(auto j = -vd; j <= vd; ++j)
-					{
-						auto members = _globalState->playerTracker.members(coord + ChunkCoord{i, j});
-						visiblePlayers.insert(members.begin(), members.end());
-					}
+		if(frame.id < 0 || (UInt)frame.id >= table.size() || !table[frame.id])
+		{
+			onUnhandledPacket(phase, frame);
+			return;
+		}
 
-					lock.unlock();
+		table[frame.id](this, frame.data);
+	}
 
-					for(auto member : visiblePlayers)
-						if(member != this)
-							sendPacket(createSpawnPacket(member->_playerState));
-				}
+	void StateMachine::onUnhandledPacket(ClientPhase phase, PacketFrame frame)
+	{
+		switch(phase)
+		{
+		// clients that are logged in may send packets that are not implemented yet, they are dropped
+		case ClientPhase::PLAY_INIT:
+		case ClientPhase::PLAY:
+		{
+			auto slot = std::min((UInt)frame.id, UNHANDLED_PACKET_COUNTER_SLOTS - 1);
+			_globalState->unhandledPackets[slot].fetch_add(1, std::memory_order_relaxed);
+			break;
+		}
 
-				_phase = ClientPhase::PLAY;
-				break;
-			}
+		default:
+			disconnect();
+			break;
+		}
+	}
 
-			case PacketPluginMessageClient::ID:
-			{
-				PacketPluginMessageClient packet;
+	void StateMachine::handlePacket(PhaseConstant<ClientPhase::INITIAL>, PacketHandshake const& packet)
+	{
+		if(packet.version != PROTOCOL_VERSION)
+		{
+			disconnect("version mismatch");
+			return;
+		}
 
-				if(!deserializePacketPayload(frame.data, &packet))
-				{
-					disconnect();
-					return;
-				}
+		switch(packet.nextState)
+		{
+		case 1: _phase = ClientPhase::STATUS; break;
+		case 2: _phase = ClientPhase::LOGIN; break;
+		default:
+			disconnect("invalid next state"); break;
+		}
+	}
 
-				if(packet.channel == spanFromCString(PLUGIN_CHANNEL_MINECRAFT_BRAND))
-				{
-					Span<Char8 const> brand;
-					auto bufp = packet.data.data();
-					auto size = packet.data.size();
+	void StateMachine::handlePacket(PhaseConstant<ClientPhase::LOGIN>, PacketLoginStart const& packet)
+	{
+		std::printf("new player from %s\n", _connection->endpoint().c_str());
 
-					if(deserializeString(&bufp, &size, &brand) != DeserializeStatus::OK || size != 0)
-					{
-						disconnect();
-						return;
-					}
+		// TODO: check for duplicate player names
+		_playerState.username = toStdString(packet.name);
 
-					_playerState.clientBrand = std::string(brand.data(), brand.size());
-				}
-				else
-					std::printf("PacketPluginMessageClient: unknown plugin message\n");
+		if(!_globalState->serverSettings.onlineMode)
+		{
+			_playerState.uuid = _globalState->uuidGenerator(_playerState.username);
+			completeLogin();
+			return;
+		}
 
-				break;
-			}
+		generateRandomBytes(_verifyToken, sizeof _verifyToken);
 
-			case PacketClientSettings::ID:
-			{
-				PacketClientSettings packet;
+		PacketEncryptionRequest encryptionRequest;
+		encryptionRequest.serverId = spanFromCString(SERVER_ID);
+		encryptionRequest.publicKey = _globalState->keyPair->publicKey();
+		encryptionRequest.verifyToken = spanFromArray(_verifyToken);
+		sendPacket(encryptionRequest);
 
-				if(!deserializePacketPayload(frame.data, &packet))
-				{
-					disconnect();
-					return;
-				}
+		_phase = ClientPhase::LOGIN_ENCRYPTION;
+	}
 
-				onClientSettingsChange(packet);
+	void StateMachine::handlePacket(PhaseConstant<ClientPhase::LOGIN_ENCRYPTION>, PacketEncryptionResponse const& packet)
+	{
+		auto& keyPair = *_globalState->keyPair;
+		std::vector<UInt8> sharedSecret;
+		std::vector<UInt8> verifyToken;
 
-				auto playerChunkCoord = coord_cast<ChunkCoord>(_playerState.position);
-				auto cx = playerChunkCoord.x;
-				auto cz = playerChunkCoord.z;
-				auto vd = _playerState.clientSettings.viewDistance;
+		if(!keyPair.decrypt(packet.sharedSecret, &sharedSecret) || sharedSecret.size() != SHARED_SECRET_SIZE
+		|| !keyPair.decrypt(packet.verifyToken, &verifyToken) || Span<UInt8 const>(verifyToken) != Span<UInt8 const>(_verifyToken, VERIFY_TOKEN_SIZE))
+		{
+			disconnect();
+			return;
+		}
 
-				for(auto i = cx - vd; i <= cx + vd; ++i)
-					for(auto j = cz - vd; j <= cz + vd; ++j)
-						sendChunk({i, j});
-
-				PacketSpawnPosition spawnPosition;
-				spawnPosition.location = toPosition({0, 0, 0});
-				sendPacket(spawnPosition);
-
-				PacketPlayerPositionLookServer positionLook;
-				positionLook.x = _playerState.position.x;
-				positionLook.y = _playerState.position.y;
-				positionLook.z = _playerState.position.z;
-				positionLook.yaw = _playerState.pitch;
-				positionLook.pitch = _playerState.yaw;
-				positionLook.flags = 0;
-				positionLook.teleportId = _playerState.startTeleport();
-				sendPacket(positionLook);
-				break;
-			}
+		// everything from here on, including a disconnect message, is encrypted
+		_connection->enableEncryption(sharedSecret);
 
-			default:
-				std::printf("unhandled packet in phase PLAY_INIT: ");
-				debugPrint(frame);
-				break;
-			}
-			break;
+		auto serverHash = computeServerHash(spanFromCString(SERVER_ID), sharedSecret, keyPair.publicKey());
 
-		case ClientPhase::PLAY:
-			switch(frame.id)
-			{
-			case PacketChatClient::ID:
+		// the client waits for the login to complete, any packet it sends until then disconnects it
+		_phase = ClientPhase::LOGIN_VERIFICATION;
+
+		_globalState->sessionVerifier->verify(_playerState.username, serverHash, [connection = _connection, self = weak_from_this()](auto profile)
+		{
+			connection->post([self = std::move(self), profile = std::move(profile)]
 			{
-				PacketChatClient packet;
+				// the client may have disconnected while waiting
+				if(auto state = self.lock())
+					state->onSessionVerified(profile);
+			});
+		});
+	}
 
-				if(!deserializePacketPayload(frame.data, &packet))
-				{
-					disconnect();
-					return;
-				}
+	void StateMachine::onSessionVerified(std::optional<SessionProfile> const& profile)
+	{
+		if(!profile)
+		{
+			disconnect("failed to verify username");
+			return;
+		}
 
-				if(packet.message.size() > 256)
-				{
-					disconnect("chat message too long");
-					return;
-				}
+		_playerState.username = profile->username;
+		_playerState.uuid = profile->uuid;
+		completeLogin();
+	}
 
-				{
-					auto message = chat::plainText("<" + _playerState.username + "> " + toStdString(packet.message));
+	void StateMachine::handlePacket(PhaseConstant<ClientPhase::PLAY_INIT>, PacketPlayerPositionRotationClient const& packet)
+	{
+		// discard this packet, the client is ready when receiving the teleport confirmation
+		(void)packet;
+	}
 
-					PacketChatServer serverChat;
-					serverChat.position = 0;
-					serverChat.chat = spanFromStdString(message);
+	void StateMachine::handlePacket(PhaseConstant<ClientPhase::PLAY_INIT>, PacketTeleportConfirm const& packet)
+	{
+		if(!_playerState.confirmTeleport(packet.teleportId))
+			disconnect("PacketTeleportConfirm: invalid teleport id");
 
-					std::lock_guard guard(_globalState->playersMutex);
-					broadcastGloballyUnsafe(serverChat, true);
-				}
+		auto coord = coord_cast<ChunkCoord>(_playerState.position);
 
-				break;
-			}
-
-			case PacketClientSettings::ID:
-			{
-				PacketClientSettings packet;
+		{
+			auto vd = _playerState.clientSettings.viewDistance;
+			auto spawn = createSpawnPacket(_playerState);
 
-				if(!deserializePacketPayload(frame.data, &packet))
-				{
-					disconnect();
-					return;
-				}
+			std::unordered_set<StateMachine*> visiblePlayers;
 
-				onClientSettingsChange(packet);
-				break;
-			}
+			auto lock = _globalState->playerTracker.lock();
+			_globalState->playerTracker.enter(coord, vd, this);
+			broadcastLocallyUnsafe(spawn, false);
 
-			case PacketCloseWindowClient::ID:
+			for(auto i = -vd; i <= vd; ++i)
+			for(auto j = -vd; j <= vd; ++j)
 			{
-				PacketCloseWindowClient packet;
+				auto members = _globalState->playerTracker.members(coord + ChunkCoord{i, j});
+				visiblePlayers.insert(members.begin(), members.end());
+			}
 
-				if(!deserializePacketPayload(frame.data, &packet))
-				{
-					disconnect();
-					return;
-				}
+			// keep holding the lock: players in view may be disconnected concurrently by other reactor threads
+			for(auto member : visiblePlayers)
+				if(member != this)
+					sendPacket(createSpawnPacket(member->_playerState));
+		}
 
-				// ignore ID=0 (player inventory), since the client never sends an open packet for this id
-				if(packet.windowId != 0)
-				{
-					if(_playerState.openWindow != packet.windowId)
-					{
-						disconnect("invalid window id");
-						return;
-					}
+		_phase = ClientPhase::PLAY;
+	}
 
-					_playerState.openWindow = 0;
-				}
+	void StateMachine::handlePacket(PhaseConstant<ClientPhase::PLAY_INIT>, PacketPluginMessageClient const& packet)
+	{
+		if(packet.channel == spanFromCString(PLUGIN_CHANNEL_MINECRAFT_BRAND))
+		{
+			Span<Char8 const> brand;
+			auto bufp = packet.data.data();
+			auto size = packet.data.size();
 
-				break;
+			if(deserializeString(&bufp, &size, &brand) != DeserializeStatus::OK || size != 0)
+			{
+				disconnect();
+				return;
 			}
 
-			case PacketInteractEntity::ID:
-			{
-				PacketInteractEntity packet;
+			_playerState.clientBrand = std::string(brand.data(), brand.size());
+		}
+		else
+			std::printf("PacketPluginMessageClient: unknown plugin message\n");
+	}
 
-				if(!deserializePacketPayload(frame.data, &packet))
-				{
-					disconnect();
-					return;
-				}
+	void StateMachine::handlePacket(PhaseConstant<ClientPhase::PLAY_INIT>, PacketClientSettings const& packet)
+	{
+		onClientSettingsChange(packet);
 
-				// TODO: validate, but ignore
-				break;
-			}
+		auto playerChunkCoord = coord_cast<ChunkCoord>(_playerState.position);
+		auto cx = playerChunkCoord.x;
+		auto cz = playerChunkCoord.z;
+		auto vd = _playerState.clientSettings.viewDistance;
 
-			case PacketPlayerPosition::ID:
-			{
-				PacketPlayerPosition packet;
+		for(auto i = cx - vd; i <= cx + vd; ++i)
+			for(auto j = cz - vd; j <= cz + vd; ++j)
+				sendChunk({i, j});
+
+		PacketSpawnPosition spawnPosition;
+		spawnPosition.location = toPosition({0, 0, 0});
+		sendPacket(spawnPosition);
+
+		PacketPlayerPositionLookServer positionLook;
+		positionLook.x = _playerState.position.x;
+		positionLook.y = _playerState.position.y;
+		positionLook.z = _playerState.position.z;
+		positionLook.yaw = _playerState.pitch;
+		positionLook.pitch = _playerState.yaw;
+		positionLook.flags = 0;
+		positionLook.teleportId = _playerState.startTeleport();
+		sendPacket(positionLook);
+	}
 
-				if(!deserializePacketPayload(frame.data, &packet))
-				{
-					disconnect();
-					return;
-				}
+	void StateMachine::handlePacket(PhaseConstant<ClientPhase::PLAY>, PacketChatClient const& packet)
+	{
+		if(packet.message.size() > 256)
+		{
+			disconnect("chat message too long");
+			return;
+		}
 
-				auto oldPos = _playerState.position;
-				_playerState.position.x = packet.x;
-				_playerState.position.y = packet.y;
-				_playerState.position.z = packet.z;
-				onMove(oldPos, false);
-				break;
-			}
+		auto message = chat::plainText("<" + _playerState.username + "> " + toStdString(packet.message));
 
-			case PacketPlayerPositionRotationClient::ID:
-			{
-				PacketPlayerPositionRotationClient packet;
+		PacketChatServer serverChat;
+		serverChat.position = 0;
+		serverChat.chat = spanFromStdString(message);
 
-				if(!deserializePacketPayload(frame.data, &packet))
-				{
-					disconnect();
-					return;
-				}
+		std::lock_guard guard(_globalState->playersMutex);
+		broadcastGloballyUnsafe(serverChat, true);
+	}
 
-				auto oldPos = _playerState.position;
-				_playerState.position.x = packet.x;
-				_playerState.position.y = packet.y;
-				_playerState.position.z = packet.z;
-				_playerState.yaw = packet.yaw;
-				_playerState.pitch = packet.pitch;
-				onMove(oldPos, true);
-				break;
-			}
+	void StateMachine::handlePacket(PhaseConstant<ClientPhase::PLAY>, PacketClientSettings const& packet)
+	{
+		onClientSettingsChange(packet);
+	}
 
-			case PacketPlayerRotation::ID:
+	void StateMachine::handlePacket(PhaseConstant<ClientPhase::PLAY>, PacketCloseWindowClient const& packet)
+	{
+		// ignore ID=0 (player inventory), since the client never sends an open packet for this id
+		if(packet.windowId != 0)
+		{
+			if(_playerState.openWindow != packet.windowId)
 			{
-				PacketPlayerRotation packet;
-
-				if(!deserializePacketPayload(frame.data, &packet))
-				{
-					disconnect();
-					return;
-				}
-
-				_playerState.yaw = packet.yaw;
-				_playerState.pitch = packet.pitch;
+				disconnect("invalid window id");
+				return;
+			}
 
-				PacketEntityRotation rotation;
-				rotation.entityId = _playerState.entityId;
-				rotation.yaw = _playerState.yaw * 256 / 360;
-				rotation.pitch = _playerState.pitch * 256 / 360;
-				rotation.onGround = false;
+			_playerState.openWindow = 0;
+		}
+	}
 
-				PacketEntityHeadLook look;
-				look.entityId = _playerState.entityId;
-				look.headYaw = _playerState.yaw * 256 / 360;
+	void StateMachine::handlePacket(PhaseConstant<ClientPhase::PLAY>, PacketInteractEntity const& packet)
+	{
+		// TODO: validate, but ignore
+		(void)packet;
+	}
 
-				auto lock = _globalState->playerTracker.lock();
-				broadcastLocallyUnsafe(rotation, false);
-				broadcastLocallyUnsafe(look, false);
-				break;
-			}
+	void StateMachine::handlePacket(PhaseConstant<ClientPhase::PLAY>, PacketPlayerPosition const& packet)
+	{
+		auto oldPos = _playerState.position;
 
-			case PacketPlayerMovement::ID:
-			{
-				PacketPlayerMovement packet;
+		{
+			auto lock = _globalState->playerTracker.lock();
+			_playerState.position.x = packet.x;
+			_playerState.position.y = packet.y;
+			_playerState.position.z = packet.z;
+		}
 
-				if(!deserializePacketPayload(frame.data, &packet))
-				{
-					disconnect();
-					return;
-				}
+		onMove(oldPos, false);
+	}
 
-				// ignore
-				break;
-			}
+	void StateMachine::handlePacket(PhaseConstant<ClientPhase::PLAY>, PacketPlayerPositionRotationClient const& packet)
+	{
+		auto oldPos = _playerState.position;
 
-			case PacketKeepAliveClient::ID:
-			{
-				PacketKeepAliveClient packet;
+		{
+			auto lock = _globalState->playerTracker.lock();
+			_playerState.position.x = packet.x;
+			_playerState.position.y = packet.y;
+			_playerState.position.z = packet.z;
+			_playerState.yaw = packet.yaw;
+			_playerState.pitch = packet.pitch;
+		}
 
-				if(!deserializePacketPayload(frame.data, &packet))
-				{
-					disconnect();
-					return;
-				}
+		onMove(oldPos, true);
+	}
 
-				// discard packet
-				break;
-			}
+	void StateMachine::handlePacket(PhaseConstant<ClientPhase::PLAY>, PacketPlayerRotation const& packet)
+	{
+		PacketEntityRotation rotation;
+		rotation.entityId = _playerState.entityId;
+		rotation.yaw = packet.yaw * 256 / 360;
+		rotation.pitch = packet.pitch * 256 / 360;
+		rotation.onGround = false;
 
-			case PacketPlayerAbilitiesClient::ID:
-			{
-				PacketPlayerAbilitiesClient packet;
+		PacketEntityHeadLook look;
+		look.entityId = _playerState.entityId;
+		look.headYaw = packet.yaw * 256 / 360;
 
-				if(!deserializePacketPayload(frame.data, &packet))
-				{
-					disconnect();
-					return;
-				}
+		auto lock = _globalState->playerTracker.lock();
+		_playerState.yaw = packet.yaw;
+		_playerState.pitch = packet.pitch;
+		broadcastLocallyUnsafe(rotation, false);
+		broadcastLocallyUnsafe(look, false);
+	}
 
-				_playerState.abilityFlags = packet.flags;
-				_playerState.flyingSpeed = packet.flyingSpeed;
-				_playerState.walkingSpeed = packet.walkingSpeed;
-				break;
-			}
+	void StateMachine::handlePacket(PhaseConstant<ClientPhase::PLAY>, PacketPlayerMovement const& packet)
+	{
+		// ignore
+		(void)packet;
+	}
 
-			case PacketPlayerDigging::ID:
-			{
-				PacketPlayerDigging packet;
+	void StateMachine::handlePacket(PhaseConstant<ClientPhase::PLAY>, PacketKeepAliveClient const& packet)
+	{
+		// discard packet
+		(void)packet;
+	}
 
-				if(!deserializePacketPayload(frame.data, &packet))
-				{
-					disconnect();
-					return;
-				}
+	void StateMachine::handlePacket(PhaseConstant<ClientPhase::PLAY>, PacketPlayerAbilitiesClient const& packet)
+	{
+		_playerState.abilityFlags = packet.flags;
+		_playerState.flyingSpeed = packet.flyingSpeed;
+		_playerState.walkingSpeed = packet.walkingSpeed;
+	}
 
-				if(packet.status > 6)
-				{
-					disconnect("PacketPlayerDigging: invalid status");
-					return;
-				}
+	void StateMachine::handlePacket(PhaseConstant<ClientPhase::PLAY>, PacketPlayerDigging const& packet)
+	{
+		if(packet.status > 6)
+		{
+			disconnect("PacketPlayerDigging: invalid status");
+			return;
+		}
 
-				if(packet.face > 5)
-				{
-					disconnect("PacketPlayerDigging: invalid block face");
-					return;
-				}
+		if(packet.face > 5)
+		{
+			disconnect("PacketPlayerDigging: invalid block face");
+			return;
+		}
 
-				auto location = fromPosition(packet.location);
-				auto face = (BlockFace)packet.face;
+		auto location = fromPosition(packet.location);
+		auto face = (BlockFace)packet.face;
 
-				// TODO: validate if block face matches player direction
-				(void)face;
+		// TODO: validate if block face matches player direction
+		(void)face;
 
-				switch(packet.status)
-				{
-				case 0: // started digging
-				{
-					auto distance = (coord_cast<EntityCoord>(location) - _playerState.position).length();
+		switch(packet.status)
+		{
+		case 0: // started digging
+		{
+			auto distance = (coord_cast<EntityCoord>(location) - _playerState.position).length();
 
-					if(distance > 6)
-					{
-						// TODO: reject
-						std::printf("player digging out of range\n");
-					}
+			if(distance > 6)
+			{
+				// TODO: reject
+				std::printf("player digging out of range\n");
+			}
 
-					std::unique_lock chunkListLock(_globalState->chunkMutex);
-					auto it = _globalState->chunks.find(coord_cast<ChunkCoord>(location));
+			std::unique_lock chunkListLock(_globalState->chunkMutex);
+			auto it = _globalState->chunks.find(coord_cast<ChunkCoord>(location));
 
-					if(it == _globalState->chunks.end())
-					{
-						std::printf("PacketPlayerDigging: chunk not found\n");
-						disconnect();
-						return;
-					}
+			if(it == _globalState->chunks.end())
+			{
+				std::printf("PacketPlayerDigging: chunk not found\n");
+				disconnect();
+				return;
+			}
 
-					auto& chunk = *it->second;
-					chunkListLock.unlock();
+			auto& chunk = *it->second;
+			chunkListLock.unlock();
 
-					auto blockCoord = coord_cast<ChunkBlockCoord>(location);
-					std::unique_lock chunkLock(chunk.mutex);
+			auto blockCoord = coord_cast<ChunkBlockCoord>(location);
+			std::unique_lock chunkLock(chunk.mutex);
 
-					if(!chunk.sections[blockCoord.y / 16])
-						chunk.sections[blockCoord.y / 16] = std::make_unique<ChunkSection>();
+			if(!chunk.sections[blockCoord.y / 16])
+				chunk.sections[blockCoord.y / 16] = std::make_unique<ChunkSection>();
 
-					auto& block = chunk.sections[blockCoord.y / 16]->blocks[blockCoord.y % 16][blockCoord.z][blockCoord.x];
+			auto& block = chunk.sections[blockCoord.y / 16]->blocks[blockCoord.y % 16][blockCoord.z][blockCoord.x];
 
-					// TODO: check for fluids
-					// if the client thinks there is a block, but there is none (e.g. due to a race condition)
-					if(block == BLOCKID_MINECRAFT_AIR)
-						return;
+			// TODO: check for fluids
+			// if the client thinks there is a block, but there is none (e.g. due to a race condition)
+			if(block == BLOCKID_MINECRAFT_AIR)
+				return;
 
-					block = BLOCKID_MINECRAFT_AIR;
-					chunkLock.unlock();
+			block = BLOCKID_MINECRAFT_AIR;
+			++chunk.version;
+			chunkLock.unlock();
 
-					PacketBlockChange blockChange;
-					blockChange.location = packet.location;
-					blockChange.blockId = BLOCKID_MINECRAFT_AIR;
-					broadcastLocally(blockChange, false);
+			PacketBlockChange blockChange;
+			blockChange.location = packet.location;
+			blockChange.blockId = BLOCKID_MINECRAFT_AIR;
+			broadcastLocally(blockChange, false);
 
-					break;
-				}
+			break;
+		}
 
-				default:
-					std::printf("unimplemented digging status: %d\n", packet.status);
-					break;
-				}
+		default:
+			std::printf("unimplemented digging status: %d\n", packet.status);
+			break;
+		}
+	}
 
-				break;
+	void StateMachine::handlePacket(PhaseConstant<ClientPhase::PLAY>, PacketEntityAction const& packet)
+	{
+		switch(packet.actionId)
+		{
+		case 0: // start crouching
+			if(packet.entityId != _playerState.entityId)
+			{
+				disconnect("EntityAction: invalid entity id for action 'start crouching'");
+				return;
 			}
 
-			case PacketEntityAction::ID:
+			if(_playerState.crouching)
+				disconnect("EntityAction: already crouching");
+			else
 			{
-				PacketEntityAction packet;
-
-				if(!deserializePacketPayload(frame.data, &packet))
-				{
-					disconnect();
-					return;
-				}
+				setPose(true, _playerState.sprinting);
+				sendMetadataUpdate();
+			}
 
-				switch(packet.actionId)
-				{
-				case 0: // start crouching
-					if(packet.entityId != _playerState.entityId)
-					{
-						disconnect("EntityAction: invalid entity id for action 'start crouching'");
-						return;
-					}
-
-					if(_playerState.crouching)
-						disconnect("EntityAction: already crouching");
-					else
-					{
-						_playerState.crouching = true;
-						sendMetadataUpdate();
-					}
-
-					break;
-
-				case 1: // stop crouching
-					if(packet.entityId != _playerState.entityId)
-					{
-						disconnect("EntityAction: invalid entity id for action 'stop crouching'");
-						return;
-					}
-
-					if(!_playerState.crouching)
-						disconnect("EntityAction: not crouching");
-					else
-					{
-						_playerState.crouching = false;
-						sendMetadataUpdate();
-					}
-
-					break;
-
-				case 2:
-					std::printf("unimplemented EntityAction: leave bed\n");
-					break;
-
-				case 3: // start sprinting
-					if(packet.entityId != _playerState.entityId)
-					{
-						disconnect("EntityAction: invalid entity id for action 'start sprinting'");
-						return;
-					}
-
-					if(_playerState.sprinting)
-						disconnect("EntityAction: already sprinting");
-					else
-					{
-						_playerState.sprinting = true;
-						sendMetadataUpdate();
-					}
-
-					break;
-
-				case 4:
-					if(packet.entityId != _playerState.entityId)
-					{
-						disconnect("EntityAction: invalid entity id for action 'stop sprinting'");
-						return;
-					}
-
-					if(!_playerState.sprinting)
-						disconnect("EntityAction: not sprinting");
-					else
-					{
-						_playerState.sprinting = false;
-						sendMetadataUpdate();
-					}
-
-					break;
-
-				case 5:
-					std::printf("unimplemented EntityAction: start jump with horse\n");
-					break;
-
-				case 6:
-					std::printf("unimplemented EntityAction: stop jump with horse\n");
-					break;
-
-				case 7:
-					std::printf("unimplemented EntityAction: open horse inventory\n");
-					break;
-
-				case 8:
-					std::printf("unimplemented EntityAction: start flying with elytra\n");
-					break;
-
-				default:
-					disconnect("EntityAction: invalid action id: " + std::to_string(packet.actionId));
-					break;
-				}
+			break;
 
-				break;
+		case 1: // stop crouching
+			if(packet.entityId != _playerState.entityId)
+			{
+				disconnect("EntityAction: invalid entity id for action 'stop crouching'");
+				return;
 			}
 
-			case PacketHeldItemChangeClient::ID:
+			if(!_playerState.crouching)
+				disconnect("EntityAction: not crouching");
+			else
 			{
-				PacketHeldItemChangeClient packet;
+				setPose(false, _playerState.sprinting);
+				sendMetadataUpdate();
+			}
 
-				if(!deserializePacketPayload(frame.data, &packet))
-				{
-					disconnect();
-					break;
-				}
+			break;
 
-				if(packet.slot < 0 || packet.slot > 8)
-				{
-					disconnect("HeldItemChange: invalid slot id");
-					return;
-				}
+		case 2:
+			std::printf("unimplemented EntityAction: leave bed\n");
+			break;
 
-				_playerState.heldItemSlot = (UInt8)packet.slot;
-				// TODO: relay to other clients
-				break;
+		case 3: // start sprinting
+			if(packet.entityId != _playerState.entityId)
+			{
+				disconnect("EntityAction: invalid entity id for action 'start sprinting'");
+				return;
 			}
 
-			case PacketAnimationClient::ID:
+			if(_playerState.sprinting)
+				disconnect("EntityAction: already sprinting");
+			else
 			{
-				PacketAnimationClient packet;
-
-				if(!deserializePacketPayload(frame.data, &packet))
-				{
-					disconnect();
-					break;
-				}
+				setPose(_playerState.crouching, true);
+				sendMetadataUpdate();
+			}
 
-				if(packet.hand != 0 && packet.hand != 1)
-				{
-					disconnect("Animation: invalid hand");
-					break;
-				}
+			break;
 
-				PacketEntityAnimation animation;
-				animation.entityId = _playerState.entityId;
-				animation.animationId = packet.hand == 0 ? 0 : 3;
-				broadcastLocally(animation, false);
-				break;
+		case 4:
+			if(packet.entityId != _playerState.entityId)
+			{
+				disconnect("EntityAction: invalid entity id for action 'stop sprinting'");
+				return;
 			}
 
-			case PacketUseItem::ID:
+			if(!_playerState.sprinting)
+				disconnect("EntityAction: not sprinting");
+			else
 			{
-				PacketUseItem packet;
+				setPose(_playerState.crouching, false);
+				sendMetadataUpdate();
+			}
 
-				if(!deserializePacketPayload(frame.data, &packet))
-				{
-					disconnect();
-					return;
-				}
+			break;
 
-				if(packet.hand != 0 && packet.hand != 1)
-				{
-					disconnect("PacketUseItem: invalid hand");
-					return;
-				}
+		case 5:
+			std::printf("unimplemented EntityAction: start jump with horse\n");
+			break;
 
-				// TODO: implement
-				break;
-			}
+		case 6:
+			std::printf("unimplemented EntityAction: stop jump with horse\n");
+			break;
 
-			default:
-				std::printf("unhandled packet in phase PLAY: ");
-				debugPrint(frame);
-				break;
-			}
+		case 7:
+			std::printf("unimplemented EntityAction: open horse inventory\n");
 			break;
 
-		case ClientPhase::STATUS:
-			disconnect();
+		case 8:
+			std::printf("unimplemented EntityAction: start flying with elytra\n");
 			break;
+
+		default:
+			disconnect("EntityAction: invalid action id: " + std::to_string(packet.actionId));
+			break;
+		}
+	}
+
+	void StateMachine::handlePacket(PhaseConstant<ClientPhase::PLAY>, PacketHeldItemChangeClient const& packet)
+	{
+		if(packet.slot < 0 || packet.slot > 8)
+		{
+			disconnect("HeldItemChange: invalid slot id");
+			return;
+		}
+
+		_playerState.heldItemSlot = (UInt8)packet.slot;
+		// TODO: relay to other clients
+	}
+
+	void StateMachine::handlePacket(PhaseConstant<ClientPhase::PLAY>, PacketAnimationClient const& packet)
+	{
+		if(packet.hand != 0 && packet.hand != 1)
+		{
+			disconnect("Animation: invalid hand");
+			return;
+		}
+
+		PacketEntityAnimation animation;
+		animation.entityId = _playerState.entityId;
+		animation.animationId = packet.hand == 0 ? 0 : 3;
+		broadcastLocally(animation, false, SendPolicy{true});
+	}
+
+	void StateMachine::handlePacket(PhaseConstant<ClientPhase::PLAY>, PacketUseItem const& packet)
+	{
+		if(packet.hand != 0 && packet.hand != 1)
+		{
+			disconnect("PacketUseItem: invalid hand");
+			return;
 		}
+
+		// TODO: implement
+	}
+
+	void StateMachine::onBytesReceived(Span<UInt8 const> data)
+	{
+		_reader.onBytesReceived(data);
 	}
 
 	void StateMachine::onClientSettingsChange(PacketClientSettings const& packet)
@@ -802,36 +732,6 @@ namespace vitamine::proxyd
 		}
 	}
 
-	static
-	std::unique_ptr<Chunk> generateChunk()
-	{
-		auto chunk = std::make_unique<Chunk>();
-		chunk->sections[0] = std::make_unique<ChunkSection>();
-
-		for(UInt8 x = 0; x != 16; ++x)
-		for(UInt8 z = 0; z != 16; ++z)
-			chunk->sections[0]->blocks[0][z][x] = BLOCKID_MINECRAFT_BEDROCK;
-
-		for(UInt8 x = 0; x != 16; ++x)
-		for(UInt8 z = 0; z != 16; ++z)
-		for(UInt8 y = 1; y != 14; ++y)
-			chunk->sections[0]->blocks[y][z][x] = BLOCKID_MINECRAFT_STONE;
-
-		for(UInt8 x = 0; x != 16; ++x)
-		for(UInt8 z = 0; z != 16; ++z)
-			chunk->sections[0]->blocks[14][z][x] = BLOCKID_MINECRAFT_DIRT;
-
-		for(UInt8 x = 0; x != 16; ++x)
-		for(UInt8 z = 0; z != 16; ++z)
-			chunk->sections[0]->blocks[15][z][x] = BLOCKID_MINECRAFT_GRASS_BLOCK;
-
-		for(UInt8 x = 0; x != 16; ++x)
-		for(UInt8 z = 0; z != 16; ++z)
-			chunk->heightmap[z][x] = 16;
-
-		return chunk;
-	}
-
 	Chunk* StateMachine::getOrCreateChunk(ChunkCoord coord)
 	{
 		{
@@ -844,69 +744,32 @@ namespace vitamine::proxyd
 		}
 
 		auto chunk = generateChunk();
-		auto result = &*chunk;
 
+		// another thread may have generated the same chunk in the meantime, the first one wins
 		std::lock_guard guard(_globalState->chunkMutex);
-		_globalState->chunks[coord] = std::move(chunk);
-		return result;
+		return &*_globalState->chunks.try_emplace(coord, std::move(chunk)).first->second;
 	}
 
 	void StateMachine::sendChunk(ChunkCoord coord)
 	{
 		auto chunk = getOrCreateChunk(coord);
-		std::lock_guard guard(chunk->mutex);
-
-		UInt16 bitmask = 0;
-		UInt sectionCount = 0;
-
-		for(auto i = 0; i != 16; ++i)
-			if(chunk->sections[i])
-			{
-				bitmask |= 1 << i;
-				++sectionCount;
-			}
-
-		Int64 heightmap[36];
-		bitpack16to9(&chunk->heightmap[0][0], sizeof chunk->heightmap / sizeof chunk->heightmap[0][0], (UInt8*)heightmap);
+		std::unique_lock guard(chunk->mutex);
 
-		Nbt heightmapNbt;
-		heightmapNbt.type = NbtType::LONG_ARRAY;
-		heightmapNbt.name = spanFromCString("MOTION_BLOCKING");
-		heightmapNbt.value.ai64 = spanFromArray(heightmap);
-
-		Buffer buffer;
-
-		for(auto& section : chunk->sections)
+		if(chunk->cachedPacket && chunk->cachedPacketVersion == chunk->version && chunk->cachedPacketCompressionThreshold == _compressionThreshold)
 		{
-			if(!section)
-				continue;
-
-			serializeInt(buffer, (UInt16)(16 * 16 * 16)); // block count
-			serializeInt(buffer, (UInt8)14); // bits per block
-			// no palette
-
-			Int64 data[16 * 16 * 16 * 14 / 64];
-			bitpack16to14(&section->blocks[0][0][0], sizeof section->blocks / 2, (UInt8*)data);
-
-			serializeVarInt(buffer, (Int32)(sizeof data / sizeof *data)); // length of data array in longs
-
-			for(auto i : data)
-				serializeInt(buffer, i);
+			auto packet = chunk->cachedPacket;
+			guard.unlock();
+			sendPacket(packet);
+			return;
 		}
 
-		for(int i = 0; i != 16; ++i)
-			for(int j = 0; j != 16; ++j)
-				serializeInt(buffer, chunk->biomes[i][j]);
-
-		PacketChunkData chunkData;
-		chunkData.x = coord.x;
-		chunkData.z = coord.z;
-		chunkData.fullChunk = true;
-		chunkData.primaryBitmask = bitmask;
-		chunkData.heightmaps.value.compound = Span(&heightmapNbt, 1);
-		chunkData.data = Span((UInt8 const*)buffer.data(), buffer.size());
-		chunkData.blockEntities = {};
-		sendPacket(chunkData);
+		auto packet = SharedBuffer(serializeChunkPacket(*chunk, coord, _compressionThreshold));
+		chunk->cachedPacket = packet;
+		chunk->cachedPacketVersion = chunk->version;
+		chunk->cachedPacketCompressionThreshold = _compressionThreshold;
+		guard.unlock();
+
+		sendPacket(packet);
 	}
 
 	void StateMachine::onMove(EntityCoord oldPosition, bool rotate)
@@ -918,36 +781,47 @@ namespace vitamine::proxyd
 			onChunkTransition(oldChunk, newChunk, oldPosition, rotate);
 		else
 		{
-			PacketEntityHeadLook packet;
-			packet.entityId = _playerState.entityId;
-			packet.headYaw = _playerState.yaw * 256 / 360;
+			auto movePacket = createMovePacket(oldPosition, rotate);
+			auto teleportPacket = SharedBuffer();
+			auto headLookPacket = rotate ? createHeadLookPacket(_playerState) : SharedBuffer();
 
 			auto lock = _globalState->playerTracker.lock();
-			broadcastLocallyUnsafe(createMovePacket(oldPosition, rotate), false);
 
-			if(rotate)
-				broadcastLocallyUnsafe(packet, false);
+			for(auto& sub : _globalState->playerTracker.subscribers(newChunk))
+				if(sub != this)
+					sendMovement(sub, movePacket, teleportPacket, headLookPacket);
 		}
 	}
 
-	Buffer StateMachine::createMovePacket(EntityCoord oldPosition, bool rotate)
+	// movement packets are only valid relative to the previous position, so they cannot be dropped or merged
+	// receivers that do not keep up get absolute positions instead, which replace each other in the write queue
+	void StateMachine::sendMovement(StateMachine* receiver, SharedBuffer const& movePacket, SharedBuffer& teleportPacket, SharedBuffer const& headLookPacket)
+	{
+		auto& connection = receiver->_connection;
+		auto key = (UInt64)(UInt32)_playerState.entityId << 1;
+
+		if(connection->writeQueueDepth().congested)
+		{
+			if(!teleportPacket)
+				teleportPacket = createTeleportPacket(_playerState);
+
+			connection->send(teleportPacket, SendPolicy{false, key | 1});
+		}
+		else
+			connection->send(movePacket);
+
+		if(headLookPacket)
+			connection->send(headLookPacket, SendPolicy{false, key | 2});
+	}
+
+	SharedBuffer StateMachine::createMovePacket(EntityCoord oldPosition, bool rotate)
 	{
 		auto diff = (_playerState.position - oldPosition) * 4096;
 		Float64 min = -32768;
 		Float64 max =  32767;
 
 		if(!diff.withinOrdered(EntityCoord{min, min, min}, EntityCoord{max, max, max}))
-		{
-			PacketEntityTeleport packet;
-			packet.entityId = _playerState.entityId;
-			packet.x = _playerState.position.x;
-			packet.y = _playerState.position.y;
-			packet.z = _playerState.position.z;
-			packet.yaw = _playerState.yaw * 256 / 360;
-			packet.pitch = _playerState.pitch * 256 / 360;
-			packet.onGround = false;
-			return serializePacket(packet);
-		}
+			return createTeleportPacket(_playerState);
 
 		if(rotate)
 		{
@@ -959,7 +833,7 @@ namespace vitamine::proxyd
 			packet.yaw = _playerState.yaw * 256 / 360;
 			packet.pitch = _playerState.pitch * 256 / 360;
 			packet.onGround = false;
-			return serializePacket(packet);
+			return SharedBuffer(serializeFramed(packet));
 		}
 
 		PacketEntityMove packet;
@@ -968,10 +842,31 @@ namespace vitamine::proxyd
 		packet.dy = diff.y;
 		packet.dz = diff.z;
 		packet.onGround = false;
-		return serializePacket(packet);
+		return SharedBuffer(serializeFramed(packet));
+	}
+
+	SharedBuffer StateMachine::createTeleportPacket(PlayerState const& state) const
+	{
+		PacketEntityTeleport packet;
+		packet.entityId = state.entityId;
+		packet.x = state.position.x;
+		packet.y = state.position.y;
+		packet.z = state.position.z;
+		packet.yaw = state.yaw * 256 / 360;
+		packet.pitch = state.pitch * 256 / 360;
+		packet.onGround = false;
+		return SharedBuffer(serializeFramed(packet));
+	}
+
+	SharedBuffer StateMachine::createHeadLookPacket(PlayerState const& state) const
+	{
+		PacketEntityHeadLook packet;
+		packet.entityId = state.entityId;
+		packet.headYaw = state.yaw * 256 / 360;
+		return SharedBuffer(serializeFramed(packet));
 	}
 
-	Buffer StateMachine::createSpawnPacket(PlayerState const& state)
+	SharedBuffer StateMachine::createSpawnPacket(PlayerState const& state) const
 	{
 		PacketSpawnPlayer spawn;
 		spawn.entityId = state.entityId;
@@ -990,15 +885,24 @@ namespace vitamine::proxyd
 		if(state.sprinting)
 			flags |= 0x08;
 
-		spawn.metadata.push_back(EntityMetadata{0, EntityMetadataType::BYTE, flags});
-		return serializePacket(spawn);
+		EntityMetadata metadata[] = {{0, EntityMetadataType::BYTE, flags}};
+		spawn.metadata = spanFromArray(metadata);
+		return SharedBuffer(serializeFramed(spawn));
 	}
 
-	Buffer StateMachine::createDespawnPacket(PlayerState const& state)
+	SharedBuffer StateMachine::createDespawnPacket(PlayerState const& state) const
 	{
 		PacketDestroyEntities destroy;
-		destroy.entityIds.push_back({state.entityId});
-		return serializePacket(destroy);
+		Int32 entityIds[] = {state.entityId};
+		destroy.entityIds = spanFromArray(entityIds);
+		return SharedBuffer(serializeFramed(destroy));
+	}
+
+	void StateMachine::setPose(bool crouching, bool sprinting)
+	{
+		auto lock = _globalState->playerTracker.lock();
+		_playerState.crouching = crouching;
+		_playerState.sprinting = sprinting;
 	}
 
 	void StateMachine::sendMetadataUpdate()
@@ -1014,10 +918,15 @@ namespace vitamine::proxyd
 		if(_playerState.sprinting)
 			flags |= 0x08;
 
-		packet.metadata.push_back(EntityMetadata{0, EntityMetadataType::BYTE, flags});
-
 		auto pose = _playerState.crouching ? EntityMetadataPose::CROUCHING : EntityMetadataPose::STANDING;
-		packet.metadata.push_back(EntityMetadata{6, EntityMetadataType::POSE, pose});
+
+		EntityMetadata metadata[] =
+		{
+			{0, EntityMetadataType::BYTE, flags},
+			{6, EntityMetadataType::POSE, pose},
+		};
+
+		packet.metadata = spanFromArray(metadata);
 
 		broadcastLocally(packet, false);
 	}
@@ -1063,28 +972,21 @@ namespace vitamine::proxyd
 
 		auto fromSubs = _globalState->playerTracker.subscribers(from);
 		auto toSubs = _globalState->playerTracker.subscribers(to);
-		lock.unlock();
 
+		// the lock is held until all packets are sent, since subscribers may leave concurrently on other reactor threads
 		auto movePacket = createMovePacket(oldPosition, rotate);
+		auto teleportPacket = SharedBuffer();
+		auto headLookPacket = rotate ? createHeadLookPacket(_playerState) : SharedBuffer();
 		auto spawnPacket = createSpawnPacket(_playerState);
 		auto despawnPacket = createDespawnPacket(_playerState);
 
-		PacketEntityHeadLook headLookPacket;
-		headLookPacket.entityId = _playerState.entityId;
-		headLookPacket.headYaw = _playerState.yaw * 256 / 360;
-
 		for(auto& sub : fromSubs)
 		{
 			if(sub == this)
 				continue;
 
 			if(toSubs.find(sub) != toSubs.end())
-			{
-				sub->sendPacket(movePacket);
-
-				if(rotate)
-					sub->sendPacket(headLookPacket);
-			}
+				sendMovement(sub, movePacket, teleportPacket, headLookPacket);
 			else
 				sub->sendPacket(despawnPacket);
 		}
@@ -1101,7 +1003,7 @@ namespace vitamine::proxyd
 
 	void StateMachine::onTick()
 	{
-		auto currentTime = _globalState->clock.now();
+		auto currentTime = _globalState->clock->now();
 
 		if(currentTime - _lastPacketTime >= CLIENT_READ_TIMEOUT_NANOS)
 		{
@@ -1124,10 +1026,12 @@ namespace vitamine::proxyd
 
 	StateMachine::~StateMachine()
 	{
-		if(_phase == ClientPhase::PLAY)
+		// players are added to the player list during login, but only enter the player tracker when spawning
+		if(_phase == ClientPhase::PLAY_INIT || _phase == ClientPhase::PLAY)
 		{
 			std::printf("player from %s left\n", _connection->endpoint().c_str());
 
+			if(_phase == ClientPhase::PLAY)
 			{
 				auto coord = coord_cast<ChunkCoord>(_playerState.position);
 				auto vd = _playerState.clientSettings.viewDistance;
@@ -1146,7 +1050,7 @@ namespace vitamine::proxyd
 
 				PacketPlayerInfo playerInfo;
 				playerInfo.action = PacketPlayerInfo::REMOVE_PLAYER;
-				playerInfo.entries.push_back(entry);
+				playerInfo.entries = Span(&entry, 1);
 
 				std::lock_guard guard(_globalState->playersMutex);
 				_globalState->players.erase(this);
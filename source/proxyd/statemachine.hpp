@@ -1,20 +1,27 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
 #include <atomic>
 #include <memory>
+#include <optional>
 #include <string>
+#include <type_traits>
 
 #include <boost/container/flat_set.hpp>
 #include <boost/uuid/uuid.hpp>
 #include <boost/uuid/uuid_io.hpp>
 
+#include <common/arena.hpp>
 #include <common/buffer.hpp>
 #include <common/clock.hpp>
 #include <common/coord.hpp>
+#include <common/sharedbuffer.hpp>
 #include <common/span.hpp>
 #include <common/types.hpp>
 #include <common/vector.hpp>
 #include <common/net/connection.hpp>
+#include <proxyd/authentication.hpp>
 #include <proxyd/chat.hpp>
 #include <proxyd/deserialize.hpp>
 #include <proxyd/framing.hpp>
@@ -32,16 +39,40 @@ namespace vitamine::proxyd
 		INITIAL,
 
 		LOGIN,
+		LOGIN_ENCRYPTION,
+		LOGIN_VERIFICATION,
 		PLAY_INIT,
 		PLAY,
 
 		STATUS,
 	};
 
+	constexpr UInt CLIENT_PHASE_COUNT = (UInt)ClientPhase::STATUS + 1;
+
+	// selects the handler for a packet that is accepted in several phases
+	template <ClientPhase Phase>
+	using PhaseConstant = std::integral_constant<ClientPhase, Phase>;
+
+	namespace detail
+	{
+		constexpr PacketId maxHandledPacketId()
+		{
+			PacketId max = 0;
+
+#define PACKET_HANDLER(phase, name) max = std::max(max, Packet##name::ID);
+#include <proxyd/handlers.def>
+
+			return max;
+		}
+	}
+
+	// dispatch tables are indexed by packet id, ids past the end are unhandled in every phase
+	constexpr UInt PACKET_DISPATCH_TABLE_SIZE = detail::maxHandledPacketId() + 1;
+
 	struct ClientSettings
 	{
 		std::string locale;
-		UInt8 viewDistance;
+		UInt8 viewDistance = 0;
 		ChatMode chatMode;
 		bool chatColorsEnabled;
 		UInt8 displayedSkinParts;
@@ -94,20 +125,29 @@ namespace vitamine::proxyd
 		}
 	};
 
-	class StateMachine
+	class StateMachine : public std::enable_shared_from_this<StateMachine>
 	{
 		GlobalState* _globalState;
 
 		std::shared_ptr<IConnection> _connection;
-		PacketReader _reader;
+		PacketReader<StateMachine> _reader;
 
 		std::atomic<ClientPhase> _phase = ClientPhase::INITIAL;
 
+		// negative until compression has been negotiated during login
+		// broadcasts only happen between logged in players, so every recipient uses the sender's threshold
+		std::atomic<Int32> _compressionThreshold = -1;
+
 		std::atomic<Int64> _lastPacketTime;
 		std::atomic<Int64> _lastKeepAliveSentTime;
 
+		// owned by this connection's reactor, but other reactors read position, rotation and pose when spawning this player
+		// those fields are only written with the player tracker lock held, the readers hold it as well
 		PlayerState _playerState;
 
+		// sent in the encryption request, the client has to return it encrypted with the server's public key
+		UInt8 _verifyToken[VERIFY_TOKEN_SIZE];
+
 		void disconnect()
 		{
 			_connection->disconnect();
@@ -133,18 +173,35 @@ namespace vitamine::proxyd
 			disconnect();
 		}
 
-		void sendPacket(Buffer const& buffer)
+		template <typename OutputBuffer = Buffer, typename Packet>
+		OutputBuffer serializeFramed(Packet const& packet) const
+		{
+			return serializePacket<OutputBuffer>(packet, _compressionThreshold);
+		}
+
+		void sendPacket(SharedBuffer const& buffer)
 		{
 			_connection->send(buffer);
 		}
 
+		void sendPacket(Buffer&& buffer)
+		{
+			sendPacket(SharedBuffer(std::move(buffer)));
+		}
+
+		void sendPacket(SegmentedBuffer&& buffer)
+		{
+			sendPacket(SharedBuffer(std::move(buffer)));
+		}
+
 		template <typename Packet>
 		void sendPacket(Packet const& packet)
 		{
-			sendPacket(serializePacket(packet));
+			sendPacket(serializeFramed(packet));
 		}
 
-		void broadcastGloballyUnsafe(Buffer const& buffer, bool includeSelf)
+		// broadcasts serialize the packet once, all recipients share the same buffer
+		void broadcastGloballyUnsafe(SharedBuffer const& buffer, bool includeSelf)
 		{
 			for(auto& player : _globalState->players)
 				if(includeSelf || player != this)
@@ -154,59 +211,110 @@ namespace vitamine::proxyd
 		template <typename Packet>
 		void broadcastGloballyUnsafe(Packet const& packet, bool includeSelf)
 		{
-			auto buffer = serializePacket(packet);
+			auto buffer = SharedBuffer(serializeFramed(packet));
 			broadcastGloballyUnsafe(buffer, includeSelf);
 		}
 
-		void broadcastLocallyUnsafe(Buffer const& buffer, bool includeSelf)
+		void broadcastLocallyUnsafe(SharedBuffer const& buffer, bool includeSelf, SendPolicy policy = {})
 		{
 			auto coord = coord_cast<ChunkCoord>(_playerState.position);
 
 			for(auto& player : _globalState->playerTracker.subscribers(coord))
 				if(includeSelf || player != this)
-					player->_connection->send(buffer);
+					player->_connection->send(buffer, policy);
 		}
 
 		template <typename Packet>
-		void broadcastLocallyUnsafe(Packet const& packet, bool includeSelf)
+		void broadcastLocallyUnsafe(Packet const& packet, bool includeSelf, SendPolicy policy = {})
 		{
-			auto buffer = serializePacket(packet);
-			broadcastLocallyUnsafe(buffer, includeSelf);
+			auto buffer = SharedBuffer(serializeFramed(packet));
+			broadcastLocallyUnsafe(buffer, includeSelf, policy);
 		}
 
-		void broadcastLocally(Buffer const& buffer, bool includeSelf)
+		void broadcastLocally(SharedBuffer const& buffer, bool includeSelf, SendPolicy policy = {})
 		{
 			auto lock = _globalState->playerTracker.lock();
-			broadcastLocallyUnsafe(buffer, includeSelf);
+			broadcastLocallyUnsafe(buffer, includeSelf, policy);
 		}
 
 		template <typename Packet>
-		void broadcastLocally(Packet const& packet, bool includeSelf)
+		void broadcastLocally(Packet const& packet, bool includeSelf, SendPolicy policy = {})
 		{
-			auto buffer = serializePacket(packet);
-			broadcastLocally(buffer, includeSelf);
+			auto buffer = SharedBuffer(serializeFramed(packet));
+			broadcastLocally(buffer, includeSelf, policy);
 		}
 
 		void sendChunk(ChunkCoord coord);
 
+		// sends the initial state of the world once the player is authenticated
+		void completeLogin();
+
+		friend class PacketReader<StateMachine>;
+
+		// decodes the payload and passes it to the handler, disconnects if the payload is invalid
+		using PacketThunk = void (*)(StateMachine* self, Span<UInt8 const> payload);
+		using PacketDispatchTable = std::array<PacketThunk, PACKET_DISPATCH_TABLE_SIZE>;
+
+		// generated from handlers.def, one per client phase
+		static std::array<PacketDispatchTable, CLIENT_PHASE_COUNT> const DISPATCH_TABLES;
+
+		static constexpr PacketDispatchTable makeDispatchTable(ClientPhase phase);
+
+		// variable size fields are decoded into the thread's arena, which is rewound once the handler returns
+		template <ClientPhase Phase, typename Packet>
+		static void dispatchPacket(StateMachine* self, Span<UInt8 const> payload)
+		{
+			auto& arena = threadArena();
+			ArenaScope scope(arena);
+
+			Packet packet;
+
+			if(!deserializePacketPayload(payload, &packet, arena))
+			{
+				self->disconnect();
+				return;
+			}
+
+			self->handlePacket(PhaseConstant<Phase>(), packet);
+		}
+
+#define PACKET_HANDLER(phase, name) void handlePacket(PhaseConstant<ClientPhase::phase>, Packet##name const& packet);
+#include <proxyd/handlers.def>
+
 		void onPacket(PacketFrame frame);
+		void onUnhandledPacket(ClientPhase phase, PacketFrame frame);
+
+		void onInvalidFrame()
+		{
+			disconnect();
+		}
+
 		void onClientSettingsChange(PacketClientSettings const& packet);
 
-		Buffer createMovePacket(EntityCoord oldPosition, bool rotate);
+		SharedBuffer createMovePacket(EntityCoord oldPosition, bool rotate);
+
+		SharedBuffer createTeleportPacket(PlayerState const& state) const;
+
+		SharedBuffer createHeadLookPacket(PlayerState const& state) const;
 
-		static
-		Buffer createSpawnPacket(PlayerState const& state);
+		SharedBuffer createSpawnPacket(PlayerState const& state) const;
 
-		static
-		Buffer createDespawnPacket(PlayerState const& state);
+		SharedBuffer createDespawnPacket(PlayerState const& state) const;
+
+		// takes the player tracker lock, see _playerState
+		void setPose(bool crouching, bool sprinting);
 
 		void sendMetadataUpdate();
 
+		void sendMovement(StateMachine* receiver, SharedBuffer const& movePacket, SharedBuffer& teleportPacket, SharedBuffer const& headLookPacket);
+
 		void onMove(EntityCoord oldPosition, bool rotate);
 		void onChunkTransition(ChunkCoord from, ChunkCoord to, EntityCoord oldPosition, bool rotate);
 
 		Chunk* getOrCreateChunk(ChunkCoord coord);
 
+		void onSessionVerified(std::optional<SessionProfile> const& profile);
+
 	public:
 		StateMachine(StateMachine const&) = delete;
 		StateMachine& operator=(StateMachine const&) = delete;
@@ -215,17 +323,15 @@ namespace vitamine::proxyd
 
 		StateMachine(GlobalState* globalState, std::shared_ptr<IConnection> const& connection)
 		: _globalState(globalState), _connection(connection)
-		, _reader([this](auto frame){ onPacket(frame); }, [connection]{ connection->disconnect(); })
-		, _lastPacketTime(_globalState->clock.now()), _lastKeepAliveSentTime(0)
+		, _reader(this)
+		, _lastPacketTime(_globalState->clock->now()), _lastKeepAliveSentTime(0)
 		{}
 
 		~StateMachine();
 
 		void onTick();
 
-		void onBytesReceived(Span<UInt8 const> data)
-		{
-			_reader.onBytesReceived(data);
-		}
+		// defined next to onPacket so the reader's loop can inline the dispatch
+		void onBytesReceived(Span<UInt8 const> data);
 	};
 }
@@ -0,0 +1,65 @@
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include <common/aescfb8.hpp>
+
+using namespace vitamine;
+
+// encrypted connections pass every byte through the cipher, the argument is the size of one send
+static
+void benchAesCfb8Encrypt(benchmark::State& state)
+{
+	UInt8 key[AES_CFB8_KEY_SIZE] = {0x13, 0x37};
+	AesCfb8 cipher(spanFromArray(key));
+
+	std::vector<UInt8> data(state.range(0), 0x5a);
+
+	for(auto _ : state)
+	{
+		cipher.encrypt(data.data(), data.data(), data.size());
+		benchmark::ClobberMemory();
+	}
+
+	state.SetBytesProcessed(state.iterations() * data.size());
+	state.SetLabel(AesCfb8::hardwareAccelerated() ? "aes-ni" : "openssl");
+}
+
+BENCHMARK(benchAesCfb8Encrypt)->Arg(64)->Arg(4096)->Arg(65536);
+
+static
+void benchAesCfb8Decrypt(benchmark::State& state)
+{
+	UInt8 key[AES_CFB8_KEY_SIZE] = {0x13, 0x37};
+	AesCfb8 cipher(spanFromArray(key));
+
+	std::vector<UInt8> data(state.range(0), 0x5a);
+
+	for(auto _ : state)
+	{
+		cipher.decrypt(data.data(), data.data(), data.size());
+		benchmark::ClobberMemory();
+	}
+
+	state.SetBytesProcessed(state.iterations() * data.size());
+	state.SetLabel(AesCfb8::hardwareAccelerated() ? "aes-ni" : "openssl");
+}
+
+BENCHMARK(benchAesCfb8Decrypt)->Arg(64)->Arg(4096)->Arg(65536);
+
+// plaintext baseline, what an unencrypted connection pays for the same send
+static
+void benchPlaintextCopy(benchmark::State& state)
+{
+	std::vector<UInt8> in(state.range(0), 0x5a), out(state.range(0));
+
+	for(auto _ : state)
+	{
+		std::copy(in.begin(), in.end(), out.begin());
+		benchmark::ClobberMemory();
+	}
+
+	state.SetBytesProcessed(state.iterations() * in.size());
+}
+
+BENCHMARK(benchPlaintextCopy)->Arg(64)->Arg(4096)->Arg(65536);
@@ -0,0 +1,47 @@
+#include <benchmark/benchmark.h>
+
+#include <proxyd/bitpack.hpp>
+#include <proxyd/chunk.hpp>
+
+using namespace vitamine;
+using namespace vitamine::proxyd;
+
+static
+void benchBitpack16to14(benchmark::State& state)
+{
+	auto chunk = generateChunk();
+	auto& blocks = chunk->sections[0]->blocks;
+
+	Int64 out[16 * 16 * 16 * 14 / 64];
+
+	for(auto _ : state)
+	{
+		bitpack16to14(&blocks[0][0][0], sizeof blocks / 2, (UInt8*)out);
+		benchmark::DoNotOptimize(out);
+		benchmark::ClobberMemory();
+	}
+
+	state.SetBytesProcessed(state.iterations() * sizeof blocks);
+}
+
+BENCHMARK(benchBitpack16to14);
+
+static
+void benchBitpack16to9(benchmark::State& state)
+{
+	auto chunk = generateChunk();
+	auto& heightmap = chunk->heightmap;
+
+	Int64 out[36];
+
+	for(auto _ : state)
+	{
+		bitpack16to9(&heightmap[0][0], sizeof heightmap / 2, (UInt8*)out);
+		benchmark::DoNotOptimize(out);
+		benchmark::ClobberMemory();
+	}
+
+	state.SetBytesProcessed(state.iterations() * sizeof heightmap);
+}
+
+BENCHMARK(benchBitpack16to9);
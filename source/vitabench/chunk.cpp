@@ -0,0 +1,28 @@
+#include <benchmark/benchmark.h>
+
+#include <proxyd/chunk.hpp>
+
+using namespace vitamine;
+using namespace vitamine::proxyd;
+
+// encoding of a chunk data packet as done by sendChunk when the cached packet is stale
+// the argument is the compression threshold, -1 disables compression
+static
+void benchSerializeChunkPacket(benchmark::State& state)
+{
+	auto chunk = generateChunk();
+	auto threshold = (Int32)state.range(0);
+	UInt size = 0;
+
+	for(auto _ : state)
+	{
+		auto packet = serializeChunkPacket(*chunk, {0, 0}, threshold);
+		size = packet.size();
+		benchmark::DoNotOptimize(packet);
+	}
+
+	state.SetItemsProcessed(state.iterations());
+	state.counters["frameSize"] = (double)size;
+}
+
+BENCHMARK(benchSerializeChunkPacket)->Arg(-1)->Arg(256)->Unit(benchmark::kMicrosecond);
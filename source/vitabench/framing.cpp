@@ -0,0 +1,202 @@
+#include <boost/uuid/random_generator.hpp>
+
+#include <benchmark/benchmark.h>
+
+#include <common/arena.hpp>
+#include <common/buffer.hpp>
+#include <proxyd/entitymetadata.hpp>
+#include <proxyd/framing.hpp>
+#include <proxyd/packets.hpp>
+
+using namespace vitamine;
+using namespace vitamine::proxyd;
+
+constexpr UInt FRAME_COUNT = 256;
+
+// a stream of movement packets, the most common serverbound traffic
+static
+Buffer movementStream()
+{
+	Buffer stream;
+
+	for(UInt i = 0; i != FRAME_COUNT; ++i)
+	{
+		PacketPlayerPositionRotationClient packet;
+		packet.x = 0.5 * i;
+		packet.y = 64;
+		packet.z = -0.25 * i;
+		packet.yaw = 90;
+		packet.pitch = 10;
+		packet.onGround = true;
+
+		auto frame = serializePacket(packet);
+		stream.write(frame.data(), frame.size());
+	}
+
+	return stream;
+}
+
+static
+void benchDeserializePacketFrame(benchmark::State& state)
+{
+	auto stream = movementStream();
+
+	for(auto _ : state)
+	{
+		auto bufp = (UInt8 const*)stream.data();
+		auto size = stream.size();
+
+		for(UInt i = 0; i != FRAME_COUNT; ++i)
+		{
+			PacketFrame frame;
+
+			if(deserializePacketFrame(&bufp, &size, &frame) != DeserializeStatus::OK)
+			{
+				state.SkipWithError("invalid frame");
+				return;
+			}
+
+			benchmark::DoNotOptimize(frame);
+		}
+	}
+
+	state.SetItemsProcessed(state.iterations() * FRAME_COUNT);
+	state.SetBytesProcessed(state.iterations() * stream.size());
+}
+
+BENCHMARK(benchDeserializePacketFrame);
+
+// frame and payload, as done for every packet a client sends
+static
+void benchDeserializeMovementPacket(benchmark::State& state)
+{
+	auto stream = movementStream();
+	auto& arena = threadArena();
+
+	for(auto _ : state)
+	{
+		auto bufp = (UInt8 const*)stream.data();
+		auto size = stream.size();
+
+		for(UInt i = 0; i != FRAME_COUNT; ++i)
+		{
+			ArenaScope scope(arena);
+
+			PacketFrame frame;
+			PacketPlayerPositionRotationClient packet;
+
+			if(deserializePacketFrame(&bufp, &size, &frame) != DeserializeStatus::OK
+			|| !deserializePacketPayload(frame.data, &packet, arena))
+			{
+				state.SkipWithError("invalid packet");
+				return;
+			}
+
+			benchmark::DoNotOptimize(packet);
+		}
+	}
+
+	state.SetItemsProcessed(state.iterations() * FRAME_COUNT);
+}
+
+BENCHMARK(benchDeserializeMovementPacket);
+
+template <typename Packet>
+static
+void benchSerializePacket(benchmark::State& state, Packet const& packet)
+{
+	UInt size = 0;
+
+	for(auto _ : state)
+	{
+		auto buffer = serializePacket(packet, (Int32)state.range(0));
+		size = buffer.size();
+		benchmark::DoNotOptimize(buffer.data());
+	}
+
+	state.SetItemsProcessed(state.iterations());
+	state.counters["frameSize"] = (double)size;
+}
+
+// fixed size, broadcast for every movement
+static
+void benchSerializeEntityTeleport(benchmark::State& state)
+{
+	PacketEntityTeleport packet;
+	packet.entityId = 1234;
+	packet.x = 100.5;
+	packet.y = 64;
+	packet.z = -200.25;
+	packet.yaw = 64;
+	packet.pitch = 0;
+	packet.onGround = true;
+
+	benchSerializePacket(state, packet);
+}
+
+BENCHMARK(benchSerializeEntityTeleport)->Arg(-1)->Arg(256);
+
+static
+void benchSerializeChat(benchmark::State& state)
+{
+	auto message = std::string(R"({"translate":"chat.type.text","with":[{"text":"Player"},{"text":"hello there, how is everyone doing today?"}]})");
+
+	PacketChatServer packet;
+	packet.chat = spanFromStdString(message);
+	packet.position = 0;
+
+	benchSerializePacket(state, packet);
+}
+
+BENCHMARK(benchSerializeChat)->Arg(-1)->Arg(64);
+
+static
+void benchSerializeEntityMetadata(benchmark::State& state)
+{
+	EntityMetadata metadata[] =
+	{
+		{0, EntityMetadataType::BYTE, (UInt8)0x0a},
+		{6, EntityMetadataType::POSE, EntityMetadataPose::CROUCHING},
+	};
+
+	PacketEntityMetadata packet;
+	packet.entityId = 1234;
+	packet.metadata = spanFromArray(metadata);
+
+	benchSerializePacket(state, packet);
+}
+
+BENCHMARK(benchSerializeEntityMetadata)->Arg(-1)->Arg(256);
+
+// the player list a joining player receives on a busy server
+static
+void benchSerializePlayerInfo(benchmark::State& state)
+{
+	constexpr UInt PLAYER_COUNT = 64;
+
+	std::vector<std::string> names;
+	std::vector<PacketPlayerInfo::Entry> entries;
+	boost::uuids::random_generator uuidGenerator;
+
+	for(UInt i = 0; i != PLAYER_COUNT; ++i)
+		names.push_back("Player" + std::to_string(i));
+
+	for(UInt i = 0; i != PLAYER_COUNT; ++i)
+	{
+		PacketPlayerInfo::AddPlayer addPlayer = {};
+		addPlayer.name = spanFromStdString(names[i]);
+		addPlayer.gameMode = 1;
+		addPlayer.ping = 50;
+		addPlayer.hasDisplayName = false;
+
+		entries.push_back({uuidGenerator(), addPlayer});
+	}
+
+	PacketPlayerInfo packet;
+	packet.action = PacketPlayerInfo::ADD_PLAYER;
+	packet.entries = Span<PacketPlayerInfo::Entry const>(entries.data(), entries.size());
+
+	benchSerializePacket(state, packet);
+}
+
+BENCHMARK(benchSerializePlayerInfo)->Arg(-1)->Arg(256);
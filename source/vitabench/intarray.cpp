@@ -0,0 +1,63 @@
+#include <benchmark/benchmark.h>
+
+#include <common/buffer.hpp>
+#include <common/segmentedbuffer.hpp>
+#include <proxyd/deserialize.hpp>
+#include <proxyd/serialize.hpp>
+
+using namespace vitamine;
+using namespace vitamine::proxyd;
+
+// the length of the block data of a chunk section in longs
+constexpr UInt INT_ARRAY_COUNT = 16 * 16 * 16 * 14 / 64;
+
+template <typename OutputBuffer>
+static
+void benchSerializeIntArray(benchmark::State& state)
+{
+	Int64 values[INT_ARRAY_COUNT];
+
+	for(UInt i = 0; i != INT_ARRAY_COUNT; ++i)
+		values[i] = (Int64)(i * 0x0123456789abcdefull);
+
+	for(auto _ : state)
+	{
+		OutputBuffer buffer;
+		serializeIntArray(buffer, spanFromArray(values));
+		benchmark::DoNotOptimize(buffer);
+	}
+
+	state.SetBytesProcessed(state.iterations() * sizeof values);
+}
+
+BENCHMARK_TEMPLATE(benchSerializeIntArray, Buffer);
+BENCHMARK_TEMPLATE(benchSerializeIntArray, SegmentedBuffer);
+
+static
+void benchDeserializeIntArray(benchmark::State& state)
+{
+	Buffer buffer;
+
+	for(UInt i = 0; i != INT_ARRAY_COUNT; ++i)
+		serializeInt(buffer, (Int64)(i * 0x0123456789abcdefull));
+
+	Int64 values[INT_ARRAY_COUNT];
+
+	for(auto _ : state)
+	{
+		auto bufp = (UInt8 const*)buffer.data();
+		auto size = buffer.size();
+
+		if(deserializeIntArray(&bufp, &size, values, INT_ARRAY_COUNT) != DeserializeStatus::OK)
+		{
+			state.SkipWithError("invalid array");
+			break;
+		}
+
+		benchmark::DoNotOptimize(values);
+	}
+
+	state.SetBytesProcessed(state.iterations() * sizeof values);
+}
+
+BENCHMARK(benchDeserializeIntArray);
@@ -0,0 +1,30 @@
+#include <cstring>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+// results are written as json unless another format is requested, so runs of different builds can be compared
+int main(int argc, char** argv)
+{
+	std::vector<char*> args(argv, argv + argc);
+	bool formatGiven = false;
+
+	for(int i = 1; i != argc; ++i)
+		if(std::strncmp(argv[i], "--benchmark_format", 18) == 0)
+			formatGiven = true;
+
+	char jsonFormat[] = "--benchmark_format=json";
+
+	if(!formatGiven)
+		args.push_back(jsonFormat);
+
+	auto count = (int)args.size();
+	benchmark::Initialize(&count, args.data());
+
+	if(benchmark::ReportUnrecognizedArguments(count, args.data()))
+		return 1;
+
+	benchmark::RunSpecifiedBenchmarks();
+	benchmark::Shutdown();
+	return 0;
+}
@@ -0,0 +1,138 @@
+#include <benchmark/benchmark.h>
+
+#include <common/arena.hpp>
+#include <common/buffer.hpp>
+#include <proxyd/nbt.hpp>
+
+using namespace vitamine;
+using namespace vitamine::proxyd;
+
+// shaped like a dimension entry of the dimension codec, a compound of scalars, strings and a nested compound
+template <typename F>
+static
+void withDimensionNbt(F&& f)
+{
+	Nbt element[6];
+
+	element[0].type = NbtType::BYTE;
+	element[0].name = spanFromCString("piglin_safe");
+	element[0].value.i8 = 0;
+
+	element[1].type = NbtType::FLOAT;
+	element[1].name = spanFromCString("ambient_light");
+	element[1].value.f32 = 0;
+
+	element[2].type = NbtType::STRING;
+	element[2].name = spanFromCString("infiniburn");
+	element[2].value.str = spanFromCString("minecraft:infiniburn_overworld");
+
+	element[3].type = NbtType::INT;
+	element[3].name = spanFromCString("logical_height");
+	element[3].value.i32 = 256;
+
+	element[4].type = NbtType::DOUBLE;
+	element[4].name = spanFromCString("coordinate_scale");
+	element[4].value.f64 = 1;
+
+	Int64 heightmap[36] = {};
+
+	element[5].type = NbtType::LONG_ARRAY;
+	element[5].name = spanFromCString("MOTION_BLOCKING");
+	element[5].value.ai64 = spanFromArray(heightmap);
+
+	Nbt entry[2];
+
+	entry[0].type = NbtType::STRING;
+	entry[0].name = spanFromCString("name");
+	entry[0].value.str = spanFromCString("minecraft:overworld");
+
+	entry[1].type = NbtType::COMPOUND;
+	entry[1].name = spanFromCString("element");
+	entry[1].value.compound = spanFromArray(element);
+
+	Nbt root;
+	root.value.compound = spanFromArray(entry);
+
+	f(root);
+}
+
+static
+void benchSerializeNbt(benchmark::State& state)
+{
+	withDimensionNbt([&](Nbt const& root)
+	{
+		for(auto _ : state)
+		{
+			Buffer buffer;
+			serializeNbt(buffer, root);
+			benchmark::DoNotOptimize(buffer.data());
+		}
+
+		state.SetBytesProcessed(state.iterations() * serializedSizeNbt(root));
+	});
+}
+
+BENCHMARK(benchSerializeNbt);
+
+// the same document as benchSerializeNbt, written without building the tree
+static
+void benchWriteNbt(benchmark::State& state)
+{
+	Int64 heightmap[36] = {};
+	UInt size = 0;
+
+	for(auto _ : state)
+	{
+		Buffer buffer;
+		NbtWriter writer(buffer);
+
+		writer.beginCompound("");
+		writer.field("name", spanFromCString("minecraft:overworld"));
+		writer.beginCompound("element");
+		writer.field("piglin_safe", (Int8)0);
+		writer.field("ambient_light", (Float32)0);
+		writer.field("infiniburn", spanFromCString("minecraft:infiniburn_overworld"));
+		writer.field("logical_height", (Int32)256);
+		writer.field("coordinate_scale", (Float64)1);
+		writer.array("MOTION_BLOCKING", spanFromArray(heightmap));
+		writer.endCompound();
+		writer.endCompound();
+
+		benchmark::DoNotOptimize(buffer.data());
+		size = buffer.size();
+	}
+
+	state.SetBytesProcessed(state.iterations() * size);
+}
+
+BENCHMARK(benchWriteNbt);
+
+static
+void benchDeserializeNbt(benchmark::State& state)
+{
+	Buffer buffer;
+	withDimensionNbt([&](Nbt const& root) { serializeNbt(buffer, root); });
+
+	auto& arena = threadArena();
+
+	for(auto _ : state)
+	{
+		ArenaScope scope(arena);
+
+		auto bufp = (UInt8 const*)buffer.data();
+		auto size = buffer.size();
+		Nbt nbt;
+
+		if(deserializeNbt(&bufp, &size, &nbt, arena) != DeserializeStatus::OK)
+		{
+			state.SkipWithError("invalid nbt");
+			return;
+		}
+
+		benchmark::DoNotOptimize(nbt);
+	}
+
+	state.SetBytesProcessed(state.iterations() * buffer.size());
+}
+
+BENCHMARK(benchDeserializeNbt);
@@ -0,0 +1,97 @@
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include <proxyd/playertracker.hpp>
+
+using namespace vitamine;
+using namespace vitamine::proxyd;
+
+constexpr UInt TRACKED_PLAYER_COUNT = 256;
+constexpr Int32 TRACKED_AREA_SIZE = 64;
+
+// players spread over a square area, all with the same view distance
+static
+void populate(PlayerTracker<UInt>& tracker, UInt8 viewDistance)
+{
+	for(UInt i = 0; i != TRACKED_PLAYER_COUNT; ++i)
+		tracker.enter({(Int32)(i * 7 % TRACKED_AREA_SIZE), (Int32)(i * 13 % TRACKED_AREA_SIZE)}, viewDistance, i);
+}
+
+// a player joining and leaving, the argument is the view distance
+static
+void benchPlayerTrackerEnterLeave(benchmark::State& state)
+{
+	PlayerTracker<UInt> tracker;
+	auto viewDistance = (UInt8)state.range(0);
+	populate(tracker, viewDistance);
+
+	ChunkCoord coord = {TRACKED_AREA_SIZE / 2, TRACKED_AREA_SIZE / 2};
+
+	for(auto _ : state)
+	{
+		tracker.enter(coord, viewDistance, TRACKED_PLAYER_COUNT);
+		tracker.leave(coord, viewDistance, TRACKED_PLAYER_COUNT);
+	}
+
+	state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(benchPlayerTrackerEnterLeave)->Arg(2)->Arg(10)->Arg(32);
+
+// a player crossing a chunk border along x, as in onChunkTransition
+static
+void benchPlayerTrackerChunkTransition(benchmark::State& state)
+{
+	PlayerTracker<UInt> tracker;
+	auto viewDistance = (Int32)state.range(0);
+	populate(tracker, (UInt8)viewDistance);
+
+	ChunkCoord from = {TRACKED_AREA_SIZE / 2, TRACKED_AREA_SIZE / 2};
+	ChunkCoord to = from + ChunkCoord{1, 0};
+	tracker.enter(from, (UInt8)viewDistance, TRACKED_PLAYER_COUNT);
+
+	std::vector<ChunkCoord> leftEdge, rightEdge;
+
+	for(auto dz = -viewDistance; dz <= viewDistance; ++dz)
+	{
+		leftEdge.push_back(from + ChunkCoord{-viewDistance, dz});
+		rightEdge.push_back(to + ChunkCoord{viewDistance, dz});
+	}
+
+	for(auto _ : state)
+	{
+		tracker.move(from, to, TRACKED_PLAYER_COUNT);
+		tracker.unsubscribe(leftEdge, TRACKED_PLAYER_COUNT);
+		tracker.subscribe(rightEdge, TRACKED_PLAYER_COUNT);
+
+		tracker.move(to, from, TRACKED_PLAYER_COUNT);
+		tracker.unsubscribe(rightEdge, TRACKED_PLAYER_COUNT);
+		tracker.subscribe(leftEdge, TRACKED_PLAYER_COUNT);
+	}
+
+	state.SetItemsProcessed(state.iterations() * 2);
+}
+
+BENCHMARK(benchPlayerTrackerChunkTransition)->Arg(2)->Arg(10)->Arg(32);
+
+// looking up the recipients of a local broadcast
+static
+void benchPlayerTrackerSubscribers(benchmark::State& state)
+{
+	PlayerTracker<UInt> tracker;
+	populate(tracker, 10);
+
+	UInt i = 0;
+
+	for(auto _ : state)
+	{
+		auto subscribers = tracker.subscribers({(Int32)(i * 7 % TRACKED_AREA_SIZE), (Int32)(i * 13 % TRACKED_AREA_SIZE)});
+		benchmark::DoNotOptimize(subscribers.size());
+		++i;
+	}
+
+	state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(benchPlayerTrackerSubscribers);
@@ -0,0 +1,70 @@
+#include <benchmark/benchmark.h>
+
+#include <string>
+
+#include <common/arena.hpp>
+#include <common/utf8.hpp>
+
+using namespace vitamine;
+
+constexpr UInt UTF8_STRING_SIZE = 4096;
+
+// chat sized ascii for range 0, mixed latin, cyrillic and cjk text for range 1
+static
+std::string makeUtf8String(Int64 kind)
+{
+	static char const* const WORDS[] = {"hello ", "caf\xc3\xa9 ", "\xd0\xbf\xd1\x80\xd0\xb8\xd0\xb2\xd0\xb5\xd1\x82 ", "\xe4\xb8\x96\xe7\x95\x8c "};
+
+	std::string str;
+
+	for(UInt i = 0; str.size() < UTF8_STRING_SIZE; ++i)
+		str += WORDS[kind == 0 ? 0 : i % 4];
+
+	return str;
+}
+
+static
+void benchValidateUtf8(benchmark::State& state)
+{
+	auto str = makeUtf8String(state.range(0));
+
+	for(auto _ : state)
+		benchmark::DoNotOptimize(isValidUtf8(spanFromStdString(str)));
+
+	state.SetBytesProcessed(state.iterations() * str.size());
+}
+
+BENCHMARK(benchValidateUtf8)->Arg(0)->Arg(1);
+
+static
+void benchValidateUtf8Scalar(benchmark::State& state)
+{
+	auto str = makeUtf8String(state.range(0));
+
+	for(auto _ : state)
+		benchmark::DoNotOptimize(isValidUtf8Scalar(spanFromStdString(str)));
+
+	state.SetBytesProcessed(state.iterations() * str.size());
+}
+
+BENCHMARK(benchValidateUtf8Scalar)->Arg(0)->Arg(1);
+
+// the string is the same in both encodings, so decoding only validates it
+static
+void benchModifiedUtf8ToUtf8(benchmark::State& state)
+{
+	auto str = makeUtf8String(state.range(0));
+	Arena arena;
+
+	for(auto _ : state)
+	{
+		ArenaScope scope(arena);
+		Span<Char8 const> out;
+		benchmark::DoNotOptimize(modifiedUtf8ToUtf8(spanFromStdString(str), &out, arena));
+		benchmark::DoNotOptimize(out);
+	}
+
+	state.SetBytesProcessed(state.iterations() * str.size());
+}
+
+BENCHMARK(benchModifiedUtf8ToUtf8)->Arg(0)->Arg(1);
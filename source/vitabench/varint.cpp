@@ -0,0 +1,108 @@
+#include <benchmark/benchmark.h>
+
+#include <common/buffer.hpp>
+#include <proxyd/deserialize.hpp>
+#include <proxyd/serialize.hpp>
+
+using namespace vitamine;
+using namespace vitamine::proxyd;
+
+constexpr UInt VARINT_COUNT = 1024;
+
+// values that encode to exactly the given number of bytes, 1 to 5
+static
+Int32 varIntOfLength(Int64 length, UInt i)
+{
+	switch(length)
+	{
+	case 1: return (Int32)(i & 0x7f);
+	case 2: return (Int32)(0x80 + (i & 0x3fff) % (0x4000 - 0x80));
+	case 3: return (Int32)(0x4000 + i);
+	case 4: return (Int32)(0x200000 + i);
+	default: return -(Int32)i - 1;
+	}
+}
+
+static
+void benchSerializeVarInt(benchmark::State& state)
+{
+	Int32 values[VARINT_COUNT];
+
+	for(UInt i = 0; i != VARINT_COUNT; ++i)
+		values[i] = varIntOfLength(state.range(0), i);
+
+	for(auto _ : state)
+	{
+		Buffer buffer;
+
+		for(auto value : values)
+			serializeVarInt(buffer, value);
+
+		benchmark::DoNotOptimize(buffer.data());
+	}
+
+	state.SetItemsProcessed(state.iterations() * VARINT_COUNT);
+}
+
+BENCHMARK(benchSerializeVarInt)->DenseRange(1, 5);
+
+static
+void benchDeserializeVarInt(benchmark::State& state)
+{
+	Buffer buffer;
+
+	for(UInt i = 0; i != VARINT_COUNT; ++i)
+		serializeVarInt(buffer, varIntOfLength(state.range(0), i));
+
+	for(auto _ : state)
+	{
+		auto bufp = (UInt8 const*)buffer.data();
+		auto size = buffer.size();
+
+		for(UInt i = 0; i != VARINT_COUNT; ++i)
+		{
+			Int32 value;
+
+			if(deserializeVarInt(&bufp, &size, &value) != DeserializeStatus::OK)
+			{
+				state.SkipWithError("invalid varint");
+				return;
+			}
+
+			benchmark::DoNotOptimize(value);
+		}
+	}
+
+	state.SetItemsProcessed(state.iterations() * VARINT_COUNT);
+}
+
+BENCHMARK(benchDeserializeVarInt)->DenseRange(1, 5);
+
+static
+void benchDeserializeVarIntBatch(benchmark::State& state)
+{
+	Buffer buffer;
+
+	for(UInt i = 0; i != VARINT_COUNT; ++i)
+		serializeVarInt(buffer, varIntOfLength(state.range(0), i));
+
+	Int32 values[VARINT_COUNT];
+
+	for(auto _ : state)
+	{
+		auto bufp = (UInt8 const*)buffer.data();
+		auto size = buffer.size();
+
+		if(deserializeVarIntBatch(&bufp, &size, values, VARINT_COUNT) != DeserializeStatus::OK)
+		{
+			state.SkipWithError("invalid varint");
+			return;
+		}
+
+		benchmark::DoNotOptimize(values);
+	}
+
+	state.SetItemsProcessed(state.iterations() * VARINT_COUNT);
+}
+
+BENCHMARK(benchDeserializeVarIntBatch)->DenseRange(1, 5);
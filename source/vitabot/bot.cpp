@@ -0,0 +1,503 @@
+#include <vitabot/bot.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+#include <boost/asio/write.hpp>
+
+#include <common/arena.hpp>
+#include <proxyd/authentication.hpp>
+#include <proxyd/packets.hpp>
+#include <proxyd/types.hpp>
+
+namespace
+{
+	constexpr vitamine::Int64 BOT_TICK_NANOS = 50'000'000;
+
+	// actions owed after a stalled tick are capped, so a stall does not turn into a burst
+	constexpr vitamine::Float64 MAX_ACTIONS_DUE_SECONDS = 1;
+
+	constexpr vitamine::Float64 WALK_STEP = 0.25;
+
+	// top of the generated flat world
+	constexpr vitamine::Float64 GROUND_Y = 16;
+	constexpr vitamine::Int32 DIG_DEPTH = 5;
+}
+
+namespace vitamine::vitabot
+{
+	using namespace vitamine::proxyd;
+
+	Bot::Bot(Swarm* swarm, boost::asio::io_service* service, UInt index)
+	: _swarm(swarm), _name(swarm->settings.namePrefix + std::to_string(index))
+	, _socket(*service), _timer(*service)
+	, _readBuffer(std::make_unique<UInt8[]>(READ_BUFFER_SIZE))
+	, _reader(this)
+	{
+		// bots walk in parallel lanes, so they spread over a few chunks and see each other move
+		_position.z = (Float64)(index % 32) - 16 + 0.5;
+	}
+
+	Bot::~Bot()
+	{
+		if(_phase == BotPhase::PLAY)
+			_swarm->unregisterEntity(_entityId);
+	}
+
+	void Bot::start(Int64 delayNanos)
+	{
+		_timer.expires_after(std::chrono::nanoseconds(delayNanos));
+		_timer.async_wait([this](boost::system::error_code const& error)
+		{
+			if(!error)
+				connect();
+		});
+	}
+
+	void Bot::connect()
+	{
+		_phase = BotPhase::CONNECTING;
+		_connectTime = _swarm->clock.now();
+		++_swarm->stats.connecting;
+
+		_socket.async_connect(_swarm->settings.endpoint, [this](boost::system::error_code const& error)
+		{
+			if(error)
+			{
+				fail("failed to connect");
+				return;
+			}
+
+			_socket.set_option(boost::asio::ip::tcp::no_delay(true));
+			_phase = BotPhase::LOGIN;
+
+			auto address = _swarm->settings.endpoint.address().to_string();
+
+			PacketHandshake handshake;
+			handshake.version = PROTOCOL_VERSION;
+			handshake.address = spanFromStdString(address);
+			handshake.port = _swarm->settings.endpoint.port();
+			handshake.nextState = 2;
+			sendPacket(handshake);
+
+			PacketLoginStart loginStart;
+			loginStart.name = spanFromStdString(_name);
+			sendPacket(loginStart);
+
+			read();
+		});
+	}
+
+	void Bot::read()
+	{
+		_socket.async_read_some(boost::asio::buffer(_readBuffer.get(), READ_BUFFER_SIZE), [this](boost::system::error_code const& error, std::size_t size)
+		{
+			if(_phase == BotPhase::FAILED)
+				return;
+
+			if(error)
+			{
+				fail("connection closed by the server");
+				return;
+			}
+
+			_swarm->stats.bytesReceived.fetch_add(size, std::memory_order_relaxed);
+
+			if(_cipher)
+				_cipher->decrypt(_readBuffer.get(), _readBuffer.get(), size);
+
+			_reader.onBytesReceived({_readBuffer.get(), size});
+
+			if(_phase != BotPhase::FAILED)
+				read();
+		});
+	}
+
+	void Bot::fail(char const* reason)
+	{
+		if(_phase == BotPhase::FAILED)
+			return;
+
+		std::printf("%s: %s\n", _name.c_str(), reason);
+
+		if(_phase == BotPhase::PLAY)
+		{
+			--_swarm->stats.playing;
+			_swarm->unregisterEntity(_entityId);
+		}
+		else
+			--_swarm->stats.connecting;
+
+		++_swarm->stats.failed;
+		_phase = BotPhase::FAILED;
+
+		boost::system::error_code ignored;
+		_socket.close(ignored);
+		_timer.cancel(ignored);
+	}
+
+	void Bot::flush()
+	{
+		if(_writing || _pendingWrite.size() == 0 || _phase == BotPhase::FAILED)
+			return;
+
+		std::swap(_pendingWrite, _activeWrite);
+		_writing = true;
+
+		boost::asio::async_write(_socket, boost::asio::buffer(_activeWrite.data(), _activeWrite.size()), [this](boost::system::error_code const& error, std::size_t size)
+		{
+			_writing = false;
+			_activeWrite.clear();
+
+			if(_phase == BotPhase::FAILED)
+				return;
+
+			if(error)
+			{
+				fail("failed to send");
+				return;
+			}
+
+			_swarm->stats.bytesSent.fetch_add(size, std::memory_order_relaxed);
+			flush();
+		});
+	}
+
+	void Bot::onPacket(PacketFrame frame)
+	{
+		if(_phase == BotPhase::FAILED)
+			return;
+
+		_swarm->stats.packetsReceived.fetch_add(1, std::memory_order_relaxed);
+
+		ArenaScope scope(threadArena());
+
+		if(_phase == BotPhase::LOGIN)
+			onLoginPacket(frame);
+		else
+			onPlayPacket(frame);
+	}
+
+	template <typename Packet>
+	static
+	bool decode(PacketFrame frame, Packet* packet)
+	{
+		return deserializePacketPayload(frame.data, packet, threadArena());
+	}
+
+	void Bot::onLoginPacket(PacketFrame frame)
+	{
+		switch(frame.id)
+		{
+		case PacketDisconnectLogin::ID:
+			fail("disconnected during login");
+			break;
+
+		// bots do not join through a session server, so the server has to verify sessions with a stub, e.g. vitaproxyd --stub-sessions accept
+		case PacketEncryptionRequest::ID:
+		{
+			PacketEncryptionRequest packet;
+
+			if(!decode(frame, &packet))
+			{
+				fail("invalid encryption request");
+				return;
+			}
+
+			UInt8 sharedSecret[SHARED_SECRET_SIZE];
+			generateRandomBytes(sharedSecret, sizeof sharedSecret);
+
+			std::vector<UInt8> encryptedSecret;
+			std::vector<UInt8> encryptedVerifyToken;
+
+			if(!encryptWithPublicKey(packet.publicKey, spanFromArray(sharedSecret), &encryptedSecret)
+			|| !encryptWithPublicKey(packet.publicKey, packet.verifyToken, &encryptedVerifyToken))
+			{
+				fail("invalid server public key");
+				return;
+			}
+
+			PacketEncryptionResponse response;
+			response.sharedSecret = encryptedSecret;
+			response.verifyToken = encryptedVerifyToken;
+			sendPacket(response);
+
+			// the server sends nothing between the request and the response, so everything received after it is encrypted
+			_cipher = std::make_unique<AesCfb8>(spanFromArray(sharedSecret));
+			break;
+		}
+
+		case PacketSetCompression::ID:
+		{
+			PacketSetCompression packet;
+
+			if(!decode(frame, &packet))
+			{
+				fail("invalid set compression packet");
+				return;
+			}
+
+			// the server compresses everything after this packet, and so must we
+			_compressionThreshold = packet.threshold;
+			_reader.enableCompression();
+			break;
+		}
+
+		case PacketLoginSuccess::ID:
+			_phase = BotPhase::PLAY_INIT;
+			break;
+
+		default:
+			fail("unexpected packet during login");
+			break;
+		}
+	}
+
+	void Bot::onPlayPacket(PacketFrame frame)
+	{
+		switch(frame.id)
+		{
+		case PacketJoinGame::ID:
+		{
+			PacketJoinGame packet;
+
+			if(!decode(frame, &packet))
+			{
+				fail("invalid join game packet");
+				return;
+			}
+
+			_entityId = packet.entityId;
+
+			// the server clamps the requested view distance to at least 2 and to its own maximum
+			_viewDistance = std::max<Int32>(2, std::min<Int32>(_swarm->settings.viewDistance, packet.viewDistance));
+
+			PacketClientSettings settings;
+			settings.locale = spanFromCString("en_US");
+			settings.viewDistance = _swarm->settings.viewDistance;
+			settings.chatMode = (Int32)ChatMode::ENABLED;
+			settings.chatColors = true;
+			settings.displayedSkinParts = 0x7f;
+			settings.mainHand = (Int32)MainHand::RIGHT;
+			sendPacket(settings);
+
+			_settingsTime = _swarm->clock.now();
+			break;
+		}
+
+		case PacketChunkData::ID:
+		{
+			_swarm->stats.chunksReceived.fetch_add(1, std::memory_order_relaxed);
+
+			auto chunksInView = (UInt)((2 * _viewDistance + 1) * (2 * _viewDistance + 1));
+			++_chunksReceived;
+
+			if(_chunksReceived == 1)
+				_swarm->stats.firstChunk.record(_swarm->clock.now() - _settingsTime);
+
+			if(_chunksReceived == chunksInView)
+				_swarm->stats.allChunks.record(_swarm->clock.now() - _settingsTime);
+
+			break;
+		}
+
+		case PacketPlayerPositionLookServer::ID:
+		{
+			PacketPlayerPositionLookServer packet;
+
+			if(!decode(frame, &packet))
+			{
+				fail("invalid position and look packet");
+				return;
+			}
+
+			PacketTeleportConfirm confirm;
+			confirm.teleportId = packet.teleportId;
+			sendPacket(confirm);
+
+			if(_phase == BotPhase::PLAY_INIT)
+				onSpawn();
+
+			break;
+		}
+
+		case PacketKeepAliveServer::ID:
+		{
+			PacketKeepAliveServer packet;
+
+			if(!decode(frame, &packet))
+			{
+				fail("invalid keep alive packet");
+				return;
+			}
+
+			PacketKeepAliveClient reply;
+			reply.keepAliveId = packet.keepAliveId;
+			sendPacket(reply);
+			break;
+		}
+
+		case PacketEntityMove::ID:
+		{
+			PacketEntityMove packet;
+
+			if(decode(frame, &packet))
+				onEntityMoved(packet.entityId);
+
+			break;
+		}
+
+		case PacketEntityMoveRotation::ID:
+		{
+			PacketEntityMoveRotation packet;
+
+			if(decode(frame, &packet))
+				onEntityMoved(packet.entityId);
+
+			break;
+		}
+
+		case PacketEntityTeleport::ID:
+		{
+			PacketEntityTeleport packet;
+
+			if(decode(frame, &packet))
+				onEntityMoved(packet.entityId);
+
+			break;
+		}
+
+		case PacketDisconnect::ID:
+			fail("disconnected by the server");
+			break;
+		}
+	}
+
+	// measured against the bot's latest movement, which is exact as long as moves are further apart than the latency
+	void Bot::onEntityMoved(Int32 entityId)
+	{
+		std::shared_lock lock(_swarm->entitiesMutex);
+		auto it = _swarm->entities.find(entityId);
+
+		if(it == _swarm->entities.end())
+			return;
+
+		auto moveTime = it->second->lastMoveTime();
+		lock.unlock();
+
+		if(moveTime != 0)
+			_swarm->stats.movementEcho.record(_swarm->clock.now() - moveTime);
+	}
+
+	void Bot::onSpawn()
+	{
+		// the server discards this packet until the teleport is confirmed, a vanilla client sends it anyway
+		PacketPlayerPositionRotationClient position;
+		position.x = _position.x;
+		position.y = GROUND_Y;
+		position.z = _position.z;
+		position.yaw = _yaw;
+		position.pitch = _pitch;
+		position.onGround = true;
+		sendPacket(position);
+
+		_position.y = GROUND_Y;
+		_phase = BotPhase::PLAY;
+
+		--_swarm->stats.connecting;
+		++_swarm->stats.playing;
+		_swarm->stats.connectionSetup.record(_swarm->clock.now() - _connectTime);
+		_swarm->registerEntity(_entityId, this);
+
+		_lastTickTime = _swarm->clock.now();
+		scheduleTick();
+	}
+
+	void Bot::scheduleTick()
+	{
+		_timer.expires_after(std::chrono::nanoseconds(BOT_TICK_NANOS));
+		_timer.async_wait([this](boost::system::error_code const& error)
+		{
+			if(!error && _phase == BotPhase::PLAY)
+				onTick();
+		});
+	}
+
+	void Bot::onTick()
+	{
+		auto now = _swarm->clock.now();
+		auto seconds = (now - _lastTickTime) / 1e9;
+		_lastTickTime = now;
+
+		auto& settings = _swarm->settings;
+
+		auto perform = [&](Float64& due, Float64 rate, auto action)
+		{
+			due = std::min(due + rate * seconds, std::max(rate * MAX_ACTIONS_DUE_SECONDS, 1.0));
+
+			for(; due >= 1; due -= 1)
+				(this->*action)();
+		};
+
+		perform(_movesDue, settings.moveRate, &Bot::move);
+		perform(_rotationsDue, settings.rotateRate, &Bot::rotate);
+		perform(_digsDue, settings.digRate, &Bot::dig);
+		perform(_chatsDue, settings.chatRate, &Bot::chat);
+
+		if(_phase == BotPhase::PLAY)
+			scheduleTick();
+	}
+
+	void Bot::move()
+	{
+		if(std::abs(_position.x + _walkDirection * WALK_STEP) > _swarm->settings.walkRadius)
+			_walkDirection = -_walkDirection;
+
+		_position.x += _walkDirection * WALK_STEP;
+
+		PacketPlayerPosition packet;
+		packet.x = _position.x;
+		packet.y = _position.y;
+		packet.z = _position.z;
+		packet.onGround = true;
+
+		_lastMoveTime.store(_swarm->clock.now(), std::memory_order_relaxed);
+		sendPacket(packet);
+	}
+
+	void Bot::rotate()
+	{
+		_yaw = std::fmod(_yaw + 15, 360);
+
+		PacketPlayerRotation packet;
+		packet.yaw = _yaw;
+		packet.pitch = _pitch;
+		packet.onGround = true;
+		sendPacket(packet);
+	}
+
+	// digs a column below the bot, the depth stays within reach of a player standing on the ground
+	void Bot::dig()
+	{
+		auto x = (Int32)std::floor(_position.x);
+		auto y = (Int32)GROUND_Y - 1 - (Int32)(_digCount++ % DIG_DEPTH);
+		auto z = (Int32)std::floor(_position.z);
+
+		PacketPlayerDigging packet;
+		packet.status = 0; // started digging, instant in creative mode
+		packet.location = toPosition({x, y, z});
+		packet.face = (Int8)BlockFace::POS_Y;
+		sendPacket(packet);
+	}
+
+	void Bot::chat()
+	{
+		auto message = "hello from " + _name + " #" + std::to_string(_chatCount++);
+
+		PacketChatClient packet;
+		packet.message = spanFromStdString(message);
+		sendPacket(packet);
+	}
+}
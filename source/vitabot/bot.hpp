@@ -0,0 +1,140 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <string>
+
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/steady_timer.hpp>
+
+#include <common/aescfb8.hpp>
+#include <common/buffer.hpp>
+#include <common/coord.hpp>
+#include <common/types.hpp>
+#include <proxyd/framing.hpp>
+#include <proxyd/packetreader.hpp>
+#include <vitabot/swarm.hpp>
+
+namespace vitamine::vitabot
+{
+	enum struct BotPhase
+	{
+		IDLE,
+		CONNECTING,
+		LOGIN,
+		PLAY_INIT,
+		PLAY,
+		FAILED,
+	};
+
+	// a headless client that logs in like a vanilla client and then keeps walking, rotating, digging and chatting
+	// all handlers of a bot run on the reactor that owns its socket, so a bot never needs a lock for its own state
+	class Bot
+	{
+		static constexpr UInt READ_BUFFER_SIZE = 65536;
+
+		Swarm* _swarm;
+		std::string _name;
+
+		boost::asio::ip::tcp::socket _socket;
+		boost::asio::steady_timer _timer;
+		std::unique_ptr<UInt8[]> _readBuffer;
+
+		proxyd::PacketReader<Bot, proxyd::ClientboundFrameLimits> _reader;
+
+		// set once the encryption response has been sent to a server in online mode
+		std::unique_ptr<AesCfb8> _cipher;
+
+		BotPhase _phase = BotPhase::IDLE;
+		Int32 _compressionThreshold = -1;
+		Int32 _entityId = 0;
+		Int32 _viewDistance = 0;
+
+		// packets are appended to the pending buffer while a write is in progress, and written together when it completes
+		Buffer _pendingWrite;
+		Buffer _activeWrite;
+		bool _writing = false;
+
+		Int64 _connectTime = 0;
+		Int64 _settingsTime = 0;
+		UInt _chunksReceived = 0;
+
+		EntityCoord _position = {0, 0, 0};
+		Float32 _yaw = 0;
+		Float32 _pitch = 0;
+		Float64 _walkDirection = 1;
+		UInt _digCount = 0;
+		UInt _chatCount = 0;
+
+		// actions that are due but have not been performed yet, rates rarely divide evenly into ticks
+		Int64 _lastTickTime = 0;
+		Float64 _movesDue = 0;
+		Float64 _rotationsDue = 0;
+		Float64 _digsDue = 0;
+		Float64 _chatsDue = 0;
+
+		// read by other bots' reactors when they see this bot move
+		std::atomic<Int64> _lastMoveTime = 0;
+
+		friend class proxyd::PacketReader<Bot, proxyd::ClientboundFrameLimits>;
+
+		void connect();
+		void read();
+		void fail(char const* reason);
+
+		template <typename Packet>
+		void sendPacket(Packet const& packet)
+		{
+			auto buffer = proxyd::serializePacket(packet, _compressionThreshold);
+			auto offset = _pendingWrite.size();
+			_pendingWrite.write(buffer.data(), buffer.size());
+
+			// packets are encrypted in the order they are queued, which is the order they are sent
+			if(_cipher)
+			{
+				auto data = (UInt8*)_pendingWrite.data() + offset;
+				_cipher->encrypt(data, data, buffer.size());
+			}
+
+			flush();
+		}
+
+		void flush();
+
+		void onPacket(proxyd::PacketFrame frame);
+		void onLoginPacket(proxyd::PacketFrame frame);
+		void onPlayPacket(proxyd::PacketFrame frame);
+		void onEntityMoved(Int32 entityId);
+
+		void onInvalidFrame()
+		{
+			fail("invalid frame");
+		}
+
+		void onSpawn();
+		void scheduleTick();
+		void onTick();
+
+		void move();
+		void rotate();
+		void dig();
+		void chat();
+
+	public:
+		Bot(Swarm* swarm, boost::asio::io_service* service, UInt index);
+		~Bot();
+
+		Bot(Bot const&) = delete;
+		Bot& operator=(Bot const&) = delete;
+
+		// connects after the delay, which spreads the logins of many bots over time
+		void start(Int64 delayNanos);
+
+		[[nodiscard]]
+		Int64 lastMoveTime() const
+		{
+			return _lastMoveTime.load(std::memory_order_relaxed);
+		}
+	};
+}
@@ -0,0 +1,188 @@
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/signal_set.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/ip/tcp.hpp>
+
+#include <common/net/reactorpool.hpp>
+#include <vitabot/bot.hpp>
+#include <vitabot/swarm.hpp>
+
+namespace
+{
+	constexpr vitamine::Int64 REPORT_INTERVAL_NANOS = 1'000'000'000;
+}
+
+static
+void usage(char const* argv0)
+{
+	std::printf("usage: %s [--host <address>] [--port <port>] [--bots <count>] [--connect-rate <per second>] [--threads <count>] [--pin-threads]\n"
+	            "          [--view-distance <chunks>] [--move-rate <hz>] [--rotate-rate <hz>] [--dig-rate <hz>] [--chat-rate <hz>]\n"
+	            "          [--walk-radius <blocks>] [--name-prefix <prefix>] [--duration <seconds>]\n", argv0);
+	std::exit(1);
+}
+
+struct Totals
+{
+	vitamine::UInt64 bytesReceived = 0;
+	vitamine::UInt64 bytesSent = 0;
+	vitamine::UInt64 packetsReceived = 0;
+	vitamine::UInt64 chunksReceived = 0;
+};
+
+static
+Totals totals(vitamine::vitabot::SwarmStats const& stats)
+{
+	Totals totals;
+	totals.bytesReceived = stats.bytesReceived.load();
+	totals.bytesSent = stats.bytesSent.load();
+	totals.packetsReceived = stats.packetsReceived.load();
+	totals.chunksReceived = stats.chunksReceived.load();
+	return totals;
+}
+
+int main(int argc, char** argv)
+{
+	using namespace boost::asio;
+	using namespace vitamine;
+	using namespace vitamine::vitabot;
+
+	ReactorPoolSettings poolSettings;
+	Swarm swarm;
+	auto& settings = swarm.settings;
+
+	char const* host = "127.0.0.1";
+	UInt16 port = 1337;
+	Float64 duration = 0;
+
+	for(int i = 1; i < argc; ++i)
+	{
+		if(std::strcmp(argv[i], "--host") == 0 && i + 1 < argc)
+			host = argv[++i];
+		else if(std::strcmp(argv[i], "--port") == 0 && i + 1 < argc)
+			port = std::strtoul(argv[++i], nullptr, 10);
+		else if(std::strcmp(argv[i], "--bots") == 0 && i + 1 < argc)
+			settings.botCount = std::strtoul(argv[++i], nullptr, 10);
+		else if(std::strcmp(argv[i], "--connect-rate") == 0 && i + 1 < argc)
+			settings.connectsPerSecond = std::strtod(argv[++i], nullptr);
+		else if(std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+			poolSettings.threadCount = std::strtoul(argv[++i], nullptr, 10);
+		else if(std::strcmp(argv[i], "--pin-threads") == 0)
+			poolSettings.pinThreads = true;
+		else if(std::strcmp(argv[i], "--view-distance") == 0 && i + 1 < argc)
+			settings.viewDistance = std::strtoul(argv[++i], nullptr, 10);
+		else if(std::strcmp(argv[i], "--move-rate") == 0 && i + 1 < argc)
+			settings.moveRate = std::strtod(argv[++i], nullptr);
+		else if(std::strcmp(argv[i], "--rotate-rate") == 0 && i + 1 < argc)
+			settings.rotateRate = std::strtod(argv[++i], nullptr);
+		else if(std::strcmp(argv[i], "--dig-rate") == 0 && i + 1 < argc)
+			settings.digRate = std::strtod(argv[++i], nullptr);
+		else if(std::strcmp(argv[i], "--chat-rate") == 0 && i + 1 < argc)
+			settings.chatRate = std::strtod(argv[++i], nullptr);
+		else if(std::strcmp(argv[i], "--walk-radius") == 0 && i + 1 < argc)
+			settings.walkRadius = std::strtod(argv[++i], nullptr);
+		else if(std::strcmp(argv[i], "--name-prefix") == 0 && i + 1 < argc)
+			settings.namePrefix = argv[++i];
+		else if(std::strcmp(argv[i], "--duration") == 0 && i + 1 < argc)
+			duration = std::strtod(argv[++i], nullptr);
+		else
+			usage(argv[0]);
+	}
+
+	if(settings.connectsPerSecond <= 0)
+		usage(argv[0]);
+
+	boost::system::error_code error;
+	auto address = ip::make_address(host, error);
+
+	if(error)
+	{
+		std::printf("invalid address: %s\n", host);
+		return 1;
+	}
+
+	settings.endpoint = ip::tcp::endpoint(address, port);
+
+	ReactorPool pool(poolSettings);
+
+	signal_set set(*pool.service(0));
+	set.add(SIGINT);
+	set.add(SIGTERM);
+	set.async_wait([&](...){ pool.stop(); });
+
+	// destroyed before the pool, the sockets belong to its services
+	std::vector<std::unique_ptr<Bot>> bots;
+
+	for(UInt i = 0; i != settings.botCount; ++i)
+	{
+		bots.push_back(std::make_unique<Bot>(&swarm, pool.service(i % pool.size()), i));
+		bots.back()->start((Int64)(i / settings.connectsPerSecond * 1e9));
+	}
+
+	auto startTime = swarm.clock.now();
+	auto lastReportTime = startTime;
+	auto lastTotals = Totals();
+
+	steady_timer reportTimer(*pool.service(0));
+	std::function<void()> scheduleReport;
+
+	scheduleReport = [&]
+	{
+		reportTimer.expires_after(std::chrono::nanoseconds(REPORT_INTERVAL_NANOS));
+		reportTimer.async_wait([&](boost::system::error_code const& error)
+		{
+			if(error)
+				return;
+
+			auto now = swarm.clock.now();
+			auto seconds = (now - lastReportTime) / 1e9;
+			auto current = totals(swarm.stats);
+
+			std::printf("[%7.1fs] %llu connecting, %llu playing, %llu failed, rx %.2f MB/s (%.0f packets/s, %.0f chunks/s), tx %.2f MB/s\n",
+				(now - startTime) / 1e9,
+				(unsigned long long)swarm.stats.connecting.load(),
+				(unsigned long long)swarm.stats.playing.load(),
+				(unsigned long long)swarm.stats.failed.load(),
+				(current.bytesReceived - lastTotals.bytesReceived) / seconds / 1e6,
+				(current.packetsReceived - lastTotals.packetsReceived) / seconds,
+				(current.chunksReceived - lastTotals.chunksReceived) / seconds,
+				(current.bytesSent - lastTotals.bytesSent) / seconds / 1e6);
+
+			lastReportTime = now;
+			lastTotals = current;
+
+			if(duration > 0 && now - startTime >= duration * 1e9)
+				pool.stop();
+			else
+				scheduleReport();
+		});
+	};
+
+	scheduleReport();
+
+	std::printf("starting %zu bots against %s:%d with %zu reactor threads\n",
+		(std::size_t)settings.botCount, host, (int)port, (std::size_t)pool.size());
+
+	pool.run();
+
+	auto elapsed = (swarm.clock.now() - startTime) / 1e9;
+	auto final = totals(swarm.stats);
+
+	std::printf("\nafter %.1fs: %llu playing, %llu failed\n", elapsed,
+		(unsigned long long)swarm.stats.playing.load(), (unsigned long long)swarm.stats.failed.load());
+	std::printf("  received %llu bytes in %llu packets, %llu chunks, sent %llu bytes\n",
+		(unsigned long long)final.bytesReceived, (unsigned long long)final.packetsReceived,
+		(unsigned long long)final.chunksReceived, (unsigned long long)final.bytesSent);
+
+	printSummary("connection setup", swarm.stats.connectionSetup);
+	printSummary("first chunk", swarm.stats.firstChunk);
+	printSummary("all chunks", swarm.stats.allChunks);
+	printSummary("movement echo", swarm.stats.movementEcho);
+}
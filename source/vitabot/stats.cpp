@@ -0,0 +1,92 @@
+#include <vitabot/stats.hpp>
+
+#include <algorithm>
+#include <cstdio>
+
+namespace vitamine::vitabot
+{
+	UInt LatencyHistogram::bucketIndex(UInt64 value)
+	{
+		if(value < SUB_BUCKET_COUNT)
+			return value;
+
+		// the highest set bit selects the power of two, the bits below it the sub-bucket
+		auto exponent = 63 - __builtin_clzll(value);
+		auto mantissa = (value >> (exponent - SUB_BUCKET_BITS)) & (SUB_BUCKET_COUNT - 1);
+		return ((exponent - SUB_BUCKET_BITS + 1) << SUB_BUCKET_BITS) | mantissa;
+	}
+
+	UInt64 LatencyHistogram::bucketLowerBound(UInt index)
+	{
+		if(index < SUB_BUCKET_COUNT)
+			return index;
+
+		auto exponent = (index >> SUB_BUCKET_BITS) + SUB_BUCKET_BITS - 1;
+		auto mantissa = index & (SUB_BUCKET_COUNT - 1);
+		return (SUB_BUCKET_COUNT | mantissa) << (exponent - SUB_BUCKET_BITS);
+	}
+
+	void LatencyHistogram::record(Int64 nanos)
+	{
+		auto value = (UInt64)std::max<Int64>(nanos, 0);
+
+		_buckets[bucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+		_count.fetch_add(1, std::memory_order_relaxed);
+		_sum.fetch_add(value, std::memory_order_relaxed);
+
+		auto max = _max.load(std::memory_order_relaxed);
+		while(value > max && !_max.compare_exchange_weak(max, value, std::memory_order_relaxed));
+	}
+
+	LatencyHistogram::Summary LatencyHistogram::summarize() const
+	{
+		constexpr Float64 NANOS_PER_MILLI = 1e6;
+
+		Summary summary = {};
+		summary.count = _count.load(std::memory_order_relaxed);
+
+		if(summary.count == 0)
+			return summary;
+
+		summary.meanMillis = _sum.load(std::memory_order_relaxed) / (Float64)summary.count / NANOS_PER_MILLI;
+		summary.maxMillis = _max.load(std::memory_order_relaxed) / NANOS_PER_MILLI;
+
+		// buckets may be updated concurrently, so the ranks are taken from the buckets themselves
+		UInt64 total = 0;
+
+		for(auto& bucket : _buckets)
+			total += bucket.load(std::memory_order_relaxed);
+
+		auto p50Rank = (total + 1) / 2;
+		auto p99Rank = total - total / 100;
+		UInt64 seen = 0;
+		bool p50Found = false;
+
+		for(UInt i = 0; i != BUCKET_COUNT; ++i)
+		{
+			seen += _buckets[i].load(std::memory_order_relaxed);
+
+			if(!p50Found && seen >= p50Rank)
+			{
+				summary.p50Millis = bucketLowerBound(i) / NANOS_PER_MILLI;
+				p50Found = true;
+			}
+
+			if(seen >= p99Rank)
+			{
+				summary.p99Millis = bucketLowerBound(i) / NANOS_PER_MILLI;
+				break;
+			}
+		}
+
+		return summary;
+	}
+
+	void printSummary(char const* name, LatencyHistogram const& histogram)
+	{
+		auto summary = histogram.summarize();
+
+		std::printf("  %-18s %8llu samples, mean %8.3f ms, p50 %8.3f ms, p99 %8.3f ms, max %8.3f ms\n",
+			name, (unsigned long long)summary.count, summary.meanMillis, summary.p50Millis, summary.p99Millis, summary.maxMillis);
+	}
+}
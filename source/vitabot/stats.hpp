@@ -0,0 +1,65 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+
+#include <common/types.hpp>
+
+namespace vitamine::vitabot
+{
+	// latencies in nanoseconds, recorded concurrently by all reactor threads
+	// buckets grow exponentially with 8 buckets per power of two, so percentiles are accurate to within 12.5%
+	class LatencyHistogram
+	{
+		static constexpr UInt SUB_BUCKET_BITS = 3;
+		static constexpr UInt SUB_BUCKET_COUNT = 1 << SUB_BUCKET_BITS;
+		static constexpr UInt BUCKET_COUNT = 64 * SUB_BUCKET_COUNT;
+
+		std::array<std::atomic<UInt64>, BUCKET_COUNT> _buckets = {};
+		std::atomic<UInt64> _count = 0;
+		std::atomic<UInt64> _sum = 0;
+		std::atomic<UInt64> _max = 0;
+
+		static UInt bucketIndex(UInt64 value);
+		static UInt64 bucketLowerBound(UInt index);
+
+	public:
+		struct Summary
+		{
+			UInt64 count;
+			Float64 meanMillis;
+			Float64 p50Millis;
+			Float64 p99Millis;
+			Float64 maxMillis;
+		};
+
+		void record(Int64 nanos);
+
+		[[nodiscard]]
+		Summary summarize() const;
+	};
+
+	struct SwarmStats
+	{
+		std::atomic<UInt64> connecting = 0;
+		std::atomic<UInt64> playing = 0;
+		std::atomic<UInt64> failed = 0;
+
+		std::atomic<UInt64> bytesReceived = 0;
+		std::atomic<UInt64> bytesSent = 0;
+		std::atomic<UInt64> packetsReceived = 0;
+		std::atomic<UInt64> chunksReceived = 0;
+
+		// from starting to connect until the spawn teleport has been confirmed
+		LatencyHistogram connectionSetup;
+
+		// from sending the client settings until the first and the last chunk in view arrive
+		LatencyHistogram firstChunk;
+		LatencyHistogram allChunks;
+
+		// from a bot moving until another bot sees the movement
+		LatencyHistogram movementEcho;
+	};
+
+	void printSummary(char const* name, LatencyHistogram const& histogram);
+}
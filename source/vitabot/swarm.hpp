@@ -0,0 +1,60 @@
+#pragma once
+
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+
+#include <boost/asio/ip/tcp.hpp>
+
+#include <common/clockmonotonic.hpp>
+#include <common/types.hpp>
+#include <vitabot/stats.hpp>
+
+namespace vitamine::vitabot
+{
+	class Bot;
+
+	struct SwarmSettings
+	{
+		boost::asio::ip::tcp::endpoint endpoint = {boost::asio::ip::address_v4::loopback(), 1337};
+		std::string namePrefix = "bot";
+
+		UInt botCount = 100;
+		Float64 connectsPerSecond = 100;
+
+		UInt8 viewDistance = 4;
+
+		// actions per second and bot
+		Float64 moveRate = 10;
+		Float64 rotateRate = 2;
+		Float64 digRate = 0.5;
+		Float64 chatRate = 0.1;
+
+		// bots walk back and forth along the x axis within this distance of the spawn
+		Float64 walkRadius = 24;
+	};
+
+	// state shared by all bots of one process
+	struct Swarm
+	{
+		SwarmSettings settings;
+		SwarmStats stats;
+		MonotonicClock clock;
+
+		// maps the entity ids assigned by the server back to bots, to match movement updates to the movement that caused them
+		mutable std::shared_mutex entitiesMutex;
+		std::unordered_map<Int32, Bot*> entities;
+
+		void registerEntity(Int32 entityId, Bot* bot)
+		{
+			std::unique_lock lock(entitiesMutex);
+			entities[entityId] = bot;
+		}
+
+		void unregisterEntity(Int32 entityId)
+		{
+			std::unique_lock lock(entitiesMutex);
+			entities.erase(entityId);
+		}
+	};
+}
@@ -0,0 +1,79 @@
+#include <memory>
+#include <random>
+#include <vector>
+
+#include <openssl/evp.h>
+
+#include <common/aescfb8.hpp>
+#include <vitacheck/checks.hpp>
+
+namespace vitamine::vitacheck
+{
+	// fixed, so that a failure can be reproduced
+	constexpr UInt64 AES_RANDOM_SEED = 0x6165736366623800ull;
+
+	constexpr UInt AES_RANDOM_STREAM_COUNT = 200;
+	constexpr UInt AES_MAX_STREAM_SIZE = 64 * 1024;
+
+	// the whole stream in a single call, as the reference
+	static
+	std::vector<UInt8> evpCfb8(UInt8 const* key, std::vector<UInt8> const& in, bool encrypt)
+	{
+		std::unique_ptr<EVP_CIPHER_CTX, decltype(&EVP_CIPHER_CTX_free)> context(EVP_CIPHER_CTX_new(), EVP_CIPHER_CTX_free);
+		std::vector<UInt8> out(in.size());
+		int written = 0;
+
+		if(!context || EVP_CipherInit_ex(&*context, EVP_aes_128_cfb8(), nullptr, key, key, encrypt) != 1
+		|| EVP_CipherUpdate(&*context, out.data(), &written, in.data(), (int)in.size()) != 1)
+			out.clear();
+
+		return out;
+	}
+
+	// in place, in chunks of random size, like packets arriving and leaving one after another
+	template <typename F>
+	static
+	void inChunks(std::mt19937_64& random, std::vector<UInt8>& data, F&& f)
+	{
+		for(UInt offset = 0; offset != data.size();)
+		{
+			// mostly small chunks, so that every remainder of the 8 block pipeline occurs
+			auto size = random() % 4 == 0 ? random() % 4096 : random() % 160;
+			size = std::min<UInt>(size, data.size() - offset);
+
+			f(data.data() + offset, size);
+			offset += size;
+		}
+	}
+
+	bool checkAesCfb8()
+	{
+		CheckResult result(AesCfb8::hardwareAccelerated() ? "aes-cfb8 (aes-ni)" : "aes-cfb8 (openssl)");
+		std::mt19937_64 random(AES_RANDOM_SEED);
+
+		for(UInt stream = 0; stream != AES_RANDOM_STREAM_COUNT; ++stream)
+		{
+			UInt8 key[AES_CFB8_KEY_SIZE];
+
+			for(auto& byte : key)
+				byte = (UInt8)random();
+
+			std::vector<UInt8> plaintext(random() % AES_MAX_STREAM_SIZE);
+
+			for(auto& byte : plaintext)
+				byte = (UInt8)random();
+
+			AesCfb8 cipher(Span(key, sizeof key));
+
+			auto encrypted = plaintext;
+			inChunks(random, encrypted, [&](UInt8* data, UInt size){ cipher.encrypt(data, data, size); });
+			result.expect(encrypted == evpCfb8(key, plaintext, true), "encryption of stream %lu, %lu bytes", (unsigned long)stream, (unsigned long)plaintext.size());
+
+			auto decrypted = encrypted;
+			inChunks(random, decrypted, [&](UInt8* data, UInt size){ cipher.decrypt(data, data, size); });
+			result.expect(decrypted == evpCfb8(key, encrypted, false) && decrypted == plaintext, "decryption of stream %lu, %lu bytes", (unsigned long)stream, (unsigned long)plaintext.size());
+		}
+
+		return result.report();
+	}
+}
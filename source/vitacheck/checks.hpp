@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdio>
+
+#include <common/types.hpp>
+
+namespace vitamine::vitacheck
+{
+	// counts the cases a check ran and reports the first few mismatches
+	class CheckResult
+	{
+		static constexpr UInt MAX_REPORTED_FAILURES = 10;
+
+		char const* _name;
+		UInt _cases = 0;
+		UInt _failures = 0;
+
+	public:
+		explicit CheckResult(char const* name)
+		: _name(name)
+		{}
+
+		template <typename... Args>
+		void expect(bool condition, char const* format, Args... args)
+		{
+			++_cases;
+
+			if(condition)
+				return;
+
+			if(_failures++ < MAX_REPORTED_FAILURES)
+			{
+				std::printf("%s: ", _name);
+				std::printf(format, args...);
+				std::printf("\n");
+			}
+		}
+
+		bool report() const
+		{
+			std::printf("%s: %lu cases, %lu failures\n", _name, (unsigned long)_cases, (unsigned long)_failures);
+			return _failures == 0;
+		}
+	};
+
+	// the fast and batch varint paths against the scalar reference implementations
+	bool checkVarIntEncoding();
+	bool checkVarIntDecoding();
+
+	// the validator against its scalar reference, and the conversion to modified utf-8 and back
+	bool checkUtf8Validation();
+	bool checkModifiedUtf8RoundTrip();
+
+	// the aes-ni kernels against openssl, on streams encrypted and decrypted in chunks
+	bool checkAesCfb8();
+}
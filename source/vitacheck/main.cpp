@@ -0,0 +1,25 @@
+#include <cstdio>
+
+#include <vitacheck/checks.hpp>
+
+using namespace vitamine::vitacheck;
+
+// compares the optimized code paths with their reference implementations, exits with 1 on a mismatch
+int main()
+{
+	bool (*const CHECKS[])() = {
+		checkVarIntEncoding,
+		checkVarIntDecoding,
+		checkUtf8Validation,
+		checkModifiedUtf8RoundTrip,
+		checkAesCfb8,
+	};
+
+	bool passed = true;
+
+	for(auto check : CHECKS)
+		passed &= check();
+
+	std::printf(passed ? "all checks passed\n" : "checks failed\n");
+	return passed ? 0 : 1;
+}
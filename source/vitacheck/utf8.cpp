@@ -0,0 +1,169 @@
+#include <random>
+#include <string>
+
+#include <common/arena.hpp>
+#include <common/utf8.hpp>
+#include <vitacheck/checks.hpp>
+
+namespace vitamine::vitacheck
+{
+	// fixed, so that a failure can be reproduced
+	constexpr UInt64 UTF8_RANDOM_SEED = 0x7574663863686b00ull;
+
+	constexpr UInt UTF8_RANDOM_STRING_COUNT = 20000;
+
+	// sentinel bytes behind the output of utf8ToModifiedUtf8, which must stay untouched
+	constexpr UInt UTF8_GUARD_SIZE = 16;
+
+	static
+	void appendCodePoint(std::string& str, UInt32 c)
+	{
+		if(c < 0x80)
+			str += (char)c;
+		else if(c < 0x800)
+		{
+			str += (char)(0xc0 | c >> 6);
+			str += (char)(0x80 | (c & 0x3f));
+		}
+		else if(c < 0x10000)
+		{
+			str += (char)(0xe0 | c >> 12);
+			str += (char)(0x80 | (c >> 6 & 0x3f));
+			str += (char)(0x80 | (c & 0x3f));
+		}
+		else
+		{
+			str += (char)(0xf0 | c >> 18);
+			str += (char)(0x80 | (c >> 12 & 0x3f));
+			str += (char)(0x80 | (c >> 6 & 0x3f));
+			str += (char)(0x80 | (c & 0x3f));
+		}
+	}
+
+	// every encoded length, U+0000, and long runs of ascii that take the skipping path
+	static
+	std::string makeValidUtf8(std::mt19937_64& random)
+	{
+		std::string str;
+
+		for(UInt i = random() % 64; i != 0; --i)
+		{
+			switch(random() % 6)
+			{
+			case 0: str.append(random() % 48, 'a'); break;
+			case 1: appendCodePoint(str, random() % 0x80); break;
+			case 2: appendCodePoint(str, 0x80 + random() % (0x800 - 0x80)); break;
+			case 3:
+			{
+				// no surrogates
+				auto c = 0x800 + random() % (0x10000 - 0x800 - 0x800);
+				appendCodePoint(str, c < 0xd800 ? c : c + 0x800);
+				break;
+			}
+			case 4: appendCodePoint(str, 0x10000 + random() % (0x110000 - 0x10000)); break;
+			default: appendCodePoint(str, 0); break;
+			}
+		}
+
+		return str;
+	}
+
+	// sequences that are invalid on their own or next to their neighbours
+	static
+	void corrupt(std::mt19937_64& random, std::string& str)
+	{
+		static char const* const INVALID[] = {
+			"\x80", "\xbf", "\xc0\x80", "\xc1\xbf", "\xe0\x80\x80", "\xe0\x9f\xbf", "\xed\xa0\x80", "\xed\xbf\xbf",
+			"\xf0\x80\x80\x80", "\xf0\x8f\xbf\xbf", "\xf4\x90\x80\x80", "\xf5\x80\x80\x80", "\xff", "\xc3", "\xe4\xb8", "\xf0\x9f\x98",
+		};
+
+		for(UInt i = 1 + random() % 3; i != 0; --i)
+		{
+			auto position = str.empty() ? 0 : random() % (str.size() + 1);
+
+			switch(random() % 4)
+			{
+			case 0: str.insert(position, INVALID[random() % (sizeof INVALID / sizeof INVALID[0])]); break;
+			case 1: str.insert(position, 1, (char)random()); break;
+			case 2: if(!str.empty()) str[random() % str.size()] = (char)random(); break;
+			default: str.resize(position); break;
+			}
+		}
+	}
+
+	static
+	Span<Char8 const> spanOf(std::string const& str, UInt offset = 0, UInt size = ~(UInt)0)
+	{
+		return Span((Char8 const*)str.data() + offset, std::min(size, (UInt)str.size() - offset));
+	}
+
+	bool checkUtf8Validation()
+	{
+		CheckResult result("utf-8 validation");
+		std::mt19937_64 random(UTF8_RANDOM_SEED);
+
+		for(UInt i = 0; i != UTF8_RANDOM_STRING_COUNT; ++i)
+		{
+			std::string str;
+
+			switch(i % 3)
+			{
+			case 0: str = makeValidUtf8(random); break;
+			case 1: str = makeValidUtf8(random); corrupt(random, str); break;
+			default: for(UInt j = random() % 96; j != 0; --j) str += (char)random(); break;
+			}
+
+			// every prefix, so that the end falls on every position of the 16 and 32 byte blocks and the tail
+			for(UInt size = 0; size <= str.size(); ++size)
+			{
+				auto prefix = spanOf(str, 0, size);
+				result.expect(isValidUtf8(prefix) == isValidUtf8Scalar(prefix), "prefix of %lu bytes of string %lu", (unsigned long)size, (unsigned long)i);
+			}
+
+			// and the start as well
+			for(UInt offset = 1; offset < str.size() && offset <= 32; ++offset)
+			{
+				auto suffix = spanOf(str, offset);
+				result.expect(isValidUtf8(suffix) == isValidUtf8Scalar(suffix), "suffix from %lu of string %lu", (unsigned long)offset, (unsigned long)i);
+			}
+		}
+
+		return result.report();
+	}
+
+	bool checkModifiedUtf8RoundTrip()
+	{
+		CheckResult result("modified utf-8 round trip");
+		std::mt19937_64 random(UTF8_RANDOM_SEED);
+		Arena arena;
+
+		for(UInt i = 0; i != UTF8_RANDOM_STRING_COUNT; ++i)
+		{
+			ArenaScope scope(arena);
+			auto str = makeValidUtf8(random);
+
+			auto size = modifiedUtf8Size(spanOf(str));
+			std::string converted(size + UTF8_GUARD_SIZE, '\xa5');
+			utf8ToModifiedUtf8(spanOf(str), (Char8*)converted.data());
+
+			result.expect(converted.compare(size, UTF8_GUARD_SIZE, std::string(UTF8_GUARD_SIZE, '\xa5')) == 0, "conversion of string %lu writes past its size", (unsigned long)i);
+			converted.resize(size);
+
+			// modified utf-8 has no zero bytes and no four byte sequences
+			result.expect(converted.find('\0') == std::string::npos && converted.find_first_of("\xf0\xf1\xf2\xf3\xf4") == std::string::npos, "conversion of string %lu", (unsigned long)i);
+
+			Span<Char8 const> decoded;
+			auto valid = modifiedUtf8ToUtf8(spanOf(converted), &decoded, arena);
+			result.expect(valid && decoded.size() == str.size() && std::equal(decoded.begin(), decoded.end(), (Char8 const*)str.data()), "round trip of string %lu", (unsigned long)i);
+
+			// whatever is accepted after corruption has to be valid utf-8
+			corrupt(random, converted);
+			Span<Char8 const> corrupted;
+
+			if(modifiedUtf8ToUtf8(spanOf(converted), &corrupted, arena))
+				result.expect(isValidUtf8Scalar(corrupted), "corrupted string %lu decodes to invalid utf-8", (unsigned long)i);
+		}
+
+		return result.report();
+	}
+}
@@ -0,0 +1,152 @@
+#include <cstring>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include <common/buffer.hpp>
+#include <proxyd/deserialize.hpp>
+#include <proxyd/serialize.hpp>
+#include <vitacheck/checks.hpp>
+
+namespace vitamine::vitacheck
+{
+	using namespace vitamine::proxyd;
+
+	// fixed, so that a failure can be reproduced
+	constexpr UInt64 RANDOM_SEED = 0x766974616d696e65ull;
+
+	constexpr UInt RANDOM_VALUE_COUNT = 100000;
+	constexpr UInt RANDOM_STREAM_COUNT = 2000;
+
+	static
+	std::vector<Int32> makeValues(std::mt19937_64& random)
+	{
+		std::vector<Int32> values = {0, 1, 0x7f, 0x80, 0x3fff, 0x4000, 0x1fffff, 0x200000, 0xfffffff, 0x10000000, 0x7fffffff, -1, std::numeric_limits<Int32>::min()};
+
+		// random bit lengths, so that every encoded length is equally likely
+		for(UInt i = 0; i != RANDOM_VALUE_COUNT; ++i)
+			values.push_back((Int32)(UInt32)(random() >> (32 + random() % 33)));
+
+		return values;
+	}
+
+	static
+	std::vector<UInt8> encodeScalar(std::vector<Int32> const& values)
+	{
+		std::vector<UInt8> bytes;
+		UInt8 buf[proxyd::detail::VARINT32_MAX_ENCODED_SIZE];
+
+		for(auto value : values)
+		{
+			auto length = proxyd::detail::encodeVarInt32Scalar(buf, value);
+			bytes.insert(bytes.end(), buf, buf + length);
+		}
+
+		return bytes;
+	}
+
+	bool checkVarIntEncoding()
+	{
+		CheckResult result("varint encoding");
+		std::mt19937_64 random(RANDOM_SEED);
+		auto values = makeValues(random);
+
+		for(auto value : values)
+		{
+			UInt8 expected[proxyd::detail::VARINT32_MAX_ENCODED_SIZE];
+			UInt8 actual[proxyd::detail::VARINT32_MAX_ENCODED_SIZE];
+			auto expectedLength = proxyd::detail::encodeVarInt32Scalar(expected, value);
+			auto actualLength = proxyd::detail::encodeVarInt32(actual, value);
+
+			result.expect(proxyd::detail::wireSizeVarInt32(value) == proxyd::detail::wireSizeVarInt32Scalar(value), "wire size of %d", value);
+			result.expect(actualLength == expectedLength && std::memcmp(actual, expected, expectedLength) == 0, "encoding of %d", value);
+		}
+
+		auto expected = encodeScalar(values);
+
+		// the batch path on its own and through serializeVarIntArray, which splits the values into blocks
+		std::vector<UInt8> batch(values.size() * proxyd::detail::VARINT32_MAX_ENCODED_SIZE);
+		batch.resize(proxyd::detail::encodeVarInt32Batch(batch.data(), Span(values.data(), values.size())));
+		result.expect(batch == expected, "batch encoding of %lu values", (unsigned long)values.size());
+
+		Buffer buffer;
+		serializeVarIntArray(buffer, Span<Int32 const>(values.data(), values.size()));
+		result.expect(buffer.size() == expected.size() && std::memcmp(buffer.data(), expected.data(), expected.size()) == 0, "serializeVarIntArray of %lu values", (unsigned long)values.size());
+		result.expect(serializedSizeVarIntArray(Span<Int32 const>(values.data(), values.size())) == expected.size(), "serializedSizeVarIntArray");
+
+		return result.report();
+	}
+
+	// valid varints, optionally followed by random bytes or cut off, with some bytes corrupted
+	static
+	std::vector<UInt8> makeStream(std::mt19937_64& random)
+	{
+		std::vector<Int32> values(random() % 100);
+
+		for(auto& value : values)
+			value = (Int32)(UInt32)(random() >> (32 + random() % 33));
+
+		auto bytes = encodeScalar(values);
+
+		// mostly continuation bytes, so that overlong varints are common
+		if(random() % 2)
+			for(UInt i = random() % 32; i != 0; --i)
+				bytes.push_back((UInt8)(random() | (random() % 4 != 0 ? 0x80u : 0u)));
+
+		if(random() % 4 == 0 && !bytes.empty())
+			bytes.resize(random() % bytes.size());
+
+		if(random() % 4 == 0)
+			for(UInt i = random() % 4; i != 0 && !bytes.empty(); --i)
+				bytes[random() % bytes.size()] |= 0x80u;
+
+		return bytes;
+	}
+
+	bool checkVarIntDecoding()
+	{
+		CheckResult result("varint decoding");
+		std::mt19937_64 random(RANDOM_SEED);
+
+		for(UInt stream = 0; stream != RANDOM_STREAM_COUNT; ++stream)
+		{
+			auto bytes = makeStream(random);
+
+			for(UInt offset = 0; offset <= bytes.size(); ++offset)
+			{
+				// a single varint at every offset
+				auto expectedp = (UInt8 const*)bytes.data() + offset;
+				auto expectedSize = bytes.size() - offset;
+				Int32 expectedValue = 0;
+				auto expected = deserializeVarIntScalar(&expectedp, &expectedSize, &expectedValue);
+
+				auto actualp = (UInt8 const*)bytes.data() + offset;
+				auto actualSize = bytes.size() - offset;
+				Int32 actualValue = 0;
+				auto actual = deserializeVarInt(&actualp, &actualSize, &actualValue);
+
+				result.expect(actual == expected && (expected != DeserializeStatus::OK || (actualValue == expectedValue && actualp == expectedp && actualSize == expectedSize)), "varint at offset %lu of stream %lu", (unsigned long)offset, (unsigned long)stream);
+
+				// a batch of random length, which may ask for more varints than there are
+				auto count = random() % 120;
+				std::vector<Int32> expectedValues(count);
+				std::vector<Int32> actualValues(count);
+
+				auto expectedBatchp = (UInt8 const*)bytes.data() + offset;
+				auto expectedBatchSize = bytes.size() - offset;
+				auto expectedBatch = DeserializeStatus::OK;
+
+				for(UInt i = 0; i != count && expectedBatch == DeserializeStatus::OK; ++i)
+					expectedBatch = deserializeVarIntScalar(&expectedBatchp, &expectedBatchSize, &expectedValues[i]);
+
+				auto actualBatchp = (UInt8 const*)bytes.data() + offset;
+				auto actualBatchSize = bytes.size() - offset;
+				auto actualBatch = deserializeVarIntBatch(&actualBatchp, &actualBatchSize, actualValues.data(), count);
+
+				result.expect(actualBatch == expectedBatch && (expectedBatch != DeserializeStatus::OK || (actualValues == expectedValues && actualBatchp == expectedBatchp && actualBatchSize == expectedBatchSize)), "batch of %lu at offset %lu of stream %lu", (unsigned long)count, (unsigned long)offset, (unsigned long)stream);
+			}
+		}
+
+		return result.report();
+	}
+}
@@ -0,0 +1,241 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/asio/io_service.hpp>
+
+#include <common/clockvirtual.hpp>
+#include <common/net/capture.hpp>
+#include <proxyd/proxyserver.hpp>
+#include <vitareplay/replayconnection.hpp>
+
+using namespace vitamine;
+using namespace vitamine::proxyd;
+using namespace vitamine::vitareplay;
+
+struct ReplayOptions
+{
+	// sleeps until each record is due instead of replaying as fast as possible
+	bool realtime = false;
+	Float64 speed = 1;
+
+	// the compression threshold is taken from the capture, the compression levels only affect what the server sends
+	ServerSettings serverSettings;
+};
+
+struct ReplayStats
+{
+	UInt64 records = 0;
+	UInt64 connections = 0;
+	UInt64 serverDisconnects = 0;
+
+	UInt64 inboundBytes = 0;
+	UInt64 recordedOutboundBytes = 0;
+	UInt64 replayedOutboundBytes = 0;
+	UInt64 replayedOutboundPackets = 0;
+
+	Int64 captureNanos = 0;
+	Int64 replayNanos = 0;
+};
+
+static
+void usage(char const* argv0)
+{
+	std::printf("usage: %s <capture> [--realtime] [--speed <factor>] [--repeat <count>] [--compression-levels <min> <max>]\n", argv0);
+	std::exit(1);
+}
+
+// feeds one capture into a fresh server, all on the calling thread
+// the server's clock follows the capture, so timeouts and keep alives happen as they did when it was recorded
+static
+ReplayStats replay(char const* path, ReplayOptions const& options)
+{
+	CaptureReader reader(path);
+
+	// encryption responses only decrypt with the captured server's key pair, and logins would need the session server
+	if(reader.settings().onlineMode)
+		throw std::runtime_error("the capture was recorded in online mode, which cannot be replayed");
+
+	auto serverSettings = options.serverSettings;
+	serverSettings.compressionThreshold = reader.settings().compressionThreshold;
+
+	// never run, ticks are driven by the virtual clock
+	boost::asio::io_service service;
+	VirtualClock clock;
+	ProxyServer proxy(&service, serverSettings, nullptr, &clock);
+
+	std::unordered_map<UInt32, std::shared_ptr<ReplayConnection>> connections;
+	std::vector<ReplayConnection*> disconnected;
+	std::vector<std::function<void()>> posted;
+	ReplayStats stats;
+
+	auto remove = [&](UInt32 id)
+	{
+		auto it = connections.find(id);
+
+		if(it == connections.end())
+			return;
+
+		auto connection = std::move(it->second);
+		connections.erase(it);
+
+		proxy.onClientDisconnected(connection);
+		stats.replayedOutboundBytes += connection->bytesSent;
+		stats.replayedOutboundPackets += connection->packetsSent;
+	};
+
+	// runs what connections posted, then removes the connections the server disconnected
+	// later records of disconnected connections are skipped
+	auto processDeferred = [&]
+	{
+		// posted functions may disconnect as well and post more functions
+		while(!posted.empty())
+		{
+			auto functions = std::move(posted);
+			posted.clear();
+
+			for(auto& f : functions)
+				f();
+		}
+
+		while(!disconnected.empty())
+		{
+			auto connection = disconnected.back();
+			disconnected.pop_back();
+
+			++stats.serverDisconnects;
+			remove(connection->id());
+		}
+	};
+
+	constexpr Int64 TICK_NANOS = TICK_TIMER_PERIOD_MILLIS * 1'000'000;
+	Int64 nextTick = TICK_NANOS;
+
+	auto wallStart = std::chrono::steady_clock::now();
+	CaptureRecord record;
+
+	while(reader.next(&record))
+	{
+		++stats.records;
+
+		// ticks that were due between the previous record and this one
+		for(; nextTick <= record.time; nextTick += TICK_NANOS)
+		{
+			clock.set(nextTick);
+			proxy.tickStateMachines();
+			processDeferred();
+		}
+
+		clock.set(record.time);
+
+		if(options.realtime)
+			std::this_thread::sleep_until(wallStart + std::chrono::nanoseconds((Int64)(record.time / options.speed)));
+
+		switch(record.type)
+		{
+		case CaptureRecordType::CONNECT:
+		{
+			auto connection = std::make_shared<ReplayConnection>(record.connection, &disconnected, &posted);
+			connections[record.connection] = connection;
+			proxy.onClientConnected(connection);
+			++stats.connections;
+			break;
+		}
+
+		case CaptureRecordType::INBOUND:
+		{
+			auto it = connections.find(record.connection);
+
+			if(it != connections.end())
+			{
+				stats.inboundBytes += record.data.size();
+				proxy.onDataReceived(it->second, record.data);
+			}
+
+			break;
+		}
+
+		case CaptureRecordType::OUTBOUND:
+			stats.recordedOutboundBytes += record.data.size();
+			break;
+
+		case CaptureRecordType::DISCONNECT:
+			remove(record.connection);
+			break;
+		}
+
+		processDeferred();
+		stats.captureNanos = record.time;
+	}
+
+	// connections that were still open when the capture ended
+	while(!connections.empty())
+		remove(connections.begin()->first);
+
+	stats.replayNanos = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - wallStart).count();
+	return stats;
+}
+
+int main(int argc, char** argv)
+{
+	if(argc < 2)
+		usage(argv[0]);
+
+	char const* path = argv[1];
+	ReplayOptions options;
+	UInt repeat = 1;
+
+	for(int i = 2; i < argc; ++i)
+	{
+		if(std::strcmp(argv[i], "--realtime") == 0)
+			options.realtime = true;
+		else if(std::strcmp(argv[i], "--speed") == 0 && i + 1 < argc)
+			options.speed = std::strtod(argv[++i], nullptr);
+		else if(std::strcmp(argv[i], "--repeat") == 0 && i + 1 < argc)
+			repeat = std::strtoul(argv[++i], nullptr, 10);
+		else if(std::strcmp(argv[i], "--compression-levels") == 0 && i + 2 < argc)
+		{
+			options.serverSettings.compressionLevels.min = std::strtol(argv[++i], nullptr, 10);
+			options.serverSettings.compressionLevels.max = std::strtol(argv[++i], nullptr, 10);
+		}
+		else
+			usage(argv[0]);
+	}
+
+	if(options.speed <= 0)
+		usage(argv[0]);
+
+	for(UInt i = 0; i != repeat; ++i)
+	{
+		ReplayStats stats;
+
+		try
+		{
+			stats = replay(path, options);
+		}
+		catch(std::exception const& e)
+		{
+			std::printf("replay failed: %s\n", e.what());
+			return 1;
+		}
+
+		auto replaySeconds = stats.replayNanos / 1e9;
+
+		std::printf("replayed %llu records of %llu connections, %.3fs of traffic in %.3fs (%.2f MB/s inbound)\n",
+			(unsigned long long)stats.records, (unsigned long long)stats.connections,
+			stats.captureNanos / 1e9, replaySeconds, stats.inboundBytes / replaySeconds / 1e6);
+
+		std::printf("  inbound %llu bytes, outbound %llu bytes in %llu packets (%llu bytes captured), %llu connections disconnected by the server\n",
+			(unsigned long long)stats.inboundBytes, (unsigned long long)stats.replayedOutboundBytes,
+			(unsigned long long)stats.replayedOutboundPackets, (unsigned long long)stats.recordedOutboundBytes,
+			(unsigned long long)stats.serverDisconnects);
+	}
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <common/sharedbuffer.hpp>
+#include <common/span.hpp>
+#include <common/types.hpp>
+#include <common/net/connection.hpp>
+
+namespace vitamine::vitareplay
+{
+	// stands in for a transport connection, everything sent is counted and discarded
+	class ReplayConnection : public IConnection
+	{
+		ConnectionId _id;
+		void* _userPointer = nullptr;
+
+		// connections the server disconnected, the replay reports them to the server once the current callback returns
+		std::vector<ReplayConnection*>* _disconnected;
+
+		// functions posted to the connection, the replay runs them once the current callback returns
+		std::vector<std::function<void()>>* _posted;
+
+		bool _disconnectRequested = false;
+
+	public:
+		UInt64 bytesSent = 0;
+		UInt64 packetsSent = 0;
+
+		ReplayConnection(ConnectionId id, std::vector<ReplayConnection*>* disconnected, std::vector<std::function<void()>>* posted)
+		: _id(id), _disconnected(disconnected), _posted(posted)
+		{}
+
+		ConnectionId id() const final
+		{
+			return _id;
+		}
+
+		std::string endpoint() const final
+		{
+			return "replay:" + std::to_string(_id);
+		}
+
+		void userPointer(void* ptr) final
+		{
+			_userPointer = ptr;
+		}
+
+		void* userPointer() final
+		{
+			return _userPointer;
+		}
+
+		WriteQueueDepth writeQueueDepth() const final
+		{
+			return {0, 0, false};
+		}
+
+		void send(SharedBuffer buffer, SendPolicy policy) final
+		{
+			(void)policy;
+			bytesSent += buffer.size();
+			++packetsSent;
+		}
+
+		void disconnect() final
+		{
+			if(_disconnectRequested)
+				return;
+
+			_disconnectRequested = true;
+			_disconnected->push_back(this);
+		}
+
+		// the capture holds the decrypted stream, so there is nothing to decrypt
+		void enableEncryption(Span<UInt8 const> sharedSecret) final
+		{
+			(void)sharedSecret;
+		}
+
+		void post(std::function<void()> f) final
+		{
+			_posted->push_back(std::move(f));
+		}
+	};
+}